@@ -0,0 +1,2478 @@
+/********************************************************************
+ *    rtc_bench.cpp
+ *
+ *    Host side benchmark for the STM32LIBS_RTC library. The library is
+ *    built against the register simulator (STM32LIBS_SIM), no target
+ *    hardware needed:
+ *
+ *      g++ -O2 -pthread -DSTM32LIBS_HOST_SIM -DRTC_MAX_ALARMS=4096 \
+ *          -DRTC_MAX_WHEEL_TIMERS=4096 -I../../src \
+ *          rtc_bench.cpp ../../src/STM32LIBS_*.cpp -o rtc_bench
+ *
+ *    Compares the legacy (year / month loop) epoch conversions with the
+ *    constant time conversions in STM32LIBS_CALENDAR.h over the full 32 bit
+ *    epoch range and verifies both produce identical results, then runs
+ *    the library itself on the simulated RTC.
+ *
+ *      rtc_bench --hot [--save file] [--check file]
+ *
+ *    runs only the hot path suite (ns/op, heap allocations) and saves or
+ *    checks a baseline, see benchHotPaths(). The Makefile has the targets.
+ *
+\*******************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <chrono>
+#include <thread>
+#include "STM32LIBS_RTC.h"
+#include "STM32LIBS_ALARMS.h"
+#include "STM32LIBS_WHEEL.h"
+#include "STM32LIBS_KV.h"
+#include "STM32LIBS_SCHEMA.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <atomic>
+#include <algorithm>
+#include <new>
+
+typedef struct
+{
+  uint8_t seconds;
+  uint8_t minutes;
+  uint8_t hours;
+  uint8_t day;
+  uint8_t weekday;
+  uint8_t month;
+  uint16_t year;
+} bench_datetime_t;
+
+static const uint8_t legacyMonthDays[] = {31,28,31,30,31,30,31,31,30,31,30,31};
+#define LEGACY_IS_LEAP_YEAR(Y)   ( ((1970+(Y))>0) && !((1970+(Y))%4) && ( ((1970+(Y))%100) || !((1970+(Y))%400) ) )
+
+/********************************************************************
+ *  @brief epoch decode as shipped in V1.0.0 (loops over years & months)
+\*******************************************************************/
+static void legacyEpochToDateTime(bench_datetime_t *dt, uint32_t _epoch)
+{
+  uint8_t _month, monthLength;
+  uint32_t _days = 0;
+  uint32_t _time = _epoch;
+
+  dt->seconds = _time % 60;
+  _time /= 60;
+  dt->minutes = _time % 60;
+  _time /= 60;
+  dt->hours = _time % 24;
+  _time /= 24;
+  dt->weekday = ((_time + 4) % 7);
+
+  dt->year = 0;
+  while((unsigned)(_days += (LEGACY_IS_LEAP_YEAR(dt->year) ? 366 : 365)) <= _time)
+    dt->year++;
+
+  _days -= LEGACY_IS_LEAP_YEAR(dt->year) ? 366 : 365;
+  _time -= _days;
+
+  for (_month=0; _month<12; _month++)
+  {
+    if (_month == 1)
+      monthLength = LEGACY_IS_LEAP_YEAR(dt->year) ? 29 : 28;
+    else
+      monthLength = legacyMonthDays[_month];
+
+    if (_time >= monthLength)
+      _time -= monthLength;
+    else
+      break;
+  }
+  dt->year += 1970;
+  dt->month = _month + 1;
+  dt->day = _time + 1;
+}
+
+/********************************************************************
+ *  @brief epoch encode as shipped in V1.0.0 (loops over years & months)
+\*******************************************************************/
+static uint32_t legacyDateTimeToEpoch(const bench_datetime_t *dt)
+{
+  int16_t i;
+  uint32_t _seconds;
+  int16_t _year = (dt->year - 1970);
+
+  _seconds = _year * (86400UL * 365);
+  for (i = 0; i < _year; i++)
+  {
+    if (LEGACY_IS_LEAP_YEAR(i))
+      _seconds += 86400UL;
+  }
+  for (i = 1; i < dt->month; i++)
+  {
+    if ((i == 2) && LEGACY_IS_LEAP_YEAR(_year))
+      _seconds += 86400UL * 29;
+    else
+      _seconds += 86400UL * legacyMonthDays[i-1];
+  }
+  _seconds += (dt->day-1) * 86400UL;
+  _seconds += dt->hours * 3600UL;
+  _seconds += dt->minutes * 60UL;
+  _seconds += dt->seconds;
+  return _seconds;
+}
+
+static void fastEpochToDateTime(bench_datetime_t *dt, uint32_t _epoch)
+{
+  uint32_t sod;
+  uint32_t days = calSplitEpoch(_epoch, &sod);
+
+  calSplitTime(sod, &dt->hours, &dt->minutes, &dt->seconds);
+  dt->weekday = calWeekday(days);
+  calCivilFromDays(days, &dt->year, &dt->month, &dt->day);
+}
+
+static bool sameDateTime(const bench_datetime_t *a, const bench_datetime_t *b)
+{
+  return a->seconds == b->seconds && a->minutes == b->minutes && a->hours == b->hours &&
+         a->day == b->day && a->weekday == b->weekday && a->month == b->month &&
+         a->year == b->year;
+}
+
+static double nowNs(void)
+{
+  return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(
+           std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/********************************************************************
+ *  heap allocation counter for the hot path suite. On glibc malloc,
+ *  calloc & realloc are interposed (operator new ends up in malloc),
+ *  elsewhere only operator new is counted.
+\*******************************************************************/
+static std::atomic<uint32_t> heapAllocs(0);
+
+#if defined(__GLIBC__)
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t n, size_t size);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+
+extern "C" void *malloc(size_t size) __THROW
+{
+  heapAllocs.fetch_add(1, std::memory_order_relaxed);
+  return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t n, size_t size) __THROW
+{
+  heapAllocs.fetch_add(1, std::memory_order_relaxed);
+  return __libc_calloc(n, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size) __THROW
+{
+  heapAllocs.fetch_add(1, std::memory_order_relaxed);
+  return __libc_realloc(ptr, size);
+}
+#else
+void *operator new(size_t size)
+{
+  void *ptr = malloc(size ? size : 1);
+
+  heapAllocs.fetch_add(1, std::memory_order_relaxed);
+  if(ptr == nullptr)
+    throw std::bad_alloc();
+  return ptr;
+}
+
+void *operator new[](size_t size) { return operator new(size); }
+void operator delete(void *ptr) noexcept { free(ptr); }
+void operator delete[](void *ptr) noexcept { free(ptr); }
+void operator delete(void *ptr, size_t) noexcept { free(ptr); }
+void operator delete[](void *ptr, size_t) noexcept { free(ptr); }
+#endif
+
+// odd stride so every second of the day / day of the year gets hit
+#define EPOCH_STRIDE    4099UL
+
+/********************************************************************
+ *  @brief decode benchmark over the whole 32 bit epoch range
+\*******************************************************************/
+static int benchEpochDecode(void)
+{
+  bench_datetime_t a, b;
+  uint64_t e;
+  uint32_t errors = 0;
+  uint32_t n = 0;
+  volatile uint32_t sink = 0;
+  double t0, tLegacy, tFast;
+
+  // correctness: every day boundary, plus the last second of the range
+  for(e = 0; e <= 0xFFFFFFFFULL; e += (e % 86400 == 0) ? 86399 : 1)
+  {
+    legacyEpochToDateTime(&a, (uint32_t)e);
+    fastEpochToDateTime(&b, (uint32_t)e);
+    if(!sameDateTime(&a, &b))
+    {
+      if(errors++ < 10)
+        printf("  mismatch at epoch %lu\n", (unsigned long)e);
+    }
+  }
+
+  t0 = nowNs();
+  for(e = 0; e <= 0xFFFFFFFFULL; e += EPOCH_STRIDE, n++)
+  {
+    legacyEpochToDateTime(&a, (uint32_t)e);
+    sink += a.day;
+  }
+  tLegacy = nowNs() - t0;
+
+  t0 = nowNs();
+  for(e = 0; e <= 0xFFFFFFFFULL; e += EPOCH_STRIDE)
+  {
+    fastEpochToDateTime(&b, (uint32_t)e);
+    sink += b.day;
+  }
+  tFast = nowNs() - t0;
+
+  printf("epochToDateTime  (%lu samples, 1970 - 2106)\n", (unsigned long)n);
+  printf("  legacy loop     %8.2f ns/op\n", tLegacy / n);
+  printf("  constant time   %8.2f ns/op\n", tFast / n);
+  printf("  mismatches      %lu\n", (unsigned long)errors);
+  return errors ? 1 : 0;
+}
+
+/********************************************************************
+ *  @brief encode benchmark, round trips every day of the 32 bit range
+\*******************************************************************/
+static int benchEpochEncode(void)
+{
+  static bench_datetime_t dts[50000];
+  uint32_t i, n = 0;
+  uint32_t e, errors = 0;
+  volatile uint32_t sink = 0;
+  double t0, tLegacy, tFast;
+
+  for(i = 0; i < 49710; i++, n++)
+    fastEpochToDateTime(&dts[i], i * 86400UL + (i * 7919UL) % 86400UL);
+
+  for(i = 0; i < n; i++)
+  {
+    bench_datetime_t *d = &dts[i];
+    if(!calDateTimeToEpoch(d->year, d->month, d->day, d->hours, d->minutes, d->seconds, &e) ||
+       e != legacyDateTimeToEpoch(d))
+    {
+      if(errors++ < 10)
+        printf("  mismatch at day %lu\n", (unsigned long)i);
+    }
+  }
+  // out of range elements must be rejected
+  if(calDateTimeToEpoch(2021, 2, 29, 0, 0, 0, &e) || calDateTimeToEpoch(2106, 2, 7, 6, 28, 16, &e) ||
+     calDateTimeToEpoch(1969, 12, 31, 23, 59, 59, &e) || !calDateTimeToEpoch(2106, 2, 7, 6, 28, 15, &e))
+    errors++;
+
+  t0 = nowNs();
+  for(i = 0; i < n; i++)
+    sink += legacyDateTimeToEpoch(&dts[i]);
+  tLegacy = nowNs() - t0;
+
+  t0 = nowNs();
+  for(i = 0; i < n; i++)
+  {
+    bench_datetime_t *d = &dts[i];
+    calDateTimeToEpoch(d->year, d->month, d->day, d->hours, d->minutes, d->seconds, &e);
+    sink += e;
+  }
+  tFast = nowNs() - t0;
+
+  printf("dateTimeToEpoch  (%lu samples, 1970 - 2106)\n", (unsigned long)n);
+  printf("  legacy loop     %8.2f ns/op\n", tLegacy / n);
+  printf("  constant time   %8.2f ns/op\n", tFast / n);
+  printf("  mismatches      %lu\n", (unsigned long)errors);
+  return errors ? 1 : 0;
+}
+
+static STM32LIBS_RTC &rtc = STM32LIBS_RTC::getInstance();
+static STM32LIBS_SIM &sim = STM32LIBS_SIM::getInstance();
+static volatile uint32_t benchAlarms;
+
+static void benchAlarmCallback(void *data)
+{
+  (void)data;
+  benchAlarms++;
+  rtc.setAlarmFromEpoch(rtc.getEpoch() + 3600);
+}
+
+/********************************************************************
+ *  @brief the getDateTime() cache against a full decode: the cached
+ *    datetime is advanced over minute, hour, day, month, year, leap day
+ *    and 2038 / 2106 boundaries, by steps from 1 s to just under a day
+\*******************************************************************/
+static uint32_t checkAdvance(uint32_t *steps, uint32_t *uncached)
+{
+  static const uint16_t edges[][6] = {
+    {2024, 6, 15, 12, 31, 0}, {2024, 6, 15, 13, 0, 0}, {2024, 6, 16, 0, 0, 0},   // minute, hour, day
+    {2024, 2, 1, 0, 0, 0}, {2024, 5, 1, 0, 0, 0}, {2024, 1, 1, 0, 0, 0},         // 31 & 30 day months, year
+    {2024, 2, 29, 0, 0, 0}, {2024, 3, 1, 0, 0, 0}, {2023, 3, 1, 0, 0, 0},        // leap day, after Feb 29 & 28
+    {2000, 2, 29, 0, 0, 0}, {2100, 3, 1, 0, 0, 0}, {2038, 1, 19, 3, 14, 8},      // 400 & 100 year rules, 2^31
+    {2106, 2, 7, 0, 0, 0}, {2106, 2, 7, 6, 28, 0}};                              // last day & minute
+  static const uint32_t stepSecs[] = {1, 7, 59, 61, 3599, 3601, 86000};
+  RTC_datetime_t dt, ref;
+  uint32_t i, j, k, b, e, hits, misses, hits0, mismatches = 0;
+
+  *steps = *uncached = 0;
+  for(i = 0; i < sizeof(edges) / sizeof(edges[0]); i++)
+  {
+    if(!calDateTimeToEpoch(edges[i][0], (uint8_t)edges[i][1], (uint8_t)edges[i][2], (uint8_t)edges[i][3],
+                           (uint8_t)edges[i][4], (uint8_t)edges[i][5], &b))
+    {
+      mismatches++;
+      continue;
+    }
+    for(j = 0; j < sizeof(stepSecs) / sizeof(stepSecs[0]); j++)
+    {
+      // two steps before the edge, off by half a step, and two after
+      e = b - stepSecs[j] * 2 + stepSecs[j] / 2;
+      rtc.setEpoch(e);
+      rtc.getDateTime(&dt, RTC_HOUR_FORMAT_24);   // decoded, cached
+      for(k = 0; k < 4 && dt.epoch <= 0xFFFFFFFFUL - stepSecs[j] - 1; k++)
+      {
+        rtc.getDecodeStats(&hits0, &misses);
+        sim.advanceSeconds(stepSecs[j]);
+        rtc.getDateTime(&dt, RTC_HOUR_FORMAT_24);
+        rtc.getDecodeStats(&hits, &misses);
+        rtc.epochToDateTime(&ref, dt.epoch);
+        (*steps)++;
+        if(hits == hits0)
+          (*uncached)++;
+        if(dt.seconds != ref.seconds || dt.minutes != ref.minutes || dt.hours != ref.hours ||
+           dt.day != ref.day || dt.weekday != ref.weekday || dt.month != ref.month || dt.year != ref.year)
+        {
+          if(mismatches++ < 5)
+            printf("  advance %lu s to %lu: %04u-%02u-%02u %02u:%02u:%02u wd %u != %04u-%02u-%02u %02u:%02u:%02u wd %u\n",
+                   (unsigned long)stepSecs[j], (unsigned long)dt.epoch, dt.year, dt.month, dt.day, dt.hours,
+                   dt.minutes, dt.seconds, dt.weekday, ref.year, ref.month, ref.day, ref.hours, ref.minutes,
+                   ref.seconds, ref.weekday);
+        }
+      }
+    }
+  }
+  return mismatches;
+}
+
+/********************************************************************
+ *  @brief library on the simulated RTC: a week of hourly alarms at
+ *    accelerated time, then getDateTime() cost and the decode cache
+ *    against a full decode
+\*******************************************************************/
+static int benchSimulator(void)
+{
+  RTC_datetime_t dt;
+  uint32_t i, n = 100000;
+  uint32_t hits, misses, steps, uncached, mismatches, now;
+  double t0, tGet;
+  int errors = 0;
+
+  rtc.begin(INIT_NONE);
+  dt.hour_format = RTC_HOUR_FORMAT_24;
+  dt.year = 2024; dt.month = 2; dt.day = 28;
+  dt.hours = 23; dt.minutes = 30; dt.seconds = 0;
+  if(rtc.setDateTime(&dt) != STM32LIBS_RTC::RTC_OK)
+    errors++;
+
+  rtc.attachInterrupt(benchAlarmCallback);
+  rtc.setAlarmFromEpoch(rtc.getEpoch() + 3600);
+  t0 = nowNs();
+  sim.advanceSeconds(7 * 86400);
+  printf("simulator week   %lu alarms (168 expected) in %.2f ms host time\n",
+         (unsigned long)benchAlarms, (nowNs() - t0) / 1e6);
+  if(benchAlarms != 168)
+    errors++;
+  rtc.detachInterrupt();
+  rtc.disableAlarm();
+
+  t0 = nowNs();
+  for(i = 0; i < n; i++)
+  {
+    rtc.getDateTime(&dt);
+    sim.advanceSeconds(1);
+  }
+  tGet = nowNs() - t0;
+  rtc.getDecodeStats(&hits, &misses);
+  printf("getDateTime      %8.2f ns/op incl. sim (hits %lu, misses %lu)\n",
+         tGet / n, (unsigned long)hits, (unsigned long)misses);
+
+  now = rtc.getEpoch();
+  mismatches = checkAdvance(&steps, &uncached);
+  rtc.setEpoch(now);
+  printf("  cache advance   %lu steps over calendar edges 2000 - 2106, %lu not cached, mismatches %lu\n",
+         (unsigned long)steps, (unsigned long)uncached, (unsigned long)mismatches);
+  if(mismatches != 0 || uncached != 0)
+    errors++;
+  return errors ? 1 : 0;
+}
+
+/********************************************************************
+ *  @brief software alarm scheduler: insert / cancel / fire throughput
+ *    with RTC_MAX_ALARMS timers spread over a day
+\*******************************************************************/
+static uint32_t schedDeadline[RTC_MAX_ALARMS];
+static uint32_t schedLate;
+
+static void benchSchedCallback(void *data)
+{
+  uint32_t i = (uint32_t)(uintptr_t)data;
+
+  if(rtc.getEpoch() != schedDeadline[i])
+    schedLate++;
+}
+
+static volatile uint32_t schedPast;
+
+static void benchPastCallback(void *data)
+{
+  (void)data;
+  schedPast++;
+}
+
+static int benchScheduler(void)
+{
+  STM32LIBS_ALARMS &alarms = STM32LIBS_ALARMS::getInstance();
+  static int32_t ids[RTC_MAX_ALARMS];
+  int32_t stale, reused;
+  uint32_t i, n = RTC_MAX_ALARMS, cancelled = 0;
+  uint32_t now, rearms;
+  bool aba, deferred;
+  double t0, tAdd, tCancel, tFire;
+  int errors = 0;
+
+  srand(1);
+  alarms.begin();
+  now = rtc.getEpoch();
+  for(i = 0; i < n; i++)
+    schedDeadline[i] = now + 10 + (uint32_t)(rand() % 86400);
+
+  // an old id must not cancel the alarm that reused its slot
+  stale = alarms.add(now + 10, benchSchedCallback);
+  alarms.cancel(stale);
+  reused = alarms.add(now + 10, benchSchedCallback);
+  aba = alarms.cancel(stale) || !alarms.cancel(reused);
+  if(aba)
+    errors++;
+
+  // a passed epoch runs on the next service(), not inside add()
+  schedPast = 0;
+  alarms.add(now - 1, benchPastCallback);
+  deferred = (schedPast == 0);
+  alarms.service();
+  if(!deferred || schedPast != 1)
+    errors++;
+
+  rearms = alarms.rearms;
+  t0 = nowNs();
+  for(i = 0; i < n; i++)
+    ids[i] = alarms.add(schedDeadline[i], benchSchedCallback, (void *)(uintptr_t)i);
+  tAdd = nowNs() - t0;
+  rearms = alarms.rearms - rearms;
+  if(alarms.add(now + 1, benchSchedCallback) != RTC_ALARM_NONE)
+    errors++;                                   // pool is full
+
+  t0 = nowNs();
+  for(i = 0; i < n; i += 2, cancelled++)
+  {
+    if(!alarms.cancel(ids[i]))
+      errors++;
+  }
+  tCancel = nowNs() - t0;
+
+  alarms.fired = 0;
+  sim.alarmIsrMaxNs = 0;
+  t0 = nowNs();
+  for(i = 0; i < 86400 + 20; i++)
+  {
+    sim.advanceSeconds(1);
+    alarms.service();                           // loop() lands the re-arm
+  }
+  tFire = nowNs() - t0;
+
+  printf("alarm scheduler  (%lu timers, binary heap)\n", (unsigned long)n);
+  printf("  add             %8.2f ns/op (%lu RTC re-arms), passed epoch %s\n", tAdd / n, (unsigned long)rearms,
+         deferred ? "left to service()" : "run by add()");
+  printf("  cancel          %8.2f ns/op, stale id %s\n", tCancel / cancelled, aba ? "accepted" : "rejected");
+  printf("  fire            %8.2f ns/op incl. sim, %lu fired, %lu late, interrupt %.1f us max\n",
+         tFire / (alarms.fired ? alarms.fired : 1), (unsigned long)alarms.fired, (unsigned long)schedLate,
+         sim.alarmIsrMaxNs / 1000.0);
+  if(alarms.fired != n - cancelled || schedLate != 0 || alarms.count() != 0 ||
+     sim.alarmIsrMaxNs == 0 || sim.alarmIsrMaxNs >= 20000)
+    errors++;
+  alarms.end();
+  return errors ? 1 : 0;
+}
+
+/********************************************************************
+ *  @brief timing wheel: RTC_MAX_WHEEL_TIMERS recurring timers (17 s to
+ *    80 days) over two simulated days. Every expiry is checked against
+ *    the exact epoch, the worst alarm interrupt is timed in simulated
+ *    time and its work counted.
+\*******************************************************************/
+static const uint32_t wheelPeriods[8] = {17, 60, 97, 600, 3600, 7200, 86400, 80 * 86400UL};
+static uint32_t wheelNext[RTC_MAX_WHEEL_TIMERS];
+static uint32_t wheelLate;
+static uint32_t wheelIsrCount, wheelIsrMaxWork;
+
+static void benchWheelCallback(void *data)
+{
+  uint32_t i = (uint32_t)(uintptr_t)data;
+
+  if(rtc.getEpoch() != wheelNext[i])
+    wheelLate++;
+  wheelNext[i] += wheelPeriods[i % 8];
+}
+
+static void benchWheelISR(void *data)
+{
+  STM32LIBS_WHEEL *wheel = (STM32LIBS_WHEEL *)data;
+  uint32_t work = wheel->fired + wheel->cascaded;
+
+  wheel->service();
+  work = wheel->fired + wheel->cascaded - work;
+  wheelIsrCount++;
+  if(work > wheelIsrMaxWork)
+    wheelIsrMaxWork = work;
+}
+
+static int benchWheel(void)
+{
+  STM32LIBS_WHEEL &wheel = STM32LIBS_WHEEL::getInstance();
+  static int32_t ids[RTC_MAX_WHEEL_TIMERS];
+  static uint32_t first[RTC_MAX_WHEEL_TIMERS];
+  int32_t stale, reused;
+  uint32_t i, n = RTC_MAX_WHEEL_TIMERS, cancelled = 0;
+  uint32_t now, end, period, expected = 0;
+  bool aba;
+  double t0, tAdd, tCancel, tRun;
+  int errors = 0;
+
+  srand(2);
+  wheel.begin();
+  rtc.attachInterrupt(benchWheelISR, &wheel);   // same work as the wheel ISR, counted
+  now = rtc.getEpoch();
+  end = now + 2 * 86400;
+
+  // an old id must not cancel the timer that reused its slot
+  stale = wheel.at(now + 10, benchWheelCallback);
+  wheel.cancel(stale);
+  reused = wheel.at(now + 10, benchWheelCallback);
+  aba = wheel.cancel(stale) || !wheel.cancel(reused);
+  if(aba)
+    errors++;
+
+  t0 = nowNs();
+  for(i = 0; i < n; i++)
+  {
+    period = wheelPeriods[i % 8];
+    wheelNext[i] = now + 60 + (uint32_t)(rand() % period);   // setup costs sim time
+    first[i] = wheelNext[i];
+    ids[i] = wheel.every(period, benchWheelCallback, (void *)(uintptr_t)i, wheelNext[i]);
+  }
+  tAdd = nowNs() - t0;
+  if(wheel.every(1, benchWheelCallback) != RTC_TIMER_NONE)
+    errors++;                                   // pool is full
+
+  t0 = nowNs();
+  for(i = 3; i < n; i += 4, cancelled++)
+  {
+    if(!wheel.cancel(ids[i]))
+      errors++;
+  }
+  tCancel = nowNs() - t0;
+
+  wheel.fired = 0;
+  wheel.cascaded = 0;
+  sim.alarmIsrMaxNs = 0;
+  t0 = nowNs();
+  while(rtc.getEpoch() < end)
+  {
+    sim.advanceNs(100000000ULL);                // loop() polls ten times a second
+    while(wheel.service());                     // and catches up with the interrupt
+  }
+  tRun = nowNs() - t0;
+
+  // ISR bus accesses cost sim time too, count up to where the RTC really is
+  end = rtc.getEpoch();
+  for(i = 0; i < n; i++)
+  {
+    if(i % 4 != 3)
+      expected += (wheelNext[i] - first[i]) / wheelPeriods[i % 8];
+    if(i % 4 != 3 && wheelNext[i] <= end)
+      errors++;                                 // missed expiry
+  }
+
+  printf("timing wheel     (%lu recurring timers, 2 days)\n", (unsigned long)n);
+  printf("  every           %8.2f ns/op\n", tAdd / n);
+  printf("  cancel          %8.2f ns/op, stale id %s\n", tCancel / cancelled, aba ? "accepted" : "rejected");
+  printf("  run             %8.2f ns/expiry incl. sim, %lu fired (%lu expected), %lu late, %lu cascaded\n",
+         tRun / (wheel.fired ? wheel.fired : 1), (unsigned long)wheel.fired, (unsigned long)expected,
+         (unsigned long)wheelLate, (unsigned long)wheel.cascaded);
+  printf("  alarm ISR       %lu interrupts, interrupt %.1f us max, %lu timers expired + cascaded max (limit %u)\n",
+         (unsigned long)wheelIsrCount, sim.alarmIsrMaxNs / 1000.0, (unsigned long)wheelIsrMaxWork,
+         (unsigned)RTC_WHEEL_STEPS);
+  if(wheel.fired != expected || wheelLate != 0 || wheelIsrMaxWork > RTC_WHEEL_STEPS ||
+     sim.alarmIsrMaxNs == 0 || sim.alarmIsrMaxNs >= 20000)
+    errors++;
+  wheel.clear();
+  wheel.end();
+  return errors ? 1 : 0;
+}
+
+/********************************************************************
+ *  @brief cron specs: cronNextOccurrence() against a day by day /
+ *    second by second search for random specs, then a recurring alarm
+ *    on the simulated RTC re-armed by the library
+\*******************************************************************/
+static bool bruteDayMatch(const RTC_cron_t *cron, uint32_t days)
+{
+  uint16_t year;
+  uint8_t month, day, wday = calWeekday(days);
+  bool mday, wmatch;
+
+  calCivilFromDays(days, &year, &month, &day);
+  if(!(cron->months & (1 << month)))
+    return false;
+  mday = cron->mdays & (1UL << day);
+  wmatch = cron->wdays & (1 << wday);
+  if(cron->flags & (CRON_MDAY_ANY | CRON_WDAY_ANY))
+    return mday && wmatch;
+  return mday || wmatch;
+}
+
+static uint32_t bruteNextOccurrence(const RTC_cron_t *cron, uint32_t e)
+{
+  uint64_t t = (uint64_t)e + 1;
+  uint32_t days, sod, h, m, s;
+
+  for(days = t / 86400, sod = t % 86400; days < 49711; days++, sod = 0)
+  {
+    if(!bruteDayMatch(cron, days))
+      continue;
+    for(h = sod / 3600; h < 24; h++)
+    {
+      if(!(cron->hours & (1UL << h)))
+        continue;
+      for(m = 0; m < 60; m++)
+      {
+        if(!(cron->minutes & (1ULL << m)))
+          continue;
+        for(s = 0; s < 60; s++)
+        {
+          t = (uint64_t)days * 86400 + h * 3600 + m * 60 + s;
+          if((cron->seconds & (1ULL << s)) && t > e)
+            return (t > 0xFFFFFFFFULL) ? 0 : (uint32_t)t;
+        }
+      }
+    }
+  }
+  return 0;
+}
+
+static uint64_t randomBits(uint8_t from, uint8_t to, uint8_t density)
+{
+  uint64_t bits = 0;
+  uint8_t i;
+
+  for(i = from; i <= to; i++)
+  {
+    if((uint32_t)rand() % 100 < density)
+      bits |= 1ULL << i;
+  }
+  if(bits == 0)
+    bits = 1ULL << (from + (uint32_t)rand() % (to - from + 1));
+  return bits;
+}
+
+static volatile uint32_t cronFired, cronLate;
+static RTC_cron_t benchCronSpec;
+
+static void benchCronCallback(void *data)
+{
+  RTC_datetime_t dt;
+
+  (void)data;
+  cronFired++;
+  rtc.getDateTime(&dt, RTC_HOUR_FORMAT_24);
+  if(dt.seconds != 0 || dt.minutes % 15 != 0 || dt.hours < 8 || dt.hours > 17 ||
+     dt.weekday == 0 || dt.weekday == 6)
+    cronLate++;
+}
+
+static int benchCron(void)
+{
+  static const char *specs[] = {"0 */15 8-17 * * 1-5", "30 0 0 1 * *", "0 0 12 29 2 *", "0 0 0 13 * 5",
+                                "*/10 * * * * *", "0 0 0 30 2 *", "15 7 * * 0,6", "0 0 3 L * *"};
+  static const bool specOk[] = {true, true, true, true, true, true, true, false};
+  RTC_cron_t cron;
+  RTC_datetime_t dt;
+  uint32_t i, n = 20000, e, a, b, mismatches = 0;
+  uint32_t start;
+  double t0, tNext;
+  int errors = 0;
+
+  // parser
+  for(i = 0; i < sizeof(specs) / sizeof(specs[0]); i++)
+  {
+    if(cronCompile(&cron, specs[i]) != specOk[i])
+      errors++;
+  }
+  cronCompile(&cron, "0 */15 8-17 * * 1-5");
+  if(cron.seconds != 1 || cron.minutes != 0x0000200040008001ULL || cron.hours != 0x3FF00 ||
+     cron.wdays != 0x3E || cron.flags != (CRON_MDAY_ANY))
+    errors++;
+  cronCompile(&cron, "0 0 0 30 2 *");
+  if(cronNextOccurrence(&cron, 0) != 0)
+    errors++;                                   // Feb 30 never matches
+
+  // random specs against the reference search
+  srand(3);
+  for(i = 0; i < n; i++)
+  {
+    cron.seconds = randomBits(0, 59, (i & 1) ? 50 : 3);
+    cron.minutes = randomBits(0, 59, (i & 2) ? 50 : 3);
+    cron.hours = (uint32_t)randomBits(0, 23, (i & 4) ? 50 : 5);
+    cron.mdays = (uint32_t)randomBits(1, 31, (i & 8) ? 60 : 4);
+    cron.months = (uint16_t)randomBits(1, 12, (i & 16) ? 60 : 10);
+    cron.wdays = (uint8_t)randomBits(0, 6, 30);
+    cron.flags = (uint8_t)(rand() & 3);
+    e = (uint32_t)rand() * 2 + (uint32_t)(rand() & 1);
+    a = cronNextOccurrence(&cron, e);
+    b = bruteNextOccurrence(&cron, e);
+    if(a != b && mismatches++ < 5)
+      printf("  spec %lu epoch %lu: %lu != %lu\n", (unsigned long)i, (unsigned long)e, (unsigned long)a, (unsigned long)b);
+  }
+
+  cronCompile(&cron, "0 */15 8-17 * * 1-5");
+  e = 1700000000;
+  t0 = nowNs();
+  for(i = 0; i < 1000000; i++)
+    e = cronNextOccurrence(&cron, e);
+  tNext = nowNs() - t0;
+  printf("cron             (%lu random specs)\n", (unsigned long)n);
+  printf("  nextOccurrence  %8.2f ns/op, mismatches %lu\n", tNext / 1000000, (unsigned long)mismatches);
+  if(mismatches != 0 || e == 0)
+    errors++;
+
+  // recurring alarm on the simulator: Mon 8:00 - Fri 17:45 every 15 min
+  dt.hour_format = RTC_HOUR_FORMAT_24;
+  dt.year = 2024; dt.month = 3; dt.day = 3;           // Sunday
+  dt.hours = 12; dt.minutes = 0; dt.seconds = 0;
+  rtc.setDateTime(&dt);
+  benchCronSpec = cron;
+  rtc.attachInterrupt(benchCronCallback);
+  if(rtc.setCronAlarm(&benchCronSpec) != STM32LIBS_RTC::RTC_OK)
+    errors++;
+  sim.alarmIsrMaxNs = 0;
+  start = rtc.getEpoch();
+  while(rtc.getEpoch() - start < 7 * 86400)
+  {
+    sim.advanceSeconds(1);
+    rtc.serviceWrites();                            // loop() finishes the re-arm
+  }
+  printf("  cron alarm      %lu alarms in a week (200 expected), %lu wrong, interrupt %.1f us max\n",
+         (unsigned long)cronFired, (unsigned long)cronLate, sim.alarmIsrMaxNs / 1000.0);
+  if(cronFired != 200 || cronLate != 0 || sim.alarmIsrMaxNs >= 20000)
+    errors++;
+  rtc.disableAlarm();
+  rtc.detachInterrupt();
+  return errors ? 1 : 0;
+}
+
+/********************************************************************
+ *  @brief event queue: the ring hammered by a producer and a consumer
+ *    thread, then alarm / second / overflow events from the simulated
+ *    RTC drained in loop() style batches
+\*******************************************************************/
+static uint32_t stressRing(STM32LIBS_RING<RTC_event_t, 64> *ring, uint32_t n, bool retry, uint32_t *received)
+{
+  RTC_event_t batch[8];
+  uint32_t last = 0, errors = 0, i;
+  uint16_t got;
+
+  *received = 0;
+  std::thread producer([=]() {
+    RTC_event_t ev;
+    ev.type = RTC_EVENT_SECOND;
+    ev.div = 0;
+    for(uint32_t seq = 1; seq <= n; seq++)
+    {
+      ev.epoch = seq;
+      while(!ring->push(ev) && retry)
+        std::this_thread::yield();
+    }
+  });
+  while(last != n && *received + ring->overruns() != n)
+  {
+    got = ring->pop(batch, 8);
+    if(got == 0)
+      std::this_thread::yield();
+    for(i = 0; i < got; i++)
+    {
+      // lossless: exactly the next one, lossy: only newer ones
+      if(retry ? (batch[i].epoch != last + 1) : (batch[i].epoch <= last))
+        errors++;
+      last = batch[i].epoch;
+    }
+    *received += got;
+  }
+  producer.join();
+  *received += ring->pop(batch, 8);
+  return errors;
+}
+
+static int benchEventQueue(void)
+{
+  static STM32LIBS_RING<RTC_event_t, 64> ring, lossy;
+  const uint32_t n = 5000000;
+  uint32_t received, badOrder, i;
+  uint32_t counts[RTC_EVENT_TYPES] = {0, 0, 0};
+  uint32_t overruns, badDiv = 0;
+  RTC_event_t batch[8];
+  uint16_t got;
+  double t0, tRun;
+  int errors = 0;
+
+  t0 = nowNs();
+  badOrder = stressRing(&ring, n, true, &received);
+  tRun = nowNs() - t0;
+  printf("event queue      (producer & consumer threads, %lu events, 64 entries)\n", (unsigned long)n);
+  printf("  producer waits  %8.2f ns/event, %lu received, %lu times full, %lu out of sequence\n",
+         tRun / n, (unsigned long)received, (unsigned long)ring.overruns(), (unsigned long)badOrder);
+  if(received != n || badOrder != 0)
+    errors++;
+
+  badOrder = stressRing(&lossy, n, false, &received);
+  printf("  producer drops  %lu received + %lu overruns, %lu out of order\n",
+         (unsigned long)received, (unsigned long)lossy.overruns(), (unsigned long)badOrder);
+  if(received + lossy.overruns() != n || badOrder != 0)
+    errors++;
+
+  // simulated RTC: counter overflow with an alarm just before it
+  rtc.setEpoch(0xFFFFFFF8);
+  rtc.enableEvents(RTC_EVENT_MASK(RTC_EVENT_ALARM) | RTC_EVENT_MASK(RTC_EVENT_SECOND) | RTC_EVENT_MASK(RTC_EVENT_OVERFLOW));
+  rtc.setAlarmFromEpoch(0xFFFFFFFC);
+  for(i = 0; i < 4; i++)
+  {
+    sim.advanceSeconds(3);
+    while((got = rtc.readEvents(batch, 8)) != 0)
+    {
+      for(uint16_t j = 0; j < got; j++)
+      {
+        counts[batch[j].type]++;
+        if(batch[j].div > 0x7FFF)
+          badDiv++;
+      }
+    }
+  }
+  // nobody reading for 40 s: the queue keeps the oldest events
+  sim.advanceSeconds(40);
+  got = rtc.eventsPending();
+  overruns = rtc.getEventOverruns(RTC_EVENT_SECOND);
+  rtc.enableEvents(0);
+  while(rtc.readEvents(batch, 8) != 0)
+    ;
+  printf("  RTC events      %lu alarm, %lu second, %lu overflow, %lu pending + %lu overruns after 40 s\n",
+         (unsigned long)counts[RTC_EVENT_ALARM], (unsigned long)counts[RTC_EVENT_SECOND],
+         (unsigned long)counts[RTC_EVENT_OVERFLOW], (unsigned long)got, (unsigned long)overruns);
+  if(counts[RTC_EVENT_ALARM] != 1 || counts[RTC_EVENT_OVERFLOW] != 1 || counts[RTC_EVENT_SECOND] != 11 ||
+     badDiv != 0 || got != RTC_EVENT_QUEUE_SIZE || got + overruns != 40)
+    errors++;
+  rtc.disableAlarm();
+  rtc.setEpoch(1700000000);
+  return errors ? 1 : 0;
+}
+
+/********************************************************************
+ *  @brief sub-second timestamps: monotonic and within 1 ms of the
+ *    simulated time over 10 s of 137 us steps, plus the read cost
+\*******************************************************************/
+static int benchTimestamp(void)
+{
+  RTC_timestamp_t ts;
+  uint64_t ms, lastMs, startMs, startNs;
+  uint32_t i, n = 73000, backwards = 0, reads;
+  int64_t drift, worst = 0;
+  double t0, tGet;
+  int errors = 0;
+
+  rtc.setEpoch(1700000000);
+  startMs = lastMs = rtc.getEpochMillis();
+  startNs = sim.getNs();
+  for(i = 0; i < n; i++)
+  {
+    sim.advanceNs(137000);
+    ms = rtc.getEpochMillis();
+    if(ms < lastMs)
+      backwards++;
+    lastMs = ms;
+    drift = (int64_t)(ms - startMs) - (int64_t)((sim.getNs() - startNs) / 1000000ULL);
+    if(drift < 0)
+      drift = -drift;
+    if(drift > worst)
+      worst = drift;
+  }
+
+  reads = sim.regReads;
+  rtc.getTimestamp(&ts);
+  reads = sim.regReads - reads;
+  t0 = nowNs();
+  for(i = 0; i < 1000000; i++)
+    ms += rtc.getEpochMillis();
+  tGet = nowNs() - t0;
+
+  printf("timestamps       (%lu reads 137 us apart)\n", (unsigned long)n);
+  printf("  getEpochMillis  %8.2f ns/op incl. sim, %lu register reads per call, %lu backwards, worst drift %ld ms\n",
+         tGet / 1000000, (unsigned long)reads, (unsigned long)backwards, (long)worst);
+  printf("  getTimestamp    %lu.%05lu (%lu ticks of 1/%lu s)\n", (unsigned long)ts.epoch,
+         (unsigned long)((uint64_t)ts.ticks * 100000 / ts.hz), (unsigned long)ts.ticks, (unsigned long)ts.hz);
+  if(backwards != 0 || worst > 1 || ts.hz != 32768 || ts.ticks >= ts.hz || ms == 0)
+    errors++;
+  return errors ? 1 : 0;
+}
+
+/********************************************************************
+ *  @brief coherent counter reads: sweep reads across CNTL -> CNTH carries
+ *    in 3 ns steps, count values that are neither the old nor the new
+ *    second (legacy two register read vs getEpoch / getSnapshot)
+\*******************************************************************/
+static uint32_t legacyGetEpoch(void)
+{
+  uint32_t hi = RTC_CNTH;
+
+  return (hi << 16) | RTC_CNTL;
+}
+
+static int benchCoherentRead(void)
+{
+  RTC_snapshot_t snap;
+  uint32_t trial, e, v, reads = 0;
+  uint32_t torn[3] = {0, 0, 0};
+  uint32_t regReads, regPerCall;
+  int errors = 0;
+
+  for(trial = 0; trial < 600; trial++)
+  {
+    rtc.setEpoch(0x1234FFFF + ((trial % 64) << 16));
+    e = rtc.getEpoch();
+    // just before the carry, then creep over it, a different phase each time
+    while(RTC_DIVL > 2)
+      sim.advanceNs(20000);
+    sim.advanceNs(trial * 7 % 100);
+    do {
+      switch(trial % 3)
+      {
+        case 0:
+          v = legacyGetEpoch();
+          break;
+        case 1:
+          v = rtc.getEpoch();
+          break;
+        default:
+          rtc.getSnapshot(&snap);
+          v = snap.epoch;
+          if(snap.epoch == e + 1 && snap.div < snap.prl - 2)
+            v = 0;                              // divider from the other second
+          break;
+      }
+      if(v != e && v != e + 1)
+        torn[trial % 3]++;
+      reads++;
+      sim.advanceNs(3);
+    } while(v != e + 1);
+  }
+
+  regReads = sim.regReads;
+  rtc.getEpoch();
+  regPerCall = sim.regReads - regReads;
+  printf("coherent reads   (%lu reads across 600 CNTH carries)\n", (unsigned long)reads);
+  printf("  torn values     legacy CNTH/CNTL %lu, getEpoch %lu (%lu register reads), getSnapshot %lu\n",
+         (unsigned long)torn[0], (unsigned long)torn[1], (unsigned long)regPerCall, (unsigned long)torn[2]);
+  if(torn[1] != 0 || torn[2] != 0 || torn[0] == 0)
+    errors++;
+  rtc.setEpoch(1700000000);
+  return errors ? 1 : 0;
+}
+
+/********************************************************************
+ *  @brief configuration writes: longest interrupts off window of the
+ *    V1.0.0 setEpoch() (masked across the CNF / RTOFF handshake) vs the
+ *    write engine, merged asynchronous writes polled from a busy loop,
+ *    and a stopped RTCCLK timing out without hanging the caller
+\*******************************************************************/
+static void legacySetEpoch(uint32_t _epoch)
+{
+  uint32_t tmo = millis();
+
+  __disable_irq();
+  while((RTC_CRL & RTOFF) == 0 && millis() - tmo <= REG_TIMEOUT)
+    ;
+  RTC_CRL |= CNF;
+  RTC_CRL &= ~RSF;
+  RTC_CNTH = _epoch >> 16;
+  RTC_CNTL = _epoch & 0xFFFF;
+  RTC_CRL &= ~CNF;
+  while((RTC_CRL & RTOFF_RSF) != RTOFF_RSF && millis() - tmo <= REG_TIMEOUT)
+    ;
+  __enable_irq();
+}
+
+static int benchConfigWrites(void)
+{
+  RTC_snapshot_t snap;
+  uint64_t legacyOff, engineOff, t0, tBlock;
+  uint32_t h1, h2, h3, h4, polls, tmoPolls, alarms;
+  uint8_t st1, st2, st3, st4;
+  int errors = 0;
+
+  sim.irqOffMaxNs = 0;
+  legacySetEpoch(1700000000);
+  legacyOff = sim.irqOffMaxNs;
+
+  sim.irqOffMaxNs = 0;
+  t0 = sim.getNs();
+  rtc.setEpoch(1700000100);
+  tBlock = sim.getNs() - t0;
+  if(rtc.setAlarmFromEpoch(1700000200) != STM32LIBS_RTC::RTC_OK || rtc.getEpoch() != 1700000100)
+    errors++;
+
+  // the first write starts at once, the next two share the following CNF window
+  h1 = rtc.setEpochAsync(1700001000);
+  h2 = rtc.setEpochAsync(1700002000);
+  h3 = rtc.setAlarmAsync(1700002010);
+  polls = 0;
+  while(rtc.serviceWrites() == STM32LIBS_RTC::RTC_BUSY)
+  {
+    sim.advanceNs(5000);                    // the rest of loop()
+    polls++;
+  }
+  engineOff = sim.irqOffMaxNs;
+  st1 = rtc.writeStatus(h1);
+  st2 = rtc.writeStatus(h2);
+  st3 = rtc.writeStatus(h3);
+  rtc.getSnapshot(&snap);
+  if(st1 != STM32LIBS_RTC::RTC_OK || st2 != STM32LIBS_RTC::RTC_OK || st3 != STM32LIBS_RTC::RTC_OK ||
+     snap.epoch != 1700002000 || snap.alarm != 1700002010 || (snap.crh & RTC_ALRIE) == 0 ||
+     rtc.writeStatus(0) != STM32LIBS_RTC::RTC_INVALID_PARAM)
+    errors++;
+  alarms = sim.alarmIrqs;
+  sim.advanceSeconds(11);
+  alarms = sim.alarmIrqs - alarms;
+  rtc.disableAlarm();
+
+  // RTCCLK stops with a write in flight: fails after REG_TIMEOUT, 1 ms polls
+  sim.setLseFails(true);
+  h4 = rtc.setEpochAsync(1700003000);
+  tmoPolls = 0;
+  while(rtc.writeStatus(h4) == STM32LIBS_RTC::RTC_BUSY && tmoPolls < 5000)
+  {
+    sim.advanceNs(1000000);
+    tmoPolls++;
+  }
+  st4 = rtc.writeStatus(h4);
+  sim.setLseFails(false);
+  rtc.setEpoch(1700000000);
+
+  printf("config writes    (CNF / RTOFF handshake, 3 RTCCLK per write)\n");
+  printf("  irq off window  legacy setEpoch %lu ns, write engine %lu ns (setEpoch waited %lu ns with interrupts on)\n",
+         (unsigned long)legacyOff, (unsigned long)engineOff, (unsigned long)tBlock);
+  printf("  async           3 queued writes (2 merged) done in %lu loop passes, alarm fired %lu\n",
+         (unsigned long)polls, (unsigned long)alarms);
+  printf("  stopped RTCCLK  status %u after %lu ms of polling\n", st4, (unsigned long)tmoPolls);
+  if(engineOff * 10 > legacyOff || alarms != 1 || st4 != STM32LIBS_RTC::RTC_FAIL_CONFIG_EXIT ||
+     tmoPolls > REG_TIMEOUT + 2 || rtc.getEpoch() != 1700000000)
+    errors++;
+  return errors ? 1 : 0;
+}
+
+/********************************************************************
+ *  @brief backup register shadow copy: bus traffic of a save / load
+ *    loop with the V1.0.0 access pattern (rewrite & re-read the whole
+ *    range) vs eepromWrite / eepromRead, write back batching, warm
+ *    begin() reads, and the values surviving a reset
+\*******************************************************************/
+static int benchBackupCache(void)
+{
+  uint16_t data[9], back[9];
+  uint32_t i, j, n = 1000, r0, w0;
+  uint32_t legacyReads, legacyWrites, cacheReads, cacheWrites, wbPending, wbWrites;
+  uint32_t reads, writes, bootReads, bootWrites;
+  int errors = 0;
+
+  for(j = 0; j < 9; j++)
+    data[j] = 100 + j;
+
+  r0 = sim.regReads;
+  w0 = sim.regWrites;
+  for(i = 0; i < n; i++)
+  {
+    data[0] = i / 10;                       // a counter that changes now and then
+    for(j = 0; j < 9; j++)
+      BKP_DR(j + 1) = data[j];
+    for(j = 0; j < 9; j++)
+      back[j] = BKP_DR(j + 1);
+  }
+  legacyReads = sim.regReads - r0;
+  legacyWrites = sim.regWrites - w0;
+
+  r0 = sim.regReads;
+  w0 = sim.regWrites;
+  for(i = 0; i < n; i++)
+  {
+    data[0] = i / 10;
+    rtc.eepromWrite(data, 0, 9);
+    rtc.eepromRead(back, 0, 9);
+    if(back[0] != data[0])
+      errors++;
+  }
+  cacheReads = sim.regReads - r0;
+  cacheWrites = sim.regWrites - w0;
+
+  rtc.setBackupMode(BACKUP_WRITE_BACK);
+  w0 = sim.regWrites;
+  for(i = 0; i < n; i++)
+  {
+    data[0] = i;
+    rtc.eepromWrite(data, 0, 9);
+  }
+  wbPending = sim.regWrites - w0;
+  rtc.flushBackup();
+  wbWrites = sim.regWrites - w0;
+  rtc.setBackupMode(BACKUP_WRITE_THROUGH);
+
+  // MCU reset with Vbat: the registers come back, begin() reads the status only
+  sim.powerCycle(true);
+  rtc.getBackupStats(&reads, &writes, nullptr, nullptr);
+  rtc.begin(INIT_NONE);
+  rtc.getBackupStats(&bootReads, &bootWrites, nullptr, nullptr);
+  bootReads -= reads;
+  bootWrites -= writes;
+  rtc.eepromRead(back, 0, 9);
+  for(j = 1; j < 9; j++)
+    if(back[j] != 100 + j)
+      errors++;
+
+  printf("backup registers (%lu save / load cycles of 9 registers)\n", (unsigned long)n);
+  printf("  bus accesses    whole range %lu reads %lu writes, shadow copy %lu reads %lu writes\n",
+         (unsigned long)legacyReads, (unsigned long)legacyWrites, (unsigned long)cacheReads, (unsigned long)cacheWrites);
+  printf("  write back      %lu changes -> %lu writes before flush, %lu after\n",
+         (unsigned long)n, (unsigned long)wbPending, (unsigned long)wbWrites);
+  printf("  warm begin()    %lu reads %lu writes (was 10 reads 1 write), counter %u after reset\n",
+         (unsigned long)bootReads, (unsigned long)bootWrites, back[0]);
+  if(cacheReads > 9 || cacheWrites != 9 + (n - 1) / 10 || wbPending != 0 || wbWrites != 1 ||
+     bootReads != 1 || bootWrites != 0 || back[0] != n - 1 || !rtc.isConfigured())
+    errors++;
+  return errors ? 1 : 0;
+}
+
+/********************************************************************
+ *  @brief backup register probe & address map: a 10 register part and
+ *    a 42 register part (DR11 - DR42 after the gap at 0x40), full range
+ *    eepromWrite / eepromRead across a reset, probe cost on the first and
+ *    a warm start
+\*******************************************************************/
+static int benchBackupRegs(void)
+{
+  uint16_t data[BKP_DR_MAX], back[BKP_DR_MAX];
+  uint8_t parts[2] = {10, 42}, p, count[2], warmCount[2];
+  uint32_t i, r0, w0, coldAcc[2], warmAcc[2], wrong[2];
+  int errors = 0;
+
+  for(p = 0; p < 2; p++)
+  {
+    sim.setBackupRegCount(parts[p]);
+    sim.powerCycle(false);                  // new part, empty backup domain
+    r0 = sim.regReads;
+    w0 = sim.regWrites;
+    rtc.begin(INIT_NONE);
+    coldAcc[p] = sim.regReads - r0 + sim.regWrites - w0;
+    count[p] = rtc.getBackupRegCount();
+
+    for(i = 0; i < BKP_DR_MAX; i++)
+    {
+      data[i] = 0x1000 + i;
+      back[i] = 0;
+    }
+    rtc.eepromWrite(data, 0, BKP_DR_MAX);   // clipped to eepromSize()
+    sim.powerCycle(true);
+    r0 = sim.regReads;
+    w0 = sim.regWrites;
+    rtc.begin(INIT_NONE);
+    warmAcc[p] = sim.regReads - r0 + sim.regWrites - w0;
+    warmCount[p] = rtc.getBackupRegCount();
+    rtc.eepromRead(back, 0, BKP_DR_MAX);
+
+    // user register i is DRi+2, check it at its own address
+    wrong[p] = 0;
+    for(i = 0; i < BKP_DR_MAX; i++)
+    {
+      if(i < rtc.eepromSize())
+      {
+        if(back[i] != data[i] || (STM32_REG_AT(BKP_REG_BASE + BKP_DR_OFFSET(i + 1)) & 0xFFFF) != data[i])
+          wrong[p]++;
+      }
+      else if(back[i] != 0)
+        wrong[p]++;                         // past the end, not touched
+    }
+    if(count[p] != parts[p] || warmCount[p] != parts[p] || wrong[p] != 0 || rtc.eepromSize() != parts[p] - 1)
+      errors++;
+  }
+  if(BKP_DR_OFFSET(9) != 0x28 || BKP_DR_OFFSET(10) != 0x40 || BKP_DR_OFFSET(41) != 0xBC ||
+     sizeof(BACKUP_REGS) != 0xC0)
+    errors++;
+
+  printf("backup probe     (DR11 - DR42 at 0x40 - 0xBC)\n");
+  for(p = 0; p < 2; p++)
+    printf("  %2u register part  probed %u, warm start %u, %u user registers, %lu wrong, begin() %lu cold / %lu warm bus accesses\n",
+           parts[p], count[p], warmCount[p], parts[p] - 1, (unsigned long)wrong[p],
+           (unsigned long)coldAcc[p], (unsigned long)warmAcc[p]);
+  sim.setBackupRegCount(10);
+  return errors ? 1 : 0;
+}
+
+/********************************************************************
+ *  @brief key / value store on a 42 register part: get / put cost and
+ *    bus writes vs one raw eepromWrite / eepromRead register per value,
+ *    random puts & removes checked against a model across resets, then
+ *    a corrupted newest slot (torn commit) and a wiped store
+\*******************************************************************/
+static int benchKV(void)
+{
+  STM32LIBS_KV &kv = STM32LIBS_KV::getInstance();
+  uint32_t model[KV_MAX_KEYS], v;
+  uint8_t widths[KV_MAX_KEYS], key, bits;
+  uint16_t raw;
+  uint32_t i, n = 100000, w0, mismatches = 0, rawWrites, kvWrites;
+  uint8_t st, stRecovered, stCorrupt;
+  double t0, tRawPut, tRawGet, tPut, tGet;
+  int errors = 0;
+
+  sim.setBackupRegCount(42);
+  sim.powerCycle(false);
+  rtc.begin(INIT_NONE);
+  st = kv.begin();
+
+  // one counter: raw register vs 12 bit record
+  w0 = sim.regWrites;
+  t0 = nowNs();
+  for(i = 0; i < n; i++)
+  {
+    raw = i & 0xFFF;
+    rtc.eepromWrite(&raw, 40, 1);
+  }
+  tRawPut = nowNs() - t0;
+  rawWrites = sim.regWrites - w0;
+  t0 = nowNs();
+  for(i = 0; i < n; i++)
+    rtc.eepromRead(&raw, 40, 1);
+  tRawGet = nowNs() - t0;
+
+  w0 = sim.regWrites;
+  t0 = nowNs();
+  for(i = 0; i < n; i++)
+    kv.put(1, i & 0xFFF, 12);
+  tPut = nowNs() - t0;
+  kvWrites = sim.regWrites - w0;
+  t0 = nowNs();
+  for(i = 0; i < n; i++)
+    kv.get(1, &v);
+  tGet = nowNs() - t0;
+
+  // random records against a model, reloaded after a reset now and then
+  srand(7);
+  for(key = 0; key < KV_MAX_KEYS; key++)
+    widths[key] = 0;
+  kv.remove(1);
+  for(i = 0; i < 20000; i++)
+  {
+    key = rand() % KV_MAX_KEYS;
+    bits = 1 + rand() % 16;
+    v = rand() & ((1UL << bits) - 1);
+    if(rand() % 4 == 0)
+    {
+      kv.remove(key);
+      widths[key] = 0;
+    }
+    else if(kv.put(key, v, bits))
+    {
+      model[key] = v;
+      widths[key] = bits;
+    }
+    if(i % 1000 == 999)
+    {
+      sim.powerCycle(true);
+      rtc.begin(INIT_NONE);
+      if(kv.begin() != KV_OK)
+        errors++;
+      for(key = 0; key < KV_MAX_KEYS; key++)
+        if(kv.contains(key) != (widths[key] != 0) || (widths[key] != 0 && (!kv.get(key, &v) || v != model[key])))
+          mismatches++;
+    }
+  }
+
+  // newest slot damaged (torn commit, Vbat dip): the previous commit comes back
+  for(key = 0; key < KV_MAX_KEYS; key++)
+    kv.remove(key, false);
+  kv.commit();
+  kv.put(3, 1111, 11);
+  kv.put(3, 2222, 12);
+  for(i = 0; i < 2; i++)
+  {
+    // flip a bit in slot i (user registers i * 20 .., DR index + 1), keep it if 1111 comes back
+    BKP_DR(1 + i * 20 + 1) = BKP_DR(1 + i * 20 + 1) ^ 0x0100;
+    sim.powerCycle(true);
+    rtc.begin(INIT_NONE);
+    stRecovered = kv.begin();
+    if(stRecovered == KV_RECOVERED && kv.get(3, &v) && v == 1111)
+      break;
+    BKP_DR(1 + i * 20 + 1) = BKP_DR(1 + i * 20 + 1) ^ 0x0100;      // wrong slot, undo
+  }
+  if(i == 2)
+    errors++;
+  for(i = 0; i < 2 * 20; i++)
+    BKP_DR(1 + i) = BKP_DR(1 + i) ^ 0x5A5A;
+  sim.powerCycle(true);
+  rtc.begin(INIT_NONE);
+  stCorrupt = kv.begin();
+
+  printf("key / value      (42 register part, %u record bits per slot)\n", kv.capacity());
+  printf("  raw register    put %8.2f ns/op, get %8.2f ns/op, %lu bus writes / %lu puts\n",
+         tRawPut / n, tRawGet / n, (unsigned long)rawWrites, (unsigned long)n);
+  printf("  kv 12 bit       put %8.2f ns/op, get %8.2f ns/op, %lu bus writes / %lu puts (CRC & 2 slots)\n",
+         tPut / n, tGet / n, (unsigned long)kvWrites, (unsigned long)n);
+  printf("  random          20000 puts / removes, %lu mismatches over 20 resets\n", (unsigned long)mismatches);
+  printf("  damaged slot    status %u, previous value back; both slots damaged: status %u, %lu CRC errors\n",
+         stRecovered, stCorrupt, (unsigned long)kv.crcErrors);
+  if(st != KV_EMPTY || mismatches != 0 || stCorrupt != KV_CORRUPT || kv.contains(3))
+    errors++;
+  sim.setBackupRegCount(10);
+  return errors ? 1 : 0;
+}
+
+/********************************************************************
+ *  @brief 7 small fields (29 bits) in a schema vs one eeprom register
+ *    per field: registers used, get / set cost, registers touched per
+ *    field access, random sets checked against a model across resets
+\*******************************************************************/
+enum { SC_MODE, SC_ENABLED, SC_RETRIES, SC_HOUR, SC_LEVEL, SC_FLAG, SC_PHASE, SC_FIELDS };
+typedef STM32LIBS_SCHEMA<0, 3, 1, 5, 5, 12, 1, 2> BenchSchema;
+
+static_assert(BenchSchema::bits == 29 && BenchSchema::regs == 2, "schema layout");
+
+static uint32_t schemaGet(uint8_t f)
+{
+  switch(f)
+  {
+    case SC_MODE:     return BenchSchema::get<SC_MODE>();
+    case SC_ENABLED:  return BenchSchema::get<SC_ENABLED>();
+    case SC_RETRIES:  return BenchSchema::get<SC_RETRIES>();
+    case SC_HOUR:     return BenchSchema::get<SC_HOUR>();
+    case SC_LEVEL:    return BenchSchema::get<SC_LEVEL>();
+    case SC_FLAG:     return BenchSchema::get<SC_FLAG>();
+    default:          return BenchSchema::get<SC_PHASE>();
+  }
+}
+
+static void schemaSet(uint8_t f, uint32_t v)
+{
+  switch(f)
+  {
+    case SC_MODE:     BenchSchema::set<SC_MODE>(v); break;
+    case SC_ENABLED:  BenchSchema::set<SC_ENABLED>(v); break;
+    case SC_RETRIES:  BenchSchema::set<SC_RETRIES>(v); break;
+    case SC_HOUR:     BenchSchema::set<SC_HOUR>(v); break;
+    case SC_LEVEL:    BenchSchema::set<SC_LEVEL>(v); break;
+    case SC_FLAG:     BenchSchema::set<SC_FLAG>(v); break;
+    default:          BenchSchema::set<SC_PHASE>(v); break;
+  }
+}
+
+static uint32_t backupAccesses(void)
+{
+  uint32_t r, w, rs, ws;
+
+  rtc.getBackupStats(&r, &w, &rs, &ws);
+  return r + w + rs + ws;
+}
+
+static int benchSchema(void)
+{
+  const uint8_t widths[SC_FIELDS] = {3, 1, 5, 5, 12, 1, 2};
+  uint32_t model[SC_FIELDS] = {}, v = 0, a0, touchHour, touchLevel;
+  uint16_t raw[SC_FIELDS], rec[BenchSchema::regs];
+  uint32_t i, n = 100000, mismatches = 0;
+  double t0, tRawSet, tRawGet, tSet, tGet, tPack;
+  uint8_t f;
+  int errors = 0;
+
+  sim.powerCycle(false);
+  rtc.begin(INIT_NONE);
+
+  // one register per field
+  t0 = nowNs();
+  for(i = 0; i < n; i++)
+  {
+    raw[i % SC_FIELDS] = i & ((1UL << widths[i % SC_FIELDS]) - 1);
+    rtc.eepromWrite(&raw[i % SC_FIELDS], i % SC_FIELDS, 1);
+  }
+  tRawSet = nowNs() - t0;
+  t0 = nowNs();
+  for(i = 0; i < n; i++)
+    rtc.eepromRead(&raw[i % SC_FIELDS], i % SC_FIELDS, 1);
+  tRawGet = nowNs() - t0;
+
+  t0 = nowNs();
+  for(i = 0; i < n; i++)
+    BenchSchema::set<SC_HOUR>(i % 24);
+  tSet = nowNs() - t0;
+  t0 = nowNs();
+  for(i = 0; i < n; i++)
+    v += BenchSchema::get<SC_HOUR>();
+  tGet = nowNs() - t0;
+
+  // whole record: one read, 7 fields, one write
+  t0 = nowNs();
+  for(i = 0; i < n; i++)
+  {
+    BenchSchema::read(rec);
+    BenchSchema::pack<SC_MODE>(rec, i & 7);
+    BenchSchema::pack<SC_ENABLED>(rec, i & 1);
+    BenchSchema::pack<SC_RETRIES>(rec, i & 31);
+    BenchSchema::pack<SC_HOUR>(rec, i % 24);
+    BenchSchema::pack<SC_LEVEL>(rec, i & 0xFFF);
+    BenchSchema::pack<SC_FLAG>(rec, (i >> 1) & 1);
+    BenchSchema::pack<SC_PHASE>(rec, i & 3);
+    BenchSchema::write(rec);
+  }
+  tPack = nowNs() - t0;
+  i = n - 1;
+  if(BenchSchema::get<SC_LEVEL>() != (i & 0xFFF) || BenchSchema::get<SC_PHASE>() != (i & 3)
+     || BenchSchema::unpack<SC_RETRIES>(rec) != (i & 31))
+    errors++;
+
+  // registers touched: HOUR lies in register 0, LEVEL straddles 0 & 1
+  a0 = backupAccesses();
+  BenchSchema::get<SC_HOUR>();
+  touchHour = backupAccesses() - a0;
+  a0 = backupAccesses();
+  BenchSchema::get<SC_LEVEL>();
+  touchLevel = backupAccesses() - a0;
+
+  // random sets, neighbouring fields must not change
+  for(f = 0; f < SC_FIELDS; f++)
+    model[f] = schemaGet(f);
+  srand(11);
+  for(i = 0; i < 20000; i++)
+  {
+    f = rand() % SC_FIELDS;
+    v = rand();
+    schemaSet(f, v);                                  // bits above the width are dropped
+    model[f] = v & ((1UL << widths[f]) - 1);
+    if(i % 1000 == 999)
+    {
+      sim.powerCycle(true);
+      rtc.begin(INIT_NONE);
+    }
+    for(f = 0; f < SC_FIELDS; f++)
+      if(schemaGet(f) != model[f])
+        mismatches++;
+  }
+
+  printf("schema           (%u fields, %u bits: %u registers instead of %u)\n",
+         BenchSchema::fields, BenchSchema::bits, BenchSchema::regs, SC_FIELDS);
+  printf("  raw register    set %8.2f ns/op, get %8.2f ns/op\n", tRawSet / n, tRawGet / n);
+  printf("  schema field    set %8.2f ns/op, get %8.2f ns/op, registers per get: %lu (in one), %lu (straddling)\n",
+         tSet / n, tGet / n, (unsigned long)touchHour, (unsigned long)touchLevel);
+  printf("  whole record    read + 7 x pack + write %8.2f ns/op\n", tPack / n);
+  printf("  random          20000 sets, %lu mismatches over 20 resets\n", (unsigned long)mismatches);
+  if(touchHour != 1 || touchLevel != 2 || mismatches != 0)
+    errors++;
+  return errors ? 1 : 0;
+}
+
+/********************************************************************
+ *  @brief local time over a decade (2020 - 2029) in several zones:
+ *    rules evaluated on every conversion vs the cached transition window,
+ *    glibc localtime_r() with the same TZ string as reference (offset
+ *    and DST flag must match for every sample), then getLocalDateTime()
+ *    on the simulated RTC around a DST transition
+\*******************************************************************/
+static int benchTimeZone(void)
+{
+  static const char *zones[] = {
+    "CET-1CEST,M3.5.0,M10.5.0/3",                 // Central Europe
+    "EST5EDT,M3.2.0,M11.1.0",                     // US Eastern
+    "AEST-10AEDT,M10.1.0,M4.1.0/3",               // Sydney, DST over new year
+    "NZST-12NZDT,M9.5.0,M4.1.0/3",                // New Zealand
+    "IST-2IDT,M3.4.4/26,M10.5.0",                 // Israel, transition hour 26
+    "<-02>2<-01>,M3.5.0/-1,M10.5.0/0",            // Greenland, negative hour
+    "<+0530>-5:30",                               // India, no DST
+    "EST5EDT",                                    // US rules by default
+  };
+  const uint32_t first = 1577836800UL, last = 1893456000UL, stride = 127;
+  uint32_t z, utc, n, mismatches = 0, updates, localMiss = 0;
+  RTC_tz_t tz;
+  struct tm tm;
+  time_t tt;
+  int32_t sum = 0;
+  double t0, tRules = 0, tCached = 0, tLibc = 0, tUtc, tLocal;
+  bool dst;
+  RTC_datetime_t dt;
+  int errors = 0;
+
+  n = (last - first) / stride;
+  for(z = 0; z < sizeof(zones) / sizeof(zones[0]); z++)
+  {
+    if(!tzCompile(&tz, zones[z]))
+    {
+      printf("  %s: not compiled\n", zones[z]);
+      errors++;
+      continue;
+    }
+    setenv("TZ", zones[z], 1);
+    tzset();
+    for(utc = first; utc < last; utc += stride)
+    {
+      tt = utc;
+      localtime_r(&tt, &tm);
+      if(tzOffset(&tz, utc) != tm.tm_gmtoff || tz.isDst != (tm.tm_isdst > 0))
+        mismatches++;
+    }
+
+    // rules on every read (what ad hoc DST code does)
+    t0 = nowNs();
+    for(utc = first; utc < last; utc += stride)
+    {
+      tzUpdate(&tz, utc);
+      sum += tz.offset;
+    }
+    tRules += nowNs() - t0;
+
+    updates = 0;
+    t0 = nowNs();
+    for(utc = first; utc < last; utc += stride)
+    {
+      if(utc - tz.from >= tz.span)
+        updates++;
+      sum += tzToLocal(&tz, utc) - utc;
+    }
+    tCached += nowNs() - t0;
+
+    t0 = nowNs();
+    for(utc = first; utc < last; utc += stride)
+    {
+      tt = utc;
+      localtime_r(&tt, &tm);
+      sum += tm.tm_gmtoff;
+    }
+    tLibc += nowNs() - t0;
+    if(z == 0)
+      printf("time zones       (%lu samples per zone, 2020 - 2029, %u zones)\n",
+             (unsigned long)n, (unsigned)(sizeof(zones) / sizeof(zones[0])));
+    printf("  %-34s %2lu rule evaluations, next transition after 2020-01-01: %lu\n",
+           zones[z], (unsigned long)updates, (unsigned long)tzNextTransition(&tz, first));
+  }
+  n *= sizeof(zones) / sizeof(zones[0]);
+  printf("  rules each read %8.2f ns/op\n", tRules / n);
+  printf("  cached window   %8.2f ns/op\n", tCached / n);
+  printf("  glibc localtime %8.2f ns/op\n", tLibc / n);
+  printf("  vs glibc        %lu offset / DST mismatches (checksum %ld)\n", (unsigned long)mismatches, (long)(sum & 0xFF));
+  if(mismatches != 0 || tzCompile(&tz, "CET-1CEST,M3.5.0") || tzCompile(&tz, "X5") || tz.offset != 0)
+    errors++;
+
+  // getLocalDateTime() on the simulated RTC: 2024-03-31 00:59:50 UTC, CET -> CEST at 01:00 UTC
+  rtc.setTimeZone(zones[0]);
+  rtc.setEpoch(1711846790UL);
+  for(n = 0; n < 20; n++)
+  {
+    rtc.getLocalDateTime(&dt, RTC_HOUR_FORMAT_24);
+    utc = rtc.getEpoch();
+    if(dt.hours != ((utc < 1711846800UL) ? 1 : 3) || dt.day != 31 || dt.month != 3 ||
+       rtc.getUtcOffset(&dst) != ((utc < 1711846800UL) ? 3600 : 7200) || dst != (utc >= 1711846800UL))
+      localMiss++;
+    sim.advanceSeconds(1);
+  }
+  t0 = nowNs();
+  for(n = 0; n < 10000; n++)
+    rtc.getDateTime(&dt, RTC_HOUR_FORMAT_24);
+  tUtc = nowNs() - t0;
+  t0 = nowNs();
+  for(n = 0; n < 10000; n++)
+    rtc.getLocalDateTime(&dt, RTC_HOUR_FORMAT_24);
+  tLocal = nowNs() - t0;
+  printf("  rtc             getDateTime %8.2f ns/op, getLocalDateTime %8.2f ns/op, %lu wrong around the transition\n",
+         tUtc / 10000, tLocal / 10000, (unsigned long)localMiss);
+  rtc.setTimeZone(nullptr);
+  if(localMiss != 0)
+    errors++;
+  return errors ? 1 : 0;
+}
+
+/********************************************************************
+ *  @brief getDateTimeStr() vs snprintf() building the same strings:
+ *    every format checked against snprintf over the 32 bit epoch range
+ *    in 12 & 24 hour time, then ns/op for ISO 8601 and the long format
+\*******************************************************************/
+static uint8_t refDateTimeStr(char *buf, uint8_t size, const RTC_datetime_t *dt, uint8_t format, int32_t utcOffset)
+{
+  static const char *ampm[] = {" AM", " PM"};
+  const char *sfx = (dt->hour_format == RTC_HOUR_FORMAT_12) ? ampm[dt->am_pm] : "";
+  uint8_t h24 = (dt->hour_format == RTC_HOUR_FORMAT_12) ? (dt->hours % 12) + (dt->am_pm == RTC_HOUR_PM ? 12 : 0) : dt->hours;
+  int32_t off = (utcOffset < 0) ? -utcOffset : utcOffset;
+  int n = 0;
+
+  switch(format)
+  {
+    case DT_FORMAT_ISO8601:
+      n = snprintf(buf, size, "%04u-%02u-%02uT%02u:%02u:%02u", dt->year, dt->month, dt->day, h24, dt->minutes, dt->seconds);
+      break;
+    case DT_FORMAT_RFC3339:
+      if(utcOffset == 0)
+        n = snprintf(buf, size, "%04u-%02u-%02uT%02u:%02u:%02uZ", dt->year, dt->month, dt->day, h24, dt->minutes, dt->seconds);
+      else
+        n = snprintf(buf, size, "%04u-%02u-%02uT%02u:%02u:%02u%c%02u:%02u", dt->year, dt->month, dt->day, h24,
+                     dt->minutes, dt->seconds, (utcOffset < 0) ? '-' : '+', (unsigned)(off / 3600), (unsigned)(off / 60 % 60));
+      break;
+    case DT_FORMAT_COMPACT:
+      n = snprintf(buf, size, "%04u%02u%02uT%02u%02u%02u", dt->year, dt->month, dt->day, h24, dt->minutes, dt->seconds);
+      break;
+    case DT_FORMAT_DATE:
+      n = snprintf(buf, size, "%04u-%02u-%02u", dt->year, dt->month, dt->day);
+      break;
+    case DT_FORMAT_TIME:
+      n = snprintf(buf, size, "%02u:%02u:%02u%s", dt->hours, dt->minutes, dt->seconds, sfx);
+      break;
+    case DT_FORMAT_DATETIME:
+      n = snprintf(buf, size, "%04u-%02u-%02u %02u:%02u:%02u%s", dt->year, dt->month, dt->day, dt->hours, dt->minutes, dt->seconds, sfx);
+      break;
+    case DT_FORMAT_US:
+      n = snprintf(buf, size, "%02u/%02u/%04u %02u:%02u:%02u%s", dt->month, dt->day, dt->year, dt->hours, dt->minutes, dt->seconds, sfx);
+      break;
+    case DT_FORMAT_LONG:
+      n = snprintf(buf, size, "%s, %s %u, %04u %02u:%02u:%02u%s", rtc.getWeekdayName(dt->weekday), rtc.getMonthName(dt->month),
+                   dt->day, dt->year, dt->hours, dt->minutes, dt->seconds, sfx);
+      break;
+  }
+  return (uint8_t)n;
+}
+
+static int benchFormat(void)
+{
+  static const int32_t offsets[] = {0, 3600, -18000, 19800, -34200};
+  char a[RTC_DATETIME_STR_MAX], b[64];
+  RTC_datetime_t dt;
+  uint64_t e;
+  uint32_t n = 0, mismatches = 0, i, len = 0, maxLen = 0, tooSmall = 0;
+  uint8_t fmt, hf;
+  double t0, tIso, tIsoRef, tLong, tLongRef;
+  int errors = 0;
+
+  for(e = 0; e <= 0xFFFFFFFFULL; e += 86399 * 37 + 4099)
+  {
+    for(hf = RTC_HOUR_FORMAT_12; hf <= RTC_HOUR_FORMAT_24; hf++)
+    {
+      rtc.epochToDateTime(&dt, (uint32_t)e);
+      dt.hour_format = RTC_HOUR_FORMAT_24;
+      if(hf == RTC_HOUR_FORMAT_12)
+      {
+        dt.hour_format = hf;
+        dt.am_pm = (dt.hours >= 12) ? RTC_HOUR_PM : RTC_HOUR_AM;
+        dt.hours = (dt.hours % 12 == 0) ? 12 : dt.hours % 12;
+      }
+      for(fmt = 0; fmt < DT_FORMATS; fmt++)
+      {
+        len = rtc.getDateTimeStr(a, sizeof(a), &dt, fmt, offsets[n % 5]);
+        if(len != refDateTimeStr(b, sizeof(b), &dt, fmt, offsets[n % 5]) || strcmp(a, b) != 0)
+          mismatches++;
+        if(len > maxLen)
+          maxLen = len;
+        // one byte short must fail cleanly, exact size must fit
+        if(rtc.getDateTimeStr(a, len, &dt, fmt, offsets[n % 5]) != 0 || a[0] != 0 ||
+           rtc.getDateTimeStr(a, len + 1, &dt, fmt, offsets[n % 5]) != len || strcmp(a, b) != 0)
+          tooSmall++;
+        n++;
+      }
+    }
+  }
+
+  rtc.epochToDateTime(&dt, 1601478000UL);             // Wednesday, September 30, 2020 15:00:00
+  dt.hour_format = RTC_HOUR_FORMAT_24;
+  const uint32_t reps = 1000000;
+  t0 = nowNs();
+  for(i = 0; i < reps; i++)
+  {
+    dt.seconds = i % 60;
+    len += rtc.getDateTimeStr(a, sizeof(a), &dt, DT_FORMAT_ISO8601);
+  }
+  tIso = nowNs() - t0;
+  t0 = nowNs();
+  for(i = 0; i < reps; i++)
+  {
+    dt.seconds = i % 60;
+    len += refDateTimeStr(b, sizeof(b), &dt, DT_FORMAT_ISO8601, 0);
+  }
+  tIsoRef = nowNs() - t0;
+  t0 = nowNs();
+  for(i = 0; i < reps; i++)
+  {
+    dt.seconds = i % 60;
+    len += rtc.getDateTimeStr(a, sizeof(a), &dt, DT_FORMAT_LONG);
+  }
+  tLong = nowNs() - t0;
+  t0 = nowNs();
+  for(i = 0; i < reps; i++)
+  {
+    dt.seconds = i % 60;
+    len += refDateTimeStr(b, sizeof(b), &dt, DT_FORMAT_LONG, 0);
+  }
+  tLongRef = nowNs() - t0;
+
+  printf("datetime strings (%lu strings, %u formats, 12 & 24 hour, longest %lu chars)\n",
+         (unsigned long)n, DT_FORMATS, (unsigned long)maxLen);
+  printf("  ISO 8601        getDateTimeStr %8.2f ns/op, snprintf %8.2f ns/op (%.1fx)\n", tIso / reps, tIsoRef / reps, tIsoRef / tIso);
+  printf("  long            getDateTimeStr %8.2f ns/op, snprintf %8.2f ns/op (%.1fx)\n", tLong / reps, tLongRef / reps, tLongRef / tLong);
+  printf("  vs snprintf     %lu mismatches, %lu short buffer errors (checksum %lu)\n",
+         (unsigned long)mismatches, (unsigned long)tooSmall, (unsigned long)(len & 0xFF));
+  if(mismatches != 0 || tooSmall != 0 || maxLen != RTC_DATETIME_STR_MAX - 1 ||
+     rtc.getDateTimeStr(a, sizeof(a), &dt, DT_FORMATS) != 0)
+    errors++;
+  return errors ? 1 : 0;
+}
+
+/********************************************************************
+ *  @brief parseDateTimeStr(): strings from getDateTimeStr() parsed back
+ *    to the same epoch over the 32 bit range (ISO 8601, RFC 3339 with
+ *    offsets, compact), error positions for broken input, then ns/op vs
+ *    sscanf() + dateTimeToEpoch() for the same ISO 8601 string
+\*******************************************************************/
+static int benchParse(void)
+{
+  static const struct { const char *str; uint8_t ok; uint8_t pos; } cases[] = {
+    {"2024-02-29T23:59:59",        1, 19},
+    {"2024-02-29 23:59",           1, 16},
+    {"2024-02-29",                 1, 10},
+    {"20240229235959",             1, 14},
+    {"20240229T235959.250Z",       1, 20},
+    {"2024-02-29T23:59:59+05:30",  1, 25},
+    {"2024-02-29T23:59:59-0800",   0, 22},      // basic zone in an extended string
+    {"2024-02-29T23:59:59Z\r\n",   1, 20},
+    {"2023-02-29T00:00:00",        0, 8},       // no Feb 29 in 2023
+    {"2024-13-01T00:00:00",        0, 5},
+    {"2024-12-01T24:00:00",        0, 11},
+    {"2024-12-01T23:60:00",        0, 14},
+    {"2024-12-01T23:59:60",        0, 17},
+    {"2024-12-01X23:59:59",        0, 10},
+    {"2024-12-01T23-59-59",        0, 13},
+    {"2024-1-01",                  0, 6},
+    {"1969-12-31T23:59:59",        0, 0},
+    {"2106-02-07T06:28:16",        0, 0},       // one second past the 32 bit counter
+    {"2106-02-07T06:28:15",        1, 19},
+    {"1970-01-01T00:30:00+01:00",  0, 0},       // before 1970 in UTC
+    {"2024-12-01T12:00:00.",       0, 20},
+    {"2024-12-01T12:00:00+2",      0, 21},
+    {"2024-12-01T12:00:00 ",       0, 19},
+  };
+  static const int32_t offsets[] = {0, 3600, -18000, 19800, -34200, 50400};
+  char str[RTC_DATETIME_STR_MAX];
+  RTC_datetime_t dt;
+  uint64_t e;
+  uint32_t epoch, n = 0, mismatches = 0, badPos = 0, i;
+  uint8_t pos, len, fmt, st;
+  int32_t off;
+  unsigned y, mo, d, h, mi, sec;
+  double t0, tParse, tScanf;
+  const uint32_t reps = 1000000;
+  uint32_t sum = 0;
+  int errors = 0;
+
+  for(e = 86400; e <= 0xFFFFFFFFULL - 86400; e += 86399 * 37 + 4099)
+  {
+    for(fmt = DT_FORMAT_ISO8601; fmt <= DT_FORMAT_COMPACT; fmt++)
+    {
+      off = (fmt == DT_FORMAT_RFC3339) ? offsets[n % 6] : 0;
+      rtc.epochToDateTime(&dt, (uint32_t)(e + off));
+      dt.hour_format = RTC_HOUR_FORMAT_24;
+      len = rtc.getDateTimeStr(str, sizeof(str), &dt, fmt, off);
+      if(rtc.parseDateTimeStr(str, len, &epoch, &pos) != STM32LIBS_RTC::RTC_OK || epoch != (uint32_t)e || pos != len)
+        mismatches++;
+      n++;
+    }
+  }
+
+  for(i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+  {
+    st = rtc.parseDateTimeStr(cases[i].str, strlen(cases[i].str), &epoch, &pos);
+    if((st == STM32LIBS_RTC::RTC_OK) != (cases[i].ok != 0) || pos != cases[i].pos)
+    {
+      printf("  \"%s\": status %u, position %u\n", cases[i].str, st, pos);
+      badPos++;
+    }
+  }
+  // length limited, no terminator: the date part of a longer frame
+  if(rtc.parseDateTimeStr("2024-02-29T23:59:59", 10, &epoch, &pos) != STM32LIBS_RTC::RTC_OK || pos != 10 || epoch != 1709164800UL)
+    badPos++;
+
+  strcpy(str, "2024-02-29T23:59:59");
+  t0 = nowNs();
+  for(i = 0; i < reps; i++)
+  {
+    str[18] = '0' + i % 10;
+    rtc.parseDateTimeStr(str, 19, &epoch);
+    sum += epoch;
+  }
+  tParse = nowNs() - t0;
+  t0 = nowNs();
+  for(i = 0; i < reps; i++)
+  {
+    str[18] = '0' + i % 10;
+    if(sscanf(str, "%4u-%2u-%2uT%2u:%2u:%2u", &y, &mo, &d, &h, &mi, &sec) == 6)
+    {
+      dt.year = y;
+      dt.month = mo;
+      dt.day = d;
+      dt.hours = h;
+      dt.minutes = mi;
+      dt.seconds = sec;
+      dt.hour_format = RTC_HOUR_FORMAT_24;
+      rtc.dateTimeToEpoch(&dt, &epoch);
+    }
+    sum += epoch;
+  }
+  tScanf = nowNs() - t0;
+
+  printf("timestamp parse  (%lu round trips ISO 8601 / RFC 3339 / compact, %u error cases)\n",
+         (unsigned long)n, (unsigned)(sizeof(cases) / sizeof(cases[0])));
+  printf("  ISO 8601        parseDateTimeStr %8.2f ns/op, sscanf + dateTimeToEpoch %8.2f ns/op (%.1fx)\n",
+         tParse / reps, tScanf / reps, tScanf / tParse);
+  printf("  checks          %lu round trip mismatches, %lu wrong status / position (checksum %lu)\n",
+         (unsigned long)mismatches, (unsigned long)badPos, (unsigned long)(sum & 0xFF));
+  if(mismatches != 0 || badPos != 0)
+    errors++;
+  return errors ? 1 : 0;
+}
+
+/********************************************************************
+ *  @brief log replay: 1M epochs converted one by one with
+ *    epochToDateTime() into RTC_datetime_t vs calEpochsToDateTimes()
+ *    into element arrays, conversions per second, results compared
+\*******************************************************************/
+static int benchBatch(void)
+{
+  const uint32_t n = 1000000, reps = 20;
+  uint32_t *epochs = new uint32_t[n];
+  RTC_datetime_t *aos = new RTC_datetime_t[n];
+  uint16_t *year = new uint16_t[n];
+  uint8_t *fields = new uint8_t[6 * n];
+  RTC_datetime_soa_t soa = {year, fields, fields + n, fields + 2 * n, fields + 3 * n, fields + 4 * n, fields + 5 * n};
+  uint32_t i, r, mismatches = 0, sum = 0;
+  double t0, tOne, tBatch;
+  int errors = 0;
+
+  srand(5);
+  for(i = 0; i < n; i++)                            // full range, plus the edges
+    epochs[i] = (i < 2) ? (i ? 0xFFFFFFFF : 0) : ((uint32_t)rand() << 16) ^ (uint32_t)rand() ^ ((uint32_t)rand() << 31);
+
+  t0 = nowNs();
+  for(r = 0; r < reps; r++)
+  {
+    for(i = 0; i < n; i++)
+      rtc.epochToDateTime(&aos[i], epochs[i]);
+    sum += aos[r].day;
+  }
+  tOne = nowNs() - t0;
+  t0 = nowNs();
+  for(r = 0; r < reps; r++)
+  {
+    calEpochsToDateTimes(epochs, n, &soa);
+    sum += soa.day[r];
+  }
+  tBatch = nowNs() - t0;
+
+  for(i = 0; i < n; i++)
+    if(aos[i].year != soa.year[i] || aos[i].month != soa.month[i] || aos[i].day != soa.day[i] ||
+       aos[i].hours != soa.hours[i] || aos[i].minutes != soa.minutes[i] || aos[i].seconds != soa.seconds[i] ||
+       aos[i].weekday != soa.weekday[i])
+      mismatches++;
+
+  printf("batch decode     (%lu epochs x %lu)\n", (unsigned long)n, (unsigned long)reps);
+  printf("  epochToDateTime %8.2f ns/op, %7.1f M conversions/s (RTC_datetime_t, %u bytes)\n",
+         tOne / n / reps, 1e3 * n * reps / tOne, (unsigned)sizeof(RTC_datetime_t));
+  printf("  batch SoA       %8.2f ns/op, %7.1f M conversions/s (9 bytes)\n",
+         tBatch / n / reps, 1e3 * n * reps / tBatch);
+  printf("  vs one by one   %lu mismatches (checksum %lu)\n", (unsigned long)mismatches, (unsigned long)(sum & 0xFF));
+  if(mismatches != 0)
+    errors++;
+  delete[] epochs;
+  delete[] aos;
+  delete[] year;
+  delete[] fields;
+  return errors ? 1 : 0;
+}
+
+/********************************************************************
+ *  @brief begin() after a power on (cold: LSE start, prescaler load)
+ *    vs after an MCU reset with Vbat (warm: registers restored, clock &
+ *    HAL init skipped), simulated time. The clock & HAL init a warm
+ *    begin() skips is timed on its own. Time, alarm & flags must survive.
+\*******************************************************************/
+static int benchWarmStart(void)
+{
+  uint32_t coldUs, warmUs, initUs, start, epoch, r0, w0, coldAcc, warmAcc;
+  bool coldWarm, warmWarm, fired = false;
+  int errors = 0, i;
+
+#if !RTC_WARM_START
+  printf("begin()          warm start skipped, built with RTC_WARM_START=0\n");
+  return 0;
+#endif
+  sim.powerCycle(false);
+  r0 = sim.regReads;
+  w0 = sim.regWrites;
+  rtc.begin(INIT_NONE);
+  coldAcc = sim.regReads - r0 + sim.regWrites - w0;
+  rtc.getBeginStats(&coldUs, &coldWarm);
+  rtc.setEpoch(1700000000);
+  rtc.setAlarmFromEpoch(1700000100);
+
+  sim.advanceSeconds(10);
+  sim.powerCycle(true);
+  r0 = sim.regReads;
+  w0 = sim.regWrites;
+  rtc.begin(INIT_NONE);
+  warmAcc = sim.regReads - r0 + sim.regWrites - w0;
+  rtc.getBeginStats(&warmUs, &warmWarm);
+  epoch = rtc.getEpoch();
+  if(epoch != 1700000010 || !rtc.isTimeSet() || !rtc.isAlarmEnabled() || !sim.irqBound())
+    errors++;
+  for(i = 0; i < 100 && !fired; i++)
+  {
+    sim.advanceSeconds(1);
+    fired = (RTC_CRL & RTC_CRL_ALARMF) != 0;
+  }
+  if(!fired || rtc.getEpoch() != 1700000100)
+    errors++;
+
+  // what the warm path leaves out, on a running RTC
+  sim.powerCycle(true);
+  start = micros();
+  RTC_init(HOUR_FORMAT_24, ::LSE_CLOCK, false);
+  initUs = micros() - start;
+
+  printf("begin()          (simulated time)\n");
+  printf("  cold            %6lu us, %4lu bus accesses (LSE start, prescaler load)\n",
+         (unsigned long)coldUs, (unsigned long)coldAcc);
+  printf("  warm            %6lu us, %4lu bus accesses (%s RTC_init() on a running RTC %lu us)\n",
+         (unsigned long)warmUs, (unsigned long)warmAcc, RTC_NATIVE_INIT ? "native" : "core", (unsigned long)initUs);
+  printf("  after reset     epoch %lu, time set %u, alarm %s\n",
+         (unsigned long)epoch, rtc.isTimeSet(), fired ? "fired" : "lost");
+  if(coldWarm || !warmWarm || warmUs >= 20 || warmUs >= initUs)
+    errors++;
+  rtc.begin(INIT_NONE);
+  return errors ? 1 : 0;
+}
+
+/********************************************************************
+ *  @brief cold start with a slow LSE (1.5 s) and with a dead one:
+ *    begin() time, the time kept by millis() until the switch, an alarm
+ *    set meanwhile, then the LSI fallback with a 20 % slow LSI before and
+ *    after serviceClock() calibrated it (simulated time)
+\*******************************************************************/
+static uint8_t lseServiceFor(uint32_t ms)
+{
+  uint8_t st = STM32LIBS_RTC::RTC_BUSY;
+  uint32_t i;
+
+  for(i = 0; i < ms; i++)
+  {
+    sim.advanceNs(1000000ULL);
+    st = rtc.serviceClock();
+  }
+  return st;
+}
+
+static volatile uint32_t lseAlarms;
+
+static void lseAlarmCallback(void *data)
+{
+  (void)data;
+  lseAlarms++;
+}
+
+static int benchLseStart(void)
+{
+  uint32_t beginUs, epochWait, epochLse, drift, driftCal, t0, alarms, unbound, passed, passedSwitch;
+  uint8_t stWait, stLse, stLsi;
+  bool warm, lse, lsi, fired, bound, readerSwitch, heldSet, resetSet, switchSet;
+  int errors = 0;
+
+#if !RTC_LSE_ASYNC
+  printf("LSE start        skipped, built with RTC_LSE_ASYNC=0\n");
+  return 0;
+#endif
+  // slow crystal: begin() returns, the time runs on, the RTC switches
+  sim.setLseStartupMs(1500);
+  sim.powerCycle(false);
+  rtc.begin(INIT_NONE);
+  rtc.getBeginStats(&beginUs, &warm);
+  bound = sim.irqBound();                           // without RTC_init()
+  unbound = sim.halUnbound;
+  rtc.enableEvents(RTC_EVENT_MASK(RTC_EVENT_SECOND));
+  rtc.enableEvents(0);
+  unbound = sim.halUnbound - unbound;
+  alarms = sim.alarmIrqs;
+  rtc.setEpoch(1700000000);
+  rtc.setAlarmFromEpoch(1700000005);
+  stWait = lseServiceFor(1000);
+  epochWait = rtc.getEpoch();
+  stLse = lseServiceFor(1000);
+  lse = (rtc.getClockSource() == STM32LIBS_RTC::LSE_CLOCK) && (RCC_BDCR & RTCSEL_MASK) == RTCSEL_LSE;
+  epochLse = rtc.getEpoch();
+  sim.advanceNs(4000000000ULL);
+  fired = (sim.alarmIrqs != alarms);                 // interrupt delivered, not just ALRF
+  if(stWait != STM32LIBS_RTC::RTC_BUSY || stLse != STM32LIBS_RTC::RTC_OK || !lse || !fired || !bound || unbound != 0 ||
+     epochWait != 1700000001 || epochLse != 1700000002 || warm || beginUs >= 1000)
+    errors++;
+
+  // an alarm that passes while the LSE starts fires a second after the switch
+  sim.powerCycle(false);
+  rtc.begin(INIT_NONE);
+  rtc.attachInterrupt(lseAlarmCallback, nullptr);
+  rtc.setEpoch(1700000000);
+  rtc.setAlarmFromEpoch(1700000001);
+  lseAlarms = 0;
+  sim.advanceNs(2000000000ULL);                     // LSE ready, only serviceClock() switches
+  rtc.getEpoch();
+  readerSwitch = (RCC_BDCR & RTC_ENAB) != 0;
+  lseServiceFor(1);
+  passedSwitch = lseAlarms;                         // not from serviceClock()
+  sim.advanceNs(1100000000ULL);
+  passed = lseAlarms;
+  rtc.detachInterrupt();
+  if(passed != 1 || passedSwitch != 0 || readerSwitch)
+    errors++;
+
+  // a reset while the LSE starts: the time was never in CNT, not set after it
+  sim.powerCycle(false);
+  rtc.begin(INIT_NONE);
+  rtc.setEpoch(1700000000);
+  sim.advanceNs(100000000ULL);
+  rtc.serviceWrites();
+  heldSet = rtc.isTimeSet() && (BKP_DR(0) & BACKUP_TIME_SET_FLAG) == 0;
+  sim.powerCycle(true);
+  rtc.begin(INIT_NONE);
+  resetSet = rtc.isTimeSet();
+  lseServiceFor(2000);
+  rtc.setEpoch(1700000000);
+  while(rtc.serviceWrites() == STM32LIBS_RTC::RTC_BUSY);
+  switchSet = (BKP_DR(0) & BACKUP_TIME_SET_FLAG) != 0;
+  if(!heldSet || resetSet || !switchSet)
+    errors++;
+
+  // no crystal: LSI, 20 % slow, calibrated after RTC_LSI_CAL_MS
+  sim.setLseFails(true);
+  sim.setLsiHz(32000);
+  sim.powerCycle(false);
+  rtc.begin(INIT_NONE);
+  rtc.setEpoch(1700000000);
+  stLsi = lseServiceFor(RTC_LSE_TIMEOUT + 10);
+  lsi = (rtc.getClockSource() == STM32LIBS_RTC::LSI_CLOCK) && (RCC_BDCR & RTCSEL_MASK) == RTCSEL_LSI;
+  t0 = rtc.getEpoch();
+  sim.advanceNs(600ULL * 1000000000ULL);
+  drift = 600 - (rtc.getEpoch() - t0);              // RTC seconds lost in 10 minutes
+  lseServiceFor(RTC_LSI_CAL_MS + 10);
+  while(rtc.serviceWrites() == STM32LIBS_RTC::RTC_BUSY);
+  t0 = rtc.getEpoch();
+  sim.advanceNs(3600ULL * 1000000000ULL);
+  driftCal = 3600 - (rtc.getEpoch() - t0);
+  if(stLsi != STM32LIBS_RTC::RTC_FAIL_LSERDY || !lsi || rtc.serviceClock() != STM32LIBS_RTC::RTC_FAIL_LSERDY ||
+     driftCal > 1 || t0 < 1700000000 + RTC_LSE_TIMEOUT / 1000)
+    errors++;
+
+  printf("LSE start        (simulated time)\n");
+  printf("  slow crystal    begin() %lu us, epoch %lu while waiting, %lu on LSE, alarm set meanwhile %s, "
+         "interrupts %s\n", (unsigned long)beginUs, (unsigned long)(epochWait - 1700000000),
+         (unsigned long)(epochLse - 1700000000), fired ? "fired" : "lost", (bound && unbound == 0) ? "bound" : "unbound");
+  printf("  alarm passed    while waiting: callback ran %lu times at the switch, %lu from the interrupt a second later, "
+         "getEpoch() %s the clock\n", (unsigned long)passedSwitch, (unsigned long)(passed - passedSwitch),
+         readerSwitch ? "switched" : "left");
+  printf("  time set        while waiting: isTimeSet() %u, backup flag %s, after a reset isTimeSet() %u\n",
+         heldSet, heldSet ? "held" : "written", resetSet);
+  printf("  no crystal      LSI fallback, %lu s lost per 10 min at nominal prescaler, %lu s per hour calibrated\n",
+         (unsigned long)drift, (unsigned long)driftCal);
+
+  sim.setLseFails(false);
+  sim.setLsiHz(SIM_LSI_HZ);
+  sim.setLseStartupMs(0);
+  sim.powerCycle(false);
+  rtc.begin(INIT_NONE);
+  return errors ? 1 : 0;
+}
+
+/********************************************************************
+ *  @brief performance counters (-DRTC_PERF=1): alarms set & fired,
+ *    seconds interrupts, backup traffic and an RTOFF timeout on the
+ *    simulator, then the binary dump decoded and compared with getPerf().
+ *    Ticks are host ns, the bus cost of the simulator is not in them.
+\*******************************************************************/
+#if !RTC_PERF
+static int benchPerf(void)
+{
+  uint8_t buf[RTC_PERF_DUMP_SIZE];
+  RTC_perf_t perf;
+
+  printf("perf counters    compiled out, build with -DRTC_PERF=1\n");
+  return (rtc.getPerf(RTC_PERF_ALARM_ISR, &perf) || rtc.dumpPerf(buf, sizeof(buf)) != 0) ? 1 : 0;
+}
+#else
+static volatile uint32_t perfAlarms;
+
+static void perfAlarmCallback(void *data)
+{
+  (void)data;
+  perfAlarms++;
+}
+
+static uint64_t getLe(const uint8_t *buf, uint8_t bytes)
+{
+  uint64_t value = 0;
+
+  while(bytes--)
+    value = (value << 8) | buf[bytes];
+  return value;
+}
+
+static int benchPerf(void)
+{
+  static const char *names[RTC_PERF_COUNTERS] = {"config enter", "config exit", "RTOFF timeout", "backup read",
+                                                 "backup write", "alarm arm", "alarm ISR", "seconds ISR"};
+  uint8_t buf[RTC_PERF_DUMP_SIZE];
+  RTC_perf_t perf;
+  uint16_t regs[9] = {0}, back[9], len;
+  uint32_t hz, i, h, mismatches = 0;
+  const uint8_t *rec;
+  double scale;
+  int errors = 0;
+
+  sim.powerCycle(false);
+  rtc.begin(INIT_NONE);
+  while(rtc.serviceClock() == STM32LIBS_RTC::RTC_BUSY)
+    sim.advanceNs(1000000ULL);
+  rtc.setEpoch(1700000000);
+  rtc.attachInterrupt(perfAlarmCallback, nullptr);
+  rtc.enableEvents(RTC_EVENT_MASK(RTC_EVENT_SECOND));
+  perfAlarms = 0;
+  rtc.resetPerf();
+
+  for(i = 0; i < 100; i++)
+  {
+    rtc.setAlarmFromEpoch(rtc.getEpoch() + 2);
+    sim.advanceSeconds(3);
+    regs[0] = (uint16_t)i;
+    rtc.eepromWrite(regs, 0, 9);
+  }
+  rtc.begin(INIT_NONE);                             // backup registers read again
+  rtc.eepromRead(back, 0, 9);
+  sim.setLseFails(true);                            // RTCCLK stops with a write in flight
+  h = rtc.setEpochAsync(1700003000);
+  while(rtc.writeStatus(h) == STM32LIBS_RTC::RTC_BUSY)
+    sim.advanceNs(1000000);
+  sim.setLseFails(false);
+  rtc.enableEvents(0);
+  rtc.detachInterrupt();
+  rtc.setEpoch(1700000000);
+
+  len = rtc.dumpPerf(buf, sizeof(buf));
+  hz = (uint32_t)getLe(buf + 8, 4);
+  if(len != RTC_PERF_DUMP_SIZE || getLe(buf, 4) != RTC_PERF_DUMP_MAGIC || buf[4] != RTC_PERF_DUMP_VERSION ||
+     buf[5] != RTC_PERF_COUNTERS || getLe(buf + 6, 2) != 16 || hz != rtc.getPerfTickHz() ||
+     rtc.dumpPerf(buf, RTC_PERF_DUMP_SIZE - 1) != 0)
+    errors++;
+  scale = 1e9 / hz;
+
+  printf("perf counters    (100 alarms set & fired, 1 stopped RTCCLK, %u byte dump, %lu ticks/s)\n",
+         (unsigned)len, (unsigned long)hz);
+  for(i = 0; i < RTC_PERF_COUNTERS; i++)
+  {
+    rec = buf + 12 + 16 * i;
+    rtc.getPerf(i, &perf);
+    if(getLe(rec, 4) != perf.calls || getLe(rec + 4, 4) != perf.max || getLe(rec + 8, 8) != perf.ticks)
+      mismatches++;                                 // getPerf() after the dump, nothing ran since
+    printf("  %-15s %6lu calls, mean %10.0f ns, max %10.0f ns\n", names[i], (unsigned long)getLe(rec, 4),
+           getLe(rec, 4) ? scale * getLe(rec + 8, 8) / getLe(rec, 4) : 0.0, scale * getLe(rec + 4, 4));
+  }
+  printf("  vs getPerf()    %lu mismatches\n", (unsigned long)mismatches);
+
+  rtc.getPerf(RTC_PERF_ALARM_ARM, &perf);
+  if(mismatches != 0 || perf.calls != 100 || perfAlarms != 100)
+    errors++;
+  rtc.getPerf(RTC_PERF_ALARM_ISR, &perf);
+  if(perf.calls != 100)
+    errors++;
+  rtc.getPerf(RTC_PERF_RTOFF_TIMEOUT, &perf);
+  if(perf.calls != 1)
+    errors++;
+  rtc.getPerf(RTC_PERF_BKP_WRITE, &perf);
+  if(perf.calls < 100)
+    errors++;
+  rtc.getPerf(RTC_PERF_BKP_READ, &perf);
+  if(perf.calls < 10)
+    errors++;
+  rtc.getPerf(RTC_PERF_SECONDS_ISR, &perf);
+  if(perf.calls < 300)
+    errors++;
+  return errors ? 1 : 0;
+}
+#endif
+
+/********************************************************************
+ *  @brief hot path suite: ns/op and heap allocations per op of the calls
+ *    an application makes all the time. Every path is run HOT_RUNS times
+ *    for at least HOT_RUN_NS each (ops per run calibrated first) and the
+ *    median is reported with the min - max spread. --save writes the
+ *    medians to a file, --check compares against such a file and fails
+ *    a path more than HOT_TOLERANCE % slower; any allocation fails too.
+ *    Calls on the register simulator include its bus cost (host time).
+\*******************************************************************/
+#define HOT_RUNS        15
+#define HOT_RUN_NS      2000000.0
+#define HOT_TOLERANCE   25
+#define HOT_PATHS       12
+#define HOT_INPUTS      4096              // power of 2
+
+typedef struct
+{
+  const char *name;
+  double ns;                              // median of the runs
+  double lo, hi;
+  double allocs;                          // per op
+} hot_result_t;
+
+static volatile uint32_t hotSink;
+
+template <typename F>
+static void hotRun(hot_result_t *res, const char *name, F op)
+{
+  double t[HOT_RUNS], t0;
+  uint32_t n, i, k, a0;
+
+  for(n = 64; n < (1UL << 24); n *= 2)              // ops per run, also warms caches
+  {
+    t0 = nowNs();
+    for(i = 0; i < n; i++)
+      op(i);
+    if(nowNs() - t0 >= HOT_RUN_NS)
+      break;
+  }
+  a0 = heapAllocs.load();
+  for(k = 0; k < HOT_RUNS; k++)
+  {
+    t0 = nowNs();
+    for(i = 0; i < n; i++)
+      op(i);
+    t[k] = (nowNs() - t0) / n;
+  }
+  std::sort(t, t + HOT_RUNS);
+  res->name = name;
+  res->ns = t[HOT_RUNS / 2];
+  res->lo = t[0];
+  res->hi = t[HOT_RUNS - 1];
+  res->allocs = (double)(heapAllocs.load() - a0) / ((double)n * HOT_RUNS);
+}
+
+static int hotSave(const char *file, const hot_result_t *res, int count)
+{
+  FILE *f = fopen(file, "w");
+  int i;
+
+  if(f == nullptr)
+    return 1;
+  fprintf(f, "# rtc_bench hot paths, median ns/op\n");
+  for(i = 0; i < count; i++)
+    fprintf(f, "%s %.2f\n", res[i].name, res[i].ns);
+  fclose(f);
+  return 0;
+}
+
+static double hotBaseline(FILE *f, const char *name)
+{
+  char line[128], key[64];
+  double ns;
+
+  rewind(f);
+  while(fgets(line, sizeof(line), f) != nullptr)
+    if(sscanf(line, "%63s %lf", key, &ns) == 2 && strcmp(key, name) == 0)
+      return ns;
+  return 0;
+}
+
+static int benchHotPaths(const char *save, const char *check)
+{
+  static uint32_t epochs[HOT_INPUTS];
+  static RTC_datetime_t dates[HOT_INPUTS];
+  hot_result_t res[HOT_PATHS];
+  RTC_datetime_t dt;
+  uint16_t regs[9] = {1, 2, 3, 4, 5, 6, 7, 8, 9}, back[9];
+  char str[48];
+  uint32_t alarmBase, i;
+  FILE *f = nullptr;
+  double base;
+  int errors = 0, count = 0, slower = 0, r;
+
+  srand(24);
+  for(i = 0; i < HOT_INPUTS; i++)
+  {
+    epochs[i] = ((uint32_t)rand() << 16) ^ (uint32_t)rand() ^ ((uint32_t)rand() << 31);
+    rtc.epochToDateTime(&dates[i], epochs[i]);
+    dates[i].hour_format = RTC_HOUR_FORMAT_24;
+  }
+
+  sim.powerCycle(false);
+  rtc.begin(INIT_NONE);
+  while(rtc.serviceClock() == STM32LIBS_RTC::RTC_BUSY)
+    sim.advanceNs(1000000ULL);
+  rtc.setBackupMode(BACKUP_WRITE_THROUGH);
+  rtc.setEpoch(1700000000);
+  alarmBase = 1700000000 + 30 * 86400UL;
+
+  hotRun(&res[count++], "epochToDateTime", [&](uint32_t i) {
+    rtc.epochToDateTime(&dt, epochs[i & (HOT_INPUTS - 1)]);
+    hotSink += dt.day;
+  });
+  hotRun(&res[count++], "dateTimeToEpoch", [&](uint32_t i) {
+    hotSink += rtc.dateTimeToEpoch(&dates[i & (HOT_INPUTS - 1)]);
+  });
+  hotRun(&res[count++], "getDateTime_24h", [&](uint32_t) {
+    rtc.getDateTime(&dt, RTC_HOUR_FORMAT_24);
+    hotSink += dt.hours;
+  });
+  hotRun(&res[count++], "getDateTime_12h", [&](uint32_t) {
+    rtc.getDateTime(&dt, RTC_HOUR_FORMAT_12);
+    hotSink += dt.hours;
+  });
+  hotRun(&res[count++], "getEpoch", [&](uint32_t) {
+    hotSink += rtc.getEpoch();
+  });
+  hotRun(&res[count++], "setAlarmFromEpoch", [&](uint32_t i) {
+    hotSink += rtc.setAlarmFromEpoch(alarmBase + (i & (HOT_INPUTS - 1)));
+  });
+  rtc.disableAlarm();
+  hotRun(&res[count++], "eepromWrite_9", [&](uint32_t i) {
+    regs[0] = (uint16_t)i;
+    rtc.eepromWrite(regs, 0, 9);
+  });
+  hotRun(&res[count++], "eepromRead_9", [&](uint32_t) {
+    rtc.eepromRead(back, 0, 9);
+    hotSink += back[0];
+  });
+  rtc.setBackupMode(BACKUP_WRITE_BACK);
+  hotRun(&res[count++], "eepromWrite_9_back", [&](uint32_t i) {
+    regs[0] = (uint16_t)i;
+    rtc.eepromWrite(regs, 0, 9);
+  });
+  rtc.setBackupMode(BACKUP_WRITE_THROUGH);
+  hotRun(&res[count++], "getWeekdayName", [&](uint32_t i) {
+    hotSink += rtc.getWeekdayName(i % 7)[0];
+  });
+  hotRun(&res[count++], "getMonthName", [&](uint32_t i) {
+    hotSink += rtc.getMonthName(i % 12 + 1)[0];
+  });
+  hotRun(&res[count++], "getDateTimeStr", [&](uint32_t i) {
+    hotSink += rtc.getDateTimeStr(str, sizeof(str), &dates[i & (HOT_INPUTS - 1)], DT_FORMAT_ISO8601);
+  });
+
+  i = heapAllocs.load();                            // the counter itself must work
+  ::operator delete(::operator new(16));
+  if(heapAllocs.load() == i)
+  {
+    printf("hot paths        heap allocations not counted\n");
+    errors++;
+  }
+  if(check != nullptr && (f = fopen(check, "r")) == nullptr)
+  {
+    printf("hot paths        cannot read baseline %s\n", check);
+    errors++;
+  }
+  printf("hot paths        (median of %u runs, min - max, heap allocations per op%s%s)\n",
+         HOT_RUNS, f ? ", vs " : "", f ? check : "");
+  for(r = 0; r < count; r++)
+  {
+    printf("  %-20s %9.2f ns/op  (%8.2f - %8.2f)  %g allocs", res[r].name, res[r].ns, res[r].lo, res[r].hi,
+           res[r].allocs);
+    if(res[r].allocs != 0)
+      errors++;
+    if(f != nullptr && (base = hotBaseline(f, res[r].name)) > 0)
+    {
+      printf("  %+6.1f %%", 100.0 * (res[r].ns - base) / base);
+      if(res[r].ns > base * (100 + HOT_TOLERANCE) / 100)
+      {
+        printf("  SLOWER");
+        slower++;
+      }
+    }
+    printf("\n");
+  }
+  if(f != nullptr)
+  {
+    printf("  vs baseline     %d of %d paths more than %u %% slower\n", slower, count, HOT_TOLERANCE);
+    fclose(f);
+  }
+  if(save != nullptr && hotSave(save, res, count) != 0)
+  {
+    printf("  cannot write %s\n", save);
+    errors++;
+  }
+  return (errors || slower) ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+  const char *save = nullptr, *check = nullptr;
+  bool hotOnly = false;
+  int fail = 0, i;
+
+  for(i = 1; i < argc; i++)
+  {
+    if(strcmp(argv[i], "--hot") == 0)
+      hotOnly = true;
+    else if(strcmp(argv[i], "--save") == 0 && i + 1 < argc)
+      save = argv[++i];
+    else if(strcmp(argv[i], "--check") == 0 && i + 1 < argc)
+      check = argv[++i];
+    else
+    {
+      fprintf(stderr, "usage: rtc_bench [--hot] [--save file] [--check file]\n");
+      return 2;
+    }
+  }
+  if(hotOnly)
+    return benchHotPaths(save, check);
+
+  fail |= benchEpochDecode();
+  fail |= benchEpochEncode();
+  fail |= benchSimulator();
+  fail |= benchScheduler();
+  fail |= benchWheel();
+  fail |= benchCron();
+  fail |= benchEventQueue();
+  fail |= benchTimestamp();
+  fail |= benchCoherentRead();
+  fail |= benchConfigWrites();
+  fail |= benchBackupCache();
+  fail |= benchBackupRegs();
+  fail |= benchKV();
+  fail |= benchSchema();
+  fail |= benchTimeZone();
+  fail |= benchFormat();
+  fail |= benchParse();
+  fail |= benchBatch();
+  fail |= benchWarmStart();
+  fail |= benchLseStart();
+  fail |= benchPerf();
+  fail |= benchHotPaths(save, check);
+  return fail;
+}
@@ -0,0 +1,282 @@
+/******************************************************************************
+  * @file    STM32LIBS_ALARMS.cpp
+  * @brief   Software alarms multiplexed on the single STM32F10x RTC alarm
+  ******************************************************************************
+  */
+
+#include "STM32LIBS_ALARMS.h"
+
+#define HEAP_FREE   0xFFFF
+
+static STM32LIBS_RTC &rtc = STM32LIBS_RTC::getInstance();
+
+
+/********************************************************************
+ **   @brief Takes over the RTC alarm interrupt. Any callback attached
+ **     with STM32LIBS_RTC::attachInterrupt() is replaced. Alarms kept
+ **     past their epoch run on the next service().
+\*******************************************************************/
+void STM32LIBS_ALARMS::begin(void)
+{
+  rtc.attachInterrupt(_alarmISR, this);
+  rtc.disableAlarm();
+  _active = true;
+  _armed = 0;
+  _arm();
+}
+
+
+/********************************************************************
+ **   @brief Releases the RTC alarm. Pending alarms are kept.
+\*******************************************************************/
+void STM32LIBS_ALARMS::end(void)
+{
+  _active = false;
+  rtc.disableAlarm();
+  rtc.detachInterrupt();
+}
+
+
+/********************************************************************
+ **   @brief Adds a one-shot alarm.
+ **   @param alarm_epoch - 32 bit epoch when the callback runs. Epochs not
+ **     in the future fire on the next service(), never from add().
+ **   @param callback - called with data by service(): in interrupt context
+ **     when the RTC alarm matches, in the caller's when service() is polled.
+ **   @returns alarm id or RTC_ALARM_NONE if all RTC_MAX_ALARMS are in use.
+\*******************************************************************/
+int32_t STM32LIBS_ALARMS::add(uint32_t alarm_epoch, voidFuncPtr callback, void *data)
+{
+  uint16_t slot;
+  int32_t id;
+  bool first;
+
+  if(callback == nullptr)
+    return RTC_ALARM_NONE;
+
+  __disable_irq();
+  if(_freeCount == 0)
+  {
+    __enable_irq();
+    return RTC_ALARM_NONE;
+  }
+  slot = _free[--_freeCount];
+  _pool[slot].epoch = alarm_epoch;
+  _pool[slot].callback = callback;
+  _pool[slot].data = data;
+  _heap[_count] = slot;
+  _pool[slot].heapPos = _count;
+  _siftUp(_count++);
+  first = (_pool[slot].heapPos == 0);
+  id = slot | ((int32_t)_pool[slot].gen << RTC_ALARM_GEN_SHIFT);
+  __enable_irq();
+
+  if(first)                   // new earliest deadline, left to service() if passed
+    _arm();
+  return id;
+}
+
+
+/********************************************************************
+ **   @brief Adds a one-shot alarm secs seconds from now.
+\*******************************************************************/
+int32_t STM32LIBS_ALARMS::addIn(uint32_t secs, voidFuncPtr callback, void *data)
+{
+  return add(rtc.getEpoch() + secs, callback, data);
+}
+
+
+/********************************************************************
+ **   @brief Cancels a pending alarm.
+ **   @returns false if id is not pending (already fired or cancelled),
+ **     also once its slot holds a newer alarm.
+ **   @note If the earliest alarm is cancelled the RTC alarm is left
+ **     armed; it fires early, finds nothing expired and arms the next one.
+ **     That is cheaper than an extra configuration write per cancel.
+\*******************************************************************/
+bool STM32LIBS_ALARMS::cancel(int32_t id)
+{
+  uint16_t slot = id & ((1UL << RTC_ALARM_GEN_SHIFT) - 1);
+
+  if(id < 0 || slot >= RTC_MAX_ALARMS)
+    return false;
+
+  __disable_irq();
+  if(_pool[slot].heapPos == HEAP_FREE || _pool[slot].gen != (id >> RTC_ALARM_GEN_SHIFT))
+  {
+    __enable_irq();
+    return false;
+  }
+  _remove(_pool[slot].heapPos);
+  __enable_irq();
+  return true;
+}
+
+
+/********************************************************************
+ **   @brief Cancels all alarms.
+\*******************************************************************/
+void STM32LIBS_ALARMS::clear(void)
+{
+  uint16_t i;
+
+  __disable_irq();
+  _count = 0;
+  _freeCount = RTC_MAX_ALARMS;
+  for(i = 0; i < RTC_MAX_ALARMS; i++)
+  {
+    _pool[i].heapPos = HEAP_FREE;
+    _pool[i].gen = (_pool[i].gen + 1) & RTC_ALARM_GEN_MASK;
+    _free[i] = RTC_MAX_ALARMS - 1 - i;     // hand out slot 0 first
+  }
+  __enable_irq();
+}
+
+
+uint32_t STM32LIBS_ALARMS::nextEpoch(void)
+{
+  return (_count > 0) ? _pool[_heap[0]].epoch : 0;
+}
+
+
+/********************************************************************
+ **   @brief Runs every expired alarm, then arms the RTC for the earliest
+ **     remaining one. Called from the RTC alarm interrupt; poll it (or
+ **     STM32LIBS_RTC::serviceWrites()) from loop() too, the RTC alarm
+ **     write queued here is finished by the next call.
+\*******************************************************************/
+void STM32LIBS_ALARMS::service(void)
+{
+  uint32_t now;
+  uint16_t slot;
+  voidFuncPtr callback;
+  void *data;
+
+  rtc.serviceWrites();                      // lands the last re-arm
+  do {
+    now = rtc.getEpoch();
+    for(;;)
+    {
+      __disable_irq();
+      if(_count == 0 || _pool[_heap[0]].epoch > now)
+      {
+        __enable_irq();
+        break;
+      }
+      slot = _heap[0];
+      callback = _pool[slot].callback;
+      data = _pool[slot].data;
+      _remove(0);                           // free before the call so it can re-add
+      __enable_irq();
+
+      fired++;
+      callback(data);
+    }
+  } while(!_arm());                         // the callbacks ran past the next deadline
+}
+
+
+/********************************************************************
+ **   @brief Queues the RTC alarm write for the earliest deadline, no
+ **     wait: called from the alarm interrupt.
+ **   @returns false if that deadline already passed.
+\*******************************************************************/
+bool STM32LIBS_ALARMS::_arm(void)
+{
+  uint32_t next;
+
+  if(!_active)
+    return true;
+
+  __disable_irq();
+  if(_count == 0)
+  {
+    __enable_irq();
+    if(_armed != 0)
+      rtc.disableAlarm();
+    _armed = 0;
+    return true;
+  }
+  next = _pool[_heap[0]].epoch;
+  __enable_irq();
+
+  if(next == _armed && next > rtc.getEpoch())   // polled from loop(), nothing changed
+    return true;
+  if(rtc.setAlarmAsync(next) == 0)
+    return false;
+  _armed = next;
+  rearms++;
+  return true;
+}
+
+
+void STM32LIBS_ALARMS::_alarmISR(void *data)
+{
+  ((STM32LIBS_ALARMS *)data)->service();
+}
+
+
+/******************************************************************************
+**    Binary heap helpers, called with interrupts disabled.
+\*****************************************************************************/
+void STM32LIBS_ALARMS::_siftUp(uint16_t pos)
+{
+  uint16_t slot = _heap[pos];
+  uint32_t epoch = _pool[slot].epoch;
+  uint16_t parent;
+
+  while(pos > 0)
+  {
+    parent = (pos - 1) >> 1;
+    if(_pool[_heap[parent]].epoch <= epoch)
+      break;
+    _heap[pos] = _heap[parent];
+    _pool[_heap[pos]].heapPos = pos;
+    pos = parent;
+  }
+  _heap[pos] = slot;
+  _pool[slot].heapPos = pos;
+}
+
+
+void STM32LIBS_ALARMS::_siftDown(uint16_t pos)
+{
+  uint16_t slot = _heap[pos];
+  uint32_t epoch = _pool[slot].epoch;
+  uint16_t child;
+
+  for(;;)
+  {
+    child = (pos << 1) + 1;
+    if(child >= _count)
+      break;
+    if(child + 1 < _count && _pool[_heap[child + 1]].epoch < _pool[_heap[child]].epoch)
+      child++;
+    if(epoch <= _pool[_heap[child]].epoch)
+      break;
+    _heap[pos] = _heap[child];
+    _pool[_heap[pos]].heapPos = pos;
+    pos = child;
+  }
+  _heap[pos] = slot;
+  _pool[slot].heapPos = pos;
+}
+
+
+void STM32LIBS_ALARMS::_remove(uint16_t pos)
+{
+  uint16_t slot = _heap[pos];
+
+  _pool[slot].heapPos = HEAP_FREE;
+  _pool[slot].gen = (_pool[slot].gen + 1) & RTC_ALARM_GEN_MASK;
+  _free[_freeCount++] = slot;
+  if(--_count == pos)                       // removed the last leaf
+    return;
+
+  _heap[pos] = _heap[_count];               // move the last leaf into the hole
+  _pool[_heap[pos]].heapPos = pos;
+  if(pos > 0 && _pool[_heap[pos]].epoch < _pool[_heap[(pos - 1) >> 1]].epoch)
+    _siftUp(pos);
+  else
+    _siftDown(pos);
+}
@@ -0,0 +1,90 @@
+/******************************************************************************
+  * @file    STM32LIBS_ALARMS.h
+  * @brief   Software alarms multiplexed on the single STM32F10x RTC alarm
+  *
+  * Keeps up to RTC_MAX_ALARMS one-shot alarms in a static binary min-heap
+  * ordered by epoch. The RTC alarm register always holds the earliest
+  * deadline; when it matches, every expired alarm is dispatched (in interrupt
+  * context, like attachInterrupt callbacks) and the write of the next one is
+  * queued. Poll service() from loop() to finish it. add() and cancel() are
+  * O(log n), nothing is allocated.
+  *
+  *   STM32LIBS_ALARMS& alarms = STM32LIBS_ALARMS::getInstance();
+  *   alarms.begin();                                   // takes over the RTC alarm
+  *   int32_t id = alarms.add(rtc.getEpoch() + 60, callback, data);
+  *   alarms.cancel(id);
+  ******************************************************************************
+  */
+
+#ifndef __STM32LIBS_ALARMS_H
+#define __STM32LIBS_ALARMS_H
+
+#include "STM32LIBS_RTC.h"
+
+// number of alarms, override with -D RTC_MAX_ALARMS=n (max 32767)
+#ifndef RTC_MAX_ALARMS
+#define RTC_MAX_ALARMS    16
+#endif
+
+#define RTC_ALARM_NONE    -1      // invalid alarm id
+
+// alarm id: pool slot | generation << 16, the generation counts the reuses
+// of the slot so an old id can't cancel the alarm that got the slot next
+#define RTC_ALARM_GEN_SHIFT   16
+#define RTC_ALARM_GEN_MASK    0x7FFF
+
+class STM32LIBS_ALARMS {
+  public:
+    static STM32LIBS_ALARMS &getInstance()
+    {
+      static STM32LIBS_ALARMS instance;
+      return instance;
+    }
+
+    // attach to / release the RTC alarm interrupt
+    void begin(void);
+    void end(void);
+
+    // alarm functions
+    int32_t add(uint32_t alarm_epoch, voidFuncPtr callback, void *data = nullptr);
+    int32_t addIn(uint32_t secs, voidFuncPtr callback, void *data = nullptr);
+    bool cancel(int32_t id);
+    void clear(void);
+
+    uint16_t count(void) { return _count; }
+    uint32_t nextEpoch(void);               // earliest deadline, 0 if none
+
+    // dispatch expired alarms and arm the RTC for the next one, poll from loop() too
+    void service(void);
+
+    // statistics
+    uint32_t fired;
+    uint32_t rearms;
+
+  private:
+    STM32LIBS_ALARMS(void): fired(0), rearms(0), _armed(0), _active(false) { clear(); }
+
+    typedef struct {
+      uint32_t epoch;
+      voidFuncPtr callback;
+      void *data;
+      uint16_t heapPos;                     // index in _heap, HEAP_FREE if unused
+      uint16_t gen;                         // id generation, bumped when freed
+    } alarm_entry_t;
+
+    static void _alarmISR(void *data);
+    void _siftUp(uint16_t pos);
+    void _siftDown(uint16_t pos);
+    void _remove(uint16_t pos);
+    bool _arm(void);
+
+    alarm_entry_t _pool[RTC_MAX_ALARMS];
+    uint16_t _heap[RTC_MAX_ALARMS];         // pool indexes, earliest epoch first
+    uint16_t _free[RTC_MAX_ALARMS];         // stack of unused pool indexes
+    uint16_t _count;
+    uint16_t _freeCount;
+    uint32_t _armed;                        // epoch queued for the RTC alarm, 0 if none
+    bool _active;
+};
+
+#endif // __STM32LIBS_ALARMS_H
@@ -0,0 +1,65 @@
+/******************************************************************************
+  * @file    STM32LIBS_CALENDAR.cpp
+  * @brief   Batch epoch conversion into separate element arrays
+  ******************************************************************************
+  */
+
+#include "STM32LIBS_CALENDAR.h"
+
+// restrict parameters, not locals: GCC only uses restrict on parameters
+// to rule out overlap between the arrays
+#if defined(__GNUC__) && !defined(__clang__)
+__attribute__((optimize("tree-vectorize", "vect-cost-model=dynamic")))   // GCC -O2 only vectorizes trivial loops
+#endif
+static void epochsToDateTimes(const uint32_t *__restrict in, uint32_t n, uint16_t *__restrict year,
+                              uint8_t *__restrict month, uint8_t *__restrict day, uint8_t *__restrict hours,
+                              uint8_t *__restrict minutes, uint8_t *__restrict seconds, uint8_t *__restrict weekday)
+{
+  uint32_t i;
+
+  for(i = 0; i < n; i++)
+  {
+    uint32_t e = in[i];
+    uint32_t days = (uint32_t)(((uint64_t)(e >> 7) * 0x308B915ULL) >> 35);
+    uint32_t sod = e - days * CAL_SECS_PER_DAY;
+    uint32_t h = (sod * 37283UL) >> 27;
+    uint32_t rem = sod - h * 3600UL;
+    uint32_t m = (rem * 2185UL) >> 17;
+
+    // calCivilFromDays()
+    uint32_t n1 = 4 * (days + 719468UL) + 3;
+    uint32_t c = n1 / 146097UL;
+    uint32_t n2 = 4 * ((n1 % 146097UL) / 4) + 3;
+    uint64_t p2 = (uint64_t)2939745UL * n2;
+    uint32_t ny = (uint32_t)p2 / 2939745UL / 4;
+    uint32_t n3 = 2141UL * ny + 197913UL;
+    uint32_t j = (ny >= 306);
+
+    hours[i] = (uint8_t)h;
+    minutes[i] = (uint8_t)m;
+    seconds[i] = (uint8_t)(rem - m * 60UL);
+    weekday[i] = (uint8_t)((days + 4) % 7);
+    year[i] = (uint16_t)(100 * c + (uint32_t)(p2 >> 32) + j);
+    month[i] = (uint8_t)((n3 >> 16) - 12 * j);
+    day[i] = (uint8_t)((n3 & 0xFFFF) / 2141UL + 1);
+  }
+}
+
+
+/********************************************************************
+ **   @brief Converts n epochs to date & time elements, element arrays
+ **     instead of one RTC_datetime_t per epoch.
+ **   @param epochs - n 32 bit epochs.
+ **   @param out - arrays of at least n elements each, must not overlap
+ **     epochs or each other.
+ **   @note The loop body is the constant time math of calSplitEpoch(),
+ **     calSplitTime(), calWeekday() and calCivilFromDays() on 32 bit lanes,
+ **     with no branches, tables or calls, so GCC & clang vectorize it on
+ **     x86 hosts (4 - 8 epochs per step). On the Cortex-M3 it is a
+ **     straight line of UMULL / UDIV per epoch with no per call overhead.
+\*******************************************************************/
+void calEpochsToDateTimes(const uint32_t *epochs, uint32_t n, const RTC_datetime_soa_t *out)
+{
+  epochsToDateTimes(epochs, n, out->year, out->month, out->day, out->hours, out->minutes,
+                    out->seconds, out->weekday);
+}
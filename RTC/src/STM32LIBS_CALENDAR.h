@@ -0,0 +1,166 @@
+// STM32LIBS_CALENDAR.h
+// constant time civil calendar helpers for the STM32LIBS_RTC library
+//
+// All conversions work on days / seconds since Jan 1 1970 and cover the full
+// range of the 32 bit RTC counter (1970 - 2106). No loops, no hardware access,
+// so this header can also be compiled on a host for testing & benchmarking.
+// calEpochsToDateTimes() (STM32LIBS_CALENDAR.cpp) converts whole arrays.
+
+#ifndef _STM32LIBS_CALENDAR_H
+#define _STM32LIBS_CALENDAR_H
+
+#include <stdint.h>
+
+#define CAL_SECS_PER_DAY    86400UL
+#define CAL_YEAR_MIN        1970
+#define CAL_YEAR_MAX        2106      // 32 bit counter wraps Feb 7 2106 06:28:15
+
+// days in the year before the 1st of each month (non leap year)
+static const uint16_t calDaysBeforeMonth[13] = {0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334, 365};
+
+/******************************************************************************
+**    @brief Splits an epoch into whole days and seconds of the day using
+**      multiply-shift instead of a division by 86400.
+**    @param _epoch - 32 bit number of seconds since 1970.
+**    @param sod - returns the seconds since midnight (0 - 86399).
+**    @returns Days since Jan 1 1970.
+**    @note 86400 = 2^7 * 675, (x >> 7) / 675 == ((x >> 7) * 0x308B915) >> 35
+**      for every 32 bit x.
+\*****************************************************************************/
+static inline uint32_t calSplitEpoch(uint32_t _epoch, uint32_t *sod)
+{
+  uint32_t days = (uint32_t)(((uint64_t)(_epoch >> 7) * 0x308B915ULL) >> 35);
+  *sod = _epoch - (days * CAL_SECS_PER_DAY);
+  return days;
+}
+
+/******************************************************************************
+**    @brief Splits seconds of the day into hours, minutes and seconds.
+**    @note The multiply-shift constants are exact for sod < 86400:
+**      x / 3600 == (x * 37283) >> 27, x / 60 == (x * 2185) >> 17 (x < 3600).
+\*****************************************************************************/
+static inline void calSplitTime(uint32_t sod, uint8_t *hours, uint8_t *minutes, uint8_t *seconds)
+{
+  uint32_t h = (sod * 37283UL) >> 27;
+  uint32_t rem = sod - (h * 3600UL);
+  uint32_t m = (rem * 2185UL) >> 17;
+
+  *hours = (uint8_t)h;
+  *minutes = (uint8_t)m;
+  *seconds = (uint8_t)(rem - (m * 60UL));
+}
+
+/******************************************************************************
+**    @brief Converts days since 1970 to year, month & day (civil calendar).
+**    @param days - days since Jan 1 1970.
+**    @note Neri & Schneider "Euclidean affine functions" algorithm. Years are
+**      counted from March 1 of year 0 so the leap day is the last day of the
+**      computational year, then mapped back to Jan 1.
+\*****************************************************************************/
+static inline void calCivilFromDays(uint32_t days, uint16_t *year, uint8_t *month, uint8_t *day)
+{
+  uint32_t n   = days + 719468UL;                 // days since 0000-03-01
+  uint32_t n1  = 4 * n + 3;
+  uint32_t c   = n1 / 146097UL;                   // century
+  uint32_t nc  = (n1 % 146097UL) / 4;             // day of century
+  uint32_t n2  = 4 * nc + 3;
+  uint64_t p2  = (uint64_t)2939745UL * n2;
+  uint32_t z   = (uint32_t)(p2 >> 32);            // year of century
+  uint32_t ny  = (uint32_t)p2 / 2939745UL / 4;    // day of year (from March 1)
+  uint32_t n3  = 2141UL * ny + 197913UL;
+  uint32_t m   = n3 >> 16;                        // month 3 - 14
+  uint32_t d   = (n3 & 0xFFFF) / 2141UL;          // day of month - 1
+  uint32_t j   = (ny >= 306);                     // Jan or Feb: next year
+
+  *year = (uint16_t)(100 * c + z + j);
+  *month = (uint8_t)(j ? m - 12 : m);
+  *day = (uint8_t)(d + 1);
+}
+
+/******************************************************************************
+**    @brief Leap year test for a full (4 digit) year.
+\*****************************************************************************/
+static inline bool calIsLeapYear(uint16_t year)
+{
+  return ((year % 4) == 0) && (((year % 100) != 0) || ((year % 400) == 0));
+}
+
+/******************************************************************************
+**    @brief Converts year, month & day to days since 1970 (civil calendar).
+**    @note No range checks, see calDateTimeToEpoch(). Leap days before the
+**      year are counted in closed form: n/4 - n/100 + n/400 for n = year - 1,
+**      minus the 477 leap days before 1970.
+\*****************************************************************************/
+static inline uint32_t calDaysFromCivil(uint16_t year, uint8_t month, uint8_t day)
+{
+  uint32_t n = (uint32_t)year - 1;
+  uint32_t days = ((uint32_t)year - 1970) * 365 + (n / 4 - n / 100 + n / 400 - 477);
+
+  days += calDaysBeforeMonth[month - 1] + (day - 1);
+  if(month > 2 && calIsLeapYear(year))
+    days++;
+  return days;
+}
+
+/******************************************************************************
+**    @brief Validates date & time elements and converts them to an epoch in
+**      a single pass.
+**    @param _epoch - returns the 32 bit epoch if the elements are valid.
+**    @returns false if any element is out of range or the result does not fit
+**      the 32 bit counter.
+\*****************************************************************************/
+static inline bool calDateTimeToEpoch(uint16_t year, uint8_t month, uint8_t day,
+                                      uint8_t hours, uint8_t minutes, uint8_t seconds,
+                                      uint32_t *_epoch)
+{
+  uint8_t monthLength;
+  uint64_t secs;
+
+  if(year < CAL_YEAR_MIN || year > CAL_YEAR_MAX || month < 1 || month > 12 ||
+     hours > 23 || minutes > 59 || seconds > 59)
+    return false;
+
+  monthLength = (uint8_t)(calDaysBeforeMonth[month] - calDaysBeforeMonth[month - 1]);
+  if(month == 2 && calIsLeapYear(year))
+    monthLength++;
+  if(day < 1 || day > monthLength)
+    return false;
+
+  secs = (uint64_t)calDaysFromCivil(year, month, day) * CAL_SECS_PER_DAY +
+         hours * 3600UL + minutes * 60UL + seconds;
+  if(secs > 0xFFFFFFFFULL)
+    return false;
+
+  *_epoch = (uint32_t)secs;
+  return true;
+}
+
+/******************************************************************************
+**    @brief Day of the week from days since 1970.
+**    @returns 0 (Sunday) - 6 (Saturday). Jan 1 1970 was a Thursday.
+\*****************************************************************************/
+static inline uint8_t calWeekday(uint32_t days)
+{
+  return (uint8_t)((days + 4) % 7);
+}
+
+/******************************************************************************
+**    @brief Output arrays of calEpochsToDateTimes(), one element per epoch
+**      (structure of arrays). All pointers are required.
+\*****************************************************************************/
+typedef struct
+{
+  uint16_t *year;
+  uint8_t *month;         // 1 - 12
+  uint8_t *day;           // 1 - 31
+  uint8_t *hours;         // 0 - 23
+  uint8_t *minutes;
+  uint8_t *seconds;
+  uint8_t *weekday;       // 0(Sunday) - 6(Saturday)
+} RTC_datetime_soa_t;
+
+// n epochs to date & time elements, same results as calling the functions
+// above for each epoch
+void calEpochsToDateTimes(const uint32_t *epochs, uint32_t n, const RTC_datetime_soa_t *out);
+
+#endif               // end _STM32LIBS_CALENDAR_H
@@ -0,0 +1,343 @@
+/******************************************************************************
+  * @file    STM32LIBS_CRON.cpp
+  * @brief   Cron style recurring alarm specs, compiler & next occurrence
+  ******************************************************************************
+  */
+
+#include "STM32LIBS_CRON.h"
+
+// field order in a 6 field spec
+enum {
+  CRON_SEC,
+  CRON_MIN,
+  CRON_HOUR,
+  CRON_MDAY,
+  CRON_MONTH,
+  CRON_WDAY,
+  CRON_FIELDS,
+};
+
+static const uint8_t fieldMin[CRON_FIELDS] = {0, 0, 0, 1, 1, 0};
+static const uint8_t fieldMax[CRON_FIELDS] = {59, 59, 23, 31, 12, 7};     // weekday 7 == 0 (Sunday)
+
+#define CRON_ALL_SECS     ((1ULL << 60) - 1)
+#define CRON_ALL_MINS     CRON_ALL_SECS
+#define CRON_ALL_HOURS    0x00FFFFFFUL
+#define CRON_ALL_MDAYS    0xFFFFFFFEUL
+#define CRON_ALL_MONTHS   0x1FFE
+#define CRON_ALL_WDAYS    0x7F
+
+// one copy of a 7 bit weekday mask every 7 bits, 42 bits
+#define CRON_WDAY_REPEAT  0x810204081ULL
+
+
+static const char *parseNum(const char *p, uint8_t *val)
+{
+  uint16_t v = 0;
+
+  if(*p < '0' || *p > '9')
+    return nullptr;
+  while(*p >= '0' && *p <= '9')
+  {
+    v = v * 10 + (*p++ - '0');
+    if(v > 255)
+      return nullptr;
+  }
+  *val = v;
+  return p;
+}
+
+
+/********************************************************************
+ **   @brief Parses one comma separated field into a bitmask.
+ **   @returns pointer past the field or nullptr on a syntax / range error.
+\*******************************************************************/
+static const char *parseField(const char *p, uint8_t field, uint64_t *mask, bool *any)
+{
+  uint8_t lo, hi, step, v;
+
+  *mask = 0;
+  *any = (*p == '*');
+  for(;;)
+  {
+    step = 1;
+    if(*p == '*')
+    {
+      lo = fieldMin[field];
+      hi = fieldMax[field];
+      p++;
+    }
+    else
+    {
+      if((p = parseNum(p, &lo)) == nullptr)
+        return nullptr;
+      hi = lo;
+      if(*p == '-')
+      {
+        if((p = parseNum(p + 1, &hi)) == nullptr)
+          return nullptr;
+      }
+      else if(*p == '/')
+        hi = fieldMax[field];               // n/step = n through the end
+    }
+    if(*p == '/')
+    {
+      if((p = parseNum(p + 1, &step)) == nullptr || step == 0)
+        return nullptr;
+    }
+    if(lo < fieldMin[field] || hi > fieldMax[field] || lo > hi)
+      return nullptr;
+
+    for(v = lo; v <= hi; v += step)
+    {
+      *mask |= 1ULL << v;
+      if(hi - v < step)
+        break;
+    }
+    if(*p != ',')
+      return p;
+    p++;
+  }
+}
+
+
+/********************************************************************
+ **   @brief Compiles a cron spec into per field bitmasks.
+ **   @param spec - "sec min hour mday month wday" or the classic 5 field
+ **     "min hour mday month wday" (second 0). Fields: '*', n, n-m, with an
+ **     optional /step, comma lists. Weekday 0 or 7 = Sunday.
+ **   @returns false on a syntax or range error.
+ **   @note Like cron, when both day of month and weekday are restricted a
+ **     day matching either one matches.
+\*******************************************************************/
+bool cronCompile(RTC_cron_t *cron, const char *spec)
+{
+  uint64_t masks[CRON_FIELDS];
+  bool any[CRON_FIELDS];
+  uint8_t n = 0, field;
+  const char *p;
+
+  if(cron == nullptr || spec == nullptr)
+    return false;
+
+  // count the fields, a 5 field spec starts at the minutes
+  for(p = spec; *p != 0; )
+  {
+    while(*p == ' ' || *p == '\t')
+      p++;
+    if(*p == 0)
+      break;
+    n++;
+    while(*p != 0 && *p != ' ' && *p != '\t')
+      p++;
+  }
+  if(n == CRON_FIELDS - 1)
+  {
+    masks[CRON_SEC] = 1;
+    any[CRON_SEC] = false;
+    field = CRON_MIN;
+  }
+  else if(n == CRON_FIELDS)
+    field = CRON_SEC;
+  else
+    return false;
+
+  for(p = spec; field < CRON_FIELDS; field++)
+  {
+    while(*p == ' ' || *p == '\t')
+      p++;
+    if((p = parseField(p, field, &masks[field], &any[field])) == nullptr)
+      return false;
+    if(*p != 0 && *p != ' ' && *p != '\t')
+      return false;
+  }
+
+  cron->seconds = masks[CRON_SEC];
+  cron->minutes = masks[CRON_MIN];
+  cron->hours = (uint32_t)masks[CRON_HOUR];
+  cron->mdays = (uint32_t)masks[CRON_MDAY];
+  cron->months = (uint16_t)masks[CRON_MONTH];
+  cron->wdays = (uint8_t)((masks[CRON_WDAY] | (masks[CRON_WDAY] >> 7)) & CRON_ALL_WDAYS);
+  cron->flags = (any[CRON_MDAY] ? CRON_MDAY_ANY : 0) | (any[CRON_WDAY] ? CRON_WDAY_ANY : 0);
+  return true;
+}
+
+
+/********************************************************************
+ **   @brief Builds a spec from an alarm match level (the Alarm_Match of
+ **     the STM32RTC library): the listed fields must match, the others
+ **     are '*'.
+ **   @param weekday - 0(Sunday) - 6(Saturday), only for CRON_MATCH_WHHMMSS.
+ **   @returns false if match or a used field is out of range.
+\*******************************************************************/
+bool cronFromMatch(RTC_cron_t *cron, uint8_t match, uint8_t month, uint8_t day, uint8_t weekday,
+                   uint8_t hours, uint8_t minutes, uint8_t seconds)
+{
+  if(cron == nullptr || match > CRON_MATCH_MMDDHHMMSS || seconds > 59 ||
+    (match >= CRON_MATCH_MMSS && minutes > 59) || (match >= CRON_MATCH_HHMMSS && hours > 23))
+    return false;
+
+  cron->seconds = 1ULL << seconds;
+  cron->minutes = (match >= CRON_MATCH_MMSS) ? (1ULL << minutes) : CRON_ALL_MINS;
+  cron->hours = (match >= CRON_MATCH_HHMMSS) ? (1UL << hours) : CRON_ALL_HOURS;
+  cron->mdays = CRON_ALL_MDAYS;
+  cron->months = CRON_ALL_MONTHS;
+  cron->wdays = CRON_ALL_WDAYS;
+  cron->flags = CRON_MDAY_ANY | CRON_WDAY_ANY;
+
+  if(match == CRON_MATCH_DHHMMSS || match == CRON_MATCH_MMDDHHMMSS)
+  {
+    if(day < 1 || day > 31)
+      return false;
+    cron->mdays = 1UL << day;
+    cron->flags = CRON_WDAY_ANY;
+  }
+  if(match == CRON_MATCH_MMDDHHMMSS)
+  {
+    if(month < 1 || month > 12)
+      return false;
+    cron->months = 1 << month;
+  }
+  if(match == CRON_MATCH_WHHMMSS)
+  {
+    if(weekday > 6)
+      return false;
+    cron->wdays = 1 << weekday;
+    cron->flags = CRON_MDAY_ANY;
+  }
+  return true;
+}
+
+
+/********************************************************************
+ **   @brief Days of a month matching the day of month / weekday fields.
+ **   @returns bit n set = day n matches.
+\*******************************************************************/
+static uint32_t cronMonthDayMask(const RTC_cron_t *cron, uint16_t year, uint8_t month)
+{
+  uint8_t len = calDaysBeforeMonth[month] - calDaysBeforeMonth[month - 1] + ((month == 2 && calIsLeapYear(year)) ? 1 : 0);
+  uint8_t w1 = calWeekday(calDaysFromCivil(year, month, 1));
+  uint32_t wmask;
+
+  // bit k of the repeated weekday mask >> w1 is the weekday of day k+1
+  wmask = (uint32_t)(((cron->wdays * CRON_WDAY_REPEAT) >> w1) << 1);
+  if(cron->flags & (CRON_MDAY_ANY | CRON_WDAY_ANY))
+    wmask &= cron->mdays;
+  else
+    wmask |= cron->mdays;
+  return wmask & (((1UL << len) - 1) << 1);
+}
+
+
+/********************************************************************
+ **   @brief First matching second of the day >= sod.
+ **   @returns false if none is left in the day.
+\*******************************************************************/
+static bool nextTime(const RTC_cron_t *cron, uint32_t sod, uint32_t *t)
+{
+  uint8_t h, m, s;
+  uint64_t bits;
+
+  calSplitTime(sod, &h, &m, &s);
+  for(;;)
+  {
+    bits = cron->hours & (0xFFFFFFFFUL << h);
+    if(bits == 0)
+      return false;
+    if(__builtin_ctzll(bits) != h)
+    {
+      h = __builtin_ctzll(bits);
+      m = 0;
+      s = 0;
+    }
+    bits = cron->minutes & (~0ULL << m);
+    if(bits == 0)
+    {
+      h++;
+      m = 0;
+      s = 0;
+      continue;
+    }
+    if(__builtin_ctzll(bits) != m)
+    {
+      m = __builtin_ctzll(bits);
+      s = 0;
+    }
+    bits = cron->seconds & (~0ULL << s);
+    if(bits == 0)
+    {
+      m++;
+      s = 0;
+      continue;
+    }
+    *t = h * 3600UL + m * 60UL + __builtin_ctzll(bits);
+    return true;
+  }
+}
+
+
+/********************************************************************
+ **   @brief First epoch after _epoch matching the spec.
+ **   @returns epoch or 0 if the spec never matches before the 32 bit
+ **     RTC counter wraps (Feb 7 2106), ex: Feb 30.
+ **   @note Months, days and times are found with bit scans, a spec that
+ **     never matches costs one month mask test per year up to 2106.
+\*******************************************************************/
+uint32_t cronNextOccurrence(const RTC_cron_t *cron, uint32_t _epoch)
+{
+  uint32_t sod, days, t, dmask, mmask;
+  uint16_t year;
+  uint8_t month, day, d;
+  uint64_t next;
+
+  if(cron == nullptr || _epoch == 0xFFFFFFFF || cron->seconds == 0 || cron->minutes == 0 ||
+    cron->hours == 0 || (cron->months & CRON_ALL_MONTHS) == 0)
+    return 0;
+
+  days = calSplitEpoch(_epoch + 1, &sod);
+  calCivilFromDays(days, &year, &month, &day);
+  while(year <= CAL_YEAR_MAX)
+  {
+    mmask = cron->months & (0xFFFFUL << month) & CRON_ALL_MONTHS;
+    if(mmask == 0)
+    {
+      // first matching month of the next year
+      year++;
+      month = __builtin_ctz(cron->months & CRON_ALL_MONTHS);
+      day = 1;
+      sod = 0;
+      continue;
+    }
+    if(__builtin_ctz(mmask) != month)
+    {
+      month = __builtin_ctz(mmask);
+      day = 1;
+      sod = 0;
+    }
+
+    dmask = cronMonthDayMask(cron, year, month) & (0xFFFFFFFFUL << day);
+    while(dmask)
+    {
+      d = __builtin_ctz(dmask);
+      if(d != day)
+        sod = 0;
+      if(nextTime(cron, sod, &t))
+      {
+        next = (uint64_t)calDaysFromCivil(year, month, d) * CAL_SECS_PER_DAY + t;
+        return (next > 0xFFFFFFFFULL) ? 0 : (uint32_t)next;
+      }
+      dmask &= dmask - 1;
+      sod = 0;
+    }
+
+    // nothing left this month
+    day = 1;
+    sod = 0;
+    if(++month > 12)
+    {
+      month = 1;
+      year++;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,56 @@
+// STM32LIBS_CRON.h
+// cron style recurring alarm specs for the STM32LIBS_RTC library
+//
+// A spec is compiled once into one bitmask per field. cronNextOccurrence()
+// then jumps from field to field with bit scans (month -> day -> hour ->
+// minute -> second) instead of stepping the calendar second by second, so
+// re-arming after an alarm costs about as much as one epoch conversion.
+//
+//   RTC_cron_t cron;
+//   cronCompile(&cron, "0 */15 8-17 * * 1-5");   // every 15 min, 8:00 - 17:45, Mon - Fri
+//   rtc.attachInterrupt(callback, data);
+//   rtc.setCronAlarm(&cron);                     // re-armed by the library after each alarm
+
+#ifndef _STM32LIBS_CRON_H
+#define _STM32LIBS_CRON_H
+
+#include <stdint.h>
+#include "STM32LIBS_CALENDAR.h"
+
+// RTC_cron_t flags
+#define CRON_MDAY_ANY     0x01    // day of month field was '*'
+#define CRON_WDAY_ANY     0x02    // weekday field was '*'
+
+typedef struct
+{
+  uint64_t seconds;       // bit n = second n, 0 - 59
+  uint64_t minutes;       // bit n = minute n, 0 - 59
+  uint32_t hours;         // bit n = hour n, 0 - 23
+  uint32_t mdays;         // bit n = day of month n, 1 - 31
+  uint16_t months;        // bit n = month n, 1 - 12
+  uint8_t wdays;          // bit n = weekday n, 0(Sunday) - 6(Saturday)
+  uint8_t flags;
+} RTC_cron_t;
+
+// alarm match levels for cronFromMatch(), the fields that have to match
+enum {
+  CRON_MATCH_SS,          // every minute at ss
+  CRON_MATCH_MMSS,        // every hour at mm:ss
+  CRON_MATCH_HHMMSS,      // every day at hh:mm:ss
+  CRON_MATCH_DHHMMSS,     // every month on day d at hh:mm:ss
+  CRON_MATCH_WHHMMSS,     // every week on the weekday at hh:mm:ss
+  CRON_MATCH_MMDDHHMMSS,  // every year
+};
+
+// spec: "sec min hour mday month wday" or the classic 5 fields (sec = 0),
+// each field '*', n, n-m, any of them with /step, or a comma list of those
+bool cronCompile(RTC_cron_t *cron, const char *spec);
+
+// weekday 0(Sunday) - 6(Saturday), as returned by getDateTime()
+bool cronFromMatch(RTC_cron_t *cron, uint8_t match, uint8_t month, uint8_t day, uint8_t weekday,
+                   uint8_t hours, uint8_t minutes, uint8_t seconds);
+
+// first matching epoch > _epoch, 0 if none before the 32 bit counter wraps
+uint32_t cronNextOccurrence(const RTC_cron_t *cron, uint32_t _epoch);
+
+#endif               // end _STM32LIBS_CRON_H
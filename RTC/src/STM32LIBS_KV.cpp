@@ -0,0 +1,265 @@
+/******************************************************************************
+  * @file    STM32LIBS_KV.cpp
+  * @brief   CRC protected key / value store in the RTC backup registers
+  ******************************************************************************
+  */
+
+#include "STM32LIBS_KV.h"
+
+#define KV_END            KV_MAX_KEYS     // key of the end marker
+#define KV_KEY_BITS       5
+#define KV_WIDTH_BITS     5
+#define KV_SEQ_BITS       4
+#define KV_RECORD_BITS    (KV_KEY_BITS + KV_WIDTH_BITS)     // + the value
+
+static STM32LIBS_RTC &rtc = STM32LIBS_RTC::getInstance();
+
+
+// MSB first bit stream over 16 bit registers
+static void putBits(uint16_t *buf, uint16_t *pos, uint32_t val, uint8_t bits)
+{
+  uint8_t off, n;
+
+  while(bits > 0)
+  {
+    off = *pos & 15;
+    n = (16 - off < bits) ? 16 - off : bits;
+    buf[*pos >> 4] |= ((val >> (bits - n)) & ((1UL << n) - 1)) << (16 - off - n);
+    *pos += n;
+    bits -= n;
+  }
+}
+
+static uint32_t getBits(const uint16_t *buf, uint16_t *pos, uint8_t bits)
+{
+  uint32_t val = 0;
+  uint8_t off, n;
+
+  while(bits > 0)
+  {
+    off = *pos & 15;
+    n = (16 - off < bits) ? 16 - off : bits;
+    val = (val << n) | ((buf[*pos >> 4] >> (16 - off - n)) & ((1UL << n) - 1));
+    *pos += n;
+    bits -= n;
+  }
+  return val;
+}
+
+
+/********************************************************************
+ **   @brief Loads the newest valid slot into the RAM index.
+ **   @param first - first eeprom register of the store.
+ **   @param len - eeprom registers used, 0 = up to eepromSize(). Two slots
+ **     of len / 2 registers (at most KV_SLOT_MAX), call after rtc.begin().
+ **   @returns KV_OK, KV_EMPTY, KV_RECOVERED or KV_CORRUPT.
+\*******************************************************************/
+uint8_t STM32LIBS_KV::begin(uint8_t first, uint8_t len)
+{
+  uint16_t buf[2][KV_SLOT_MAX];
+  uint8_t seq[2], slot, newest, i;
+  bool valid[2], blank[2];
+  uint16_t pos, end;
+  uint32_t val;
+  uint8_t key, width;
+
+  if(first >= rtc.eepromSize())
+    first = 0;
+  if(len == 0 || first + len > rtc.eepromSize())
+    len = rtc.eepromSize() - first;
+  _first = first;
+  _slotLen = (len / 2 > KV_SLOT_MAX) ? KV_SLOT_MAX : len / 2;
+  _payloadBits = (_slotLen >= 2) ? (_slotLen - 1) * 16 - KV_SEQ_BITS : 0;
+  _usedBits = 0;
+  _dirty = false;
+  for(key = 0; key < KV_MAX_KEYS; key++)
+    _width[key] = 0;
+
+  for(slot = 0; slot < 2; slot++)
+  {
+    valid[slot] = false;
+    blank[slot] = true;
+    if(_slotLen < 2)
+      continue;
+    rtc.eepromRead(buf[slot], _first + slot * _slotLen, _slotLen);
+    for(i = 0; i < _slotLen; i++)
+      if(buf[slot][i] != 0)
+        blank[slot] = false;
+    valid[slot] = (_crc(buf[slot], _slotLen - 1) == buf[slot][_slotLen - 1]);
+    seq[slot] = buf[slot][0] >> (16 - KV_SEQ_BITS);
+    if(!valid[slot] && !blank[slot])
+      crcErrors++;
+  }
+
+  if(!valid[0] && !valid[1])
+  {
+    _active = 1;                            // first commit goes to slot 0, sequence 0
+    _seq = (1 << KV_SEQ_BITS) - 1;
+    return (blank[0] && blank[1]) ? KV_EMPTY : KV_CORRUPT;
+  }
+  if(valid[0] && valid[1])
+    newest = (((seq[0] + 1) & ((1 << KV_SEQ_BITS) - 1)) == seq[1]) ? 1 : 0;
+  else
+    newest = valid[1] ? 1 : 0;
+  _active = newest;
+  _seq = seq[newest];
+
+  // records: key, width - 1, value ... up to the end marker or the end of the slot
+  pos = KV_SEQ_BITS;
+  end = KV_SEQ_BITS + _payloadBits;
+  while(pos + KV_RECORD_BITS <= end)
+  {
+    key = getBits(buf[newest], &pos, KV_KEY_BITS);
+    if(key == KV_END)
+      break;
+    width = getBits(buf[newest], &pos, KV_WIDTH_BITS) + 1;
+    if(pos + width > end)
+      break;
+    val = getBits(buf[newest], &pos, width);
+    if(_width[key] != 0)
+      _usedBits -= KV_RECORD_BITS + _width[key];
+    _value[key] = val;
+    _width[key] = width;
+    _usedBits += KV_RECORD_BITS + width;
+  }
+  return (!valid[newest ^ 1] && !blank[newest ^ 1]) ? KV_RECOVERED : KV_OK;
+}
+
+
+/********************************************************************
+ **   @brief Reads a value from the RAM index, no bus access.
+ **   @returns false if there is no record for key.
+\*******************************************************************/
+bool STM32LIBS_KV::get(uint8_t key, uint32_t *value)
+{
+  if(!contains(key) || value == nullptr)
+    return false;
+  *value = _value[key];
+  return true;
+}
+
+
+/********************************************************************
+ **   @brief Adds or replaces a record.
+ **   @param key - 0 - 30.
+ **   @param value - must fit in bits.
+ **   @param bits - stored width, 1 - 32.
+ **   @param write - commit now, else with a later commit().
+ **   @returns false if a parameter is out of range, the records would
+ **     not fit in a slot or the commit failed.
+\*******************************************************************/
+bool STM32LIBS_KV::put(uint8_t key, uint32_t value, uint8_t bits, bool write)
+{
+  uint16_t used;
+
+  if(key >= KV_MAX_KEYS || bits == 0 || bits > 32 || (bits < 32 && (value >> bits) != 0))
+    return false;
+  if(_width[key] != bits || _value[key] != value)
+  {
+    used = _usedBits + KV_RECORD_BITS + bits;
+    if(_width[key] != 0)
+      used -= KV_RECORD_BITS + _width[key];
+    if(used > _payloadBits)
+      return false;
+    _value[key] = value;
+    _width[key] = bits;
+    _usedBits = used;
+    _dirty = true;
+  }
+  return write ? commit() : true;
+}
+
+
+/********************************************************************
+ **   @brief Deletes a record.
+ **   @param write - commit now, else with a later commit().
+\*******************************************************************/
+bool STM32LIBS_KV::remove(uint8_t key, bool write)
+{
+  if(contains(key))
+  {
+    _usedBits -= KV_RECORD_BITS + _width[key];
+    _width[key] = 0;
+    _dirty = true;
+  }
+  return write ? commit() : true;
+}
+
+
+/********************************************************************
+ **   @brief Writes all records to the older slot with the next sequence
+ **     number, CRC register last. Nothing is written if no record changed.
+ **   @returns false if begin() found no room for a slot.
+\*******************************************************************/
+bool STM32LIBS_KV::commit(void)
+{
+  uint16_t buf[KV_SLOT_MAX];
+  uint8_t slot, seq;
+
+  if(!_dirty)
+    return true;
+  if(_slotLen < 2)
+    return false;
+
+  slot = _active ^ 1;
+  seq = (_seq + 1) & ((1 << KV_SEQ_BITS) - 1);
+  _encode(buf, seq);
+  buf[_slotLen - 1] = _crc(buf, _slotLen - 1);
+  rtc.eepromWrite(buf, _first + slot * _slotLen, _slotLen);   // ascending, CRC last
+
+  _active = slot;
+  _seq = seq;
+  _dirty = false;
+  commits++;
+  return true;
+}
+
+
+/********************************************************************
+ **   @brief Encodes the sequence number and all records, keys ascending.
+ **   @returns bits used.
+\*******************************************************************/
+uint16_t STM32LIBS_KV::_encode(uint16_t *buf, uint8_t seq)
+{
+  uint16_t pos = 0, end = KV_SEQ_BITS + _payloadBits;
+  uint8_t i, key;
+
+  for(i = 0; i < _slotLen; i++)
+    buf[i] = 0;
+  putBits(buf, &pos, seq, KV_SEQ_BITS);
+  for(key = 0; key < KV_MAX_KEYS; key++)
+  {
+    if(_width[key] == 0)
+      continue;
+    putBits(buf, &pos, key, KV_KEY_BITS);
+    putBits(buf, &pos, _width[key] - 1, KV_WIDTH_BITS);
+    putBits(buf, &pos, _value[key], _width[key]);
+  }
+  if(pos + KV_RECORD_BITS <= end)           // else the decoder stops at the end anyway
+    putBits(buf, &pos, KV_END, KV_KEY_BITS);
+  return pos;
+}
+
+
+/********************************************************************
+ **   @brief CRC-16/CCITT (0x1021, init 0xFFFF) over 16 bit registers,
+ **     high byte first. 4 bits per step, 32 byte table.
+\*******************************************************************/
+static const uint16_t crcNibble[16] = {
+  0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+  0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF,
+};
+
+uint16_t STM32LIBS_KV::_crc(const uint16_t *buf, uint8_t len)
+{
+  uint16_t crc = 0xFFFF;
+  uint8_t i, b;
+
+  for(i = 0; i < len; i++)
+  {
+    crc ^= buf[i];
+    for(b = 0; b < 4; b++)
+      crc = (crc << 4) ^ crcNibble[crc >> 12];
+  }
+  return crc;
+}
@@ -0,0 +1,86 @@
+/******************************************************************************
+  * @file    STM32LIBS_KV.h
+  * @brief   Small CRC protected key / value store in the RTC backup registers
+  *
+  * Calibration values, counters and flags are kept as bit packed records
+  * (5 bit key, 5 bit width, 1 - 32 bit value) instead of one value per raw
+  * eepromWrite() register. The register range is split in two slots; a
+  * commit writes the whole record set to the older slot with the next
+  * sequence number and a CRC-16 in its last register, written last. A
+  * write torn by a reset or a Vbat dip leaves a slot with a bad CRC and the
+  * other slot is used, so a commit either happens completely or not at all.
+  *
+  * begin() decodes the newest valid slot into a RAM index: get() is an
+  * array lookup with no bus access, put() re-encodes the records and only
+  * the registers that changed reach the bus (backup register shadow copy).
+  *
+  *   STM32LIBS_KV& kv = STM32LIBS_KV::getInstance();
+  *   kv.begin();                       // after rtc.begin(), uses all eeprom registers
+  *   kv.put(KEY_BOOTS, boots + 1, 12); // 12 bit counter, committed
+  *   kv.get(KEY_BOOTS, &boots);
+  *
+  * The store owns its eeprom registers, don't write them with eepromWrite().
+  ******************************************************************************
+  */
+
+#ifndef __STM32LIBS_KV_H
+#define __STM32LIBS_KV_H
+
+#include "STM32LIBS_RTC.h"
+
+#define KV_MAX_KEYS             31      // keys 0 - 30
+#define KV_SLOT_MAX             ((BKP_DR_MAX - 1) / 2)      // registers per slot
+
+// begin() results
+enum {
+  KV_OK,                  // newest slot valid
+  KV_EMPTY,               // registers blank, store starts empty
+  KV_RECOVERED,           // newest slot corrupt or torn, previous commit loaded
+  KV_CORRUPT,             // no valid slot, store starts empty
+};
+
+class STM32LIBS_KV {
+  public:
+    static STM32LIBS_KV &getInstance()
+    {
+      static STM32LIBS_KV instance;
+      return instance;
+    }
+
+    // eeprom registers first .. first + len - 1, len 0 = to the end
+    uint8_t begin(uint8_t first = 0, uint8_t len = 0);
+
+    bool get(uint8_t key, uint32_t *value);
+    bool contains(uint8_t key) { return key < KV_MAX_KEYS && _width[key] != 0; }
+    bool put(uint8_t key, uint32_t value, uint8_t bits = 16, bool write = true);
+    bool remove(uint8_t key, bool write = true);
+    bool commit(void);                      // write pending put() / remove() changes
+
+    uint16_t capacity(void) { return _payloadBits; }   // record bits per slot
+    uint16_t used(void) { return _usedBits; }
+
+    // statistics
+    uint32_t commits;
+    uint32_t crcErrors;                     // slots rejected by begin()
+
+  private:
+    STM32LIBS_KV(void): commits(0), crcErrors(0), _first(0), _slotLen(0), _payloadBits(0),
+      _usedBits(0), _active(0), _seq(0), _dirty(false), _value(), _width() {}
+
+    uint16_t _encode(uint16_t *buf, uint8_t seq);
+    static uint16_t _crc(const uint16_t *buf, uint8_t len);
+
+    uint8_t _first;                         // first eeprom register of slot 0
+    uint8_t _slotLen;                       // registers per slot, CRC included
+    uint16_t _payloadBits;
+    uint16_t _usedBits;
+    uint8_t _active;                        // slot holding the last commit
+    uint8_t _seq;                           // its sequence number, 4 bits
+    bool _dirty;
+
+    // RAM index
+    uint32_t _value[KV_MAX_KEYS];
+    uint8_t _width[KV_MAX_KEYS];            // value bits, 0 = no record
+};
+
+#endif // __STM32LIBS_KV_H
@@ -0,0 +1,208 @@
+/******************************************************************************
+  * @file    STM32LIBS_NATIVE.cpp
+  * @brief   Register level RTC init & interrupt glue, replaces the core's
+  *          RTC driver when built with -D RTC_NATIVE_INIT=1
+  *
+  * What RTC_init() keeps from the core's HAL_RTC_Init() path on an F1: start
+  * and select the clock and load the 1 Hz prescaler on an RTC that is not
+  * running yet, then wait for RSF. An RTC running from Vbat keeps its
+  * prescaler (the HAL reloads it, undoing a calibration) and nothing is
+  * written to it.
+  ******************************************************************************
+  */
+
+#include "STM32LIBS_RTC.h"
+
+#if RTC_NATIVE_INIT
+
+static int8_t nativePredivA = -1;
+static int16_t nativePredivS = -1;
+
+
+/******************************************************************************
+**    @brief Waits for a CRL flag, at most REG_TIMEOUT ms.
+\*****************************************************************************/
+static bool waitCrl(uint32_t flag)
+{
+  uint32_t start = millis();
+
+  while((RTC_CRL & flag) == 0)
+    if(millis() - start >= REG_TIMEOUT)
+      return false;
+  return true;
+}
+
+
+/******************************************************************************
+**    @brief Enables the backup domain, starts the clock & loads the prescaler
+**      if the RTC is not running, waits for the registers to sync.
+**    @param format - unused, the F1 RTC is a plain counter.
+**    @param reset - backup domain reset first: counter, alarm, backup
+**      registers and the clock selection are cleared.
+**    @note The LSE wait is bounded by RTC_LSE_TIMEOUT, the RTC is left
+**      without a clock if LSERDY is not set by then.
+\*****************************************************************************/
+void RTC_init(hourFormat_t format, sourceClock_t source, bool reset)
+{
+  uint32_t start, hz;
+
+  (void)format;
+  RCC_APB1ENR |= PWREN;
+  PWR_CR |= DBP;
+  HAL_NVIC_SetPriority(RTC_Alarm_IRQn, RTC_IRQ_PRIO, RTC_IRQ_SUBPRIO);
+  HAL_NVIC_EnableIRQ(RTC_Alarm_IRQn);      // also when the clock does not start
+  if(reset)
+  {
+    RCC_BDCR |= BKP_RESET;
+    RCC_BDCR &= ~BKP_RESET;
+  }
+  if((RCC_BDCR & RTCSEL_MASK) == RTCSEL_LSI || (!(RCC_BDCR & RTC_ENAB) && source == LSI_CLOCK))
+  {
+    RCC_CSR |= LSION;                       // not in the backup domain, off after every reset
+    start = millis();
+    while((RCC_CSR & LSIRDY) == 0 && (millis() - start) < REG_TIMEOUT);
+  }
+
+  if((RCC_BDCR & RTC_ENAB) == 0)
+  {
+    if(source == LSE_CLOCK)
+    {
+      RCC_BDCR |= LSEON;
+      start = millis();
+      while((RCC_BDCR & LSERDY) == 0)
+        if(millis() - start >= RTC_LSE_TIMEOUT)
+          return;
+      RCC_BDCR |= RTCSEL_LSE | RTC_ENAB;
+      hz = LSE_VALUE;
+    }
+    else if(source == LSI_CLOCK)
+    {
+      RCC_BDCR |= RTCSEL_LSI | RTC_ENAB;
+      hz = LSI_VALUE;
+    }
+    else
+    {
+      RCC_BDCR |= RTCSEL_HSE | RTC_ENAB;
+      hz = HSE_VALUE / 128;
+    }
+    if(nativePredivS >= 0)
+      hz = (uint32_t)nativePredivS + 1;
+
+    if(!waitCrl(RTOFF))
+      return;
+    RTC_CRL |= CNF;
+    RTC_PRLH = ((hz - 1) >> 16) & 0x000F;
+    RTC_PRLL = (hz - 1) & 0xFFFF;
+    RTC_CRL &= ~CNF;
+    waitCrl(RTOFF);
+  }
+
+  RTC_CRL &= ~RSF;                          // APB1 side may be stale after a reset
+  waitCrl(RSF);
+}
+
+
+// the F1 RTC is selected in RCC_BDCR by RTC_init(), nothing to record
+void RTC_SetClockSource(sourceClock_t source)
+{
+  (void)source;
+}
+
+
+void RTC_getPrediv(int8_t *predivA, int16_t *predivS)
+{
+  *predivA = nativePredivA;
+  *predivS = nativePredivS;
+}
+
+
+// used by the next RTC_init() on an RTC that is not running yet
+void RTC_setPrediv(int8_t predivA, int16_t predivS)
+{
+  nativePredivA = predivA;
+  nativePredivS = predivS;
+}
+
+
+#ifndef STM32LIBS_HOST_SIM
+
+static voidCallbackPtr alarmCallback = nullptr;
+static void *alarmData = nullptr;
+static voidCallbackPtr secondsCallback = nullptr;
+static RTC_HandleTypeDef nativeRtcHandle;
+
+
+void attachAlarmCallback(voidCallbackPtr func, void *data)
+{
+  alarmCallback = func;
+  alarmData = data;
+}
+
+
+void detachAlarmCallback(void)
+{
+  alarmCallback = nullptr;
+  alarmData = nullptr;
+}
+
+
+void attachSecondsIrqCallback(voidCallbackPtr func)
+{
+  secondsCallback = func;
+  RTC_CRH |= RTC_SECIE;
+  HAL_NVIC_SetPriority(RTC_IRQn, RTC_IRQ_PRIO, RTC_IRQ_SUBPRIO);
+  HAL_NVIC_EnableIRQ(RTC_IRQn);
+}
+
+
+void detachSecondsIrqCallback(void)
+{
+  RTC_CRH &= ~RTC_SECIE;
+  secondsCallback = nullptr;
+}
+
+
+// overridden by STM32LIBS_RTC
+extern "C" __attribute__((weak)) void HAL_RTCEx_RTCEventErrorCallback(RTC_HandleTypeDef *hrtc)
+{
+  (void)hrtc;
+}
+
+
+/******************************************************************************
+**    @brief Alarm interrupt, EXTI line 17.
+\*****************************************************************************/
+extern "C" void RTC_Alarm_IRQHandler(void)
+{
+  if((RTC_CRH & RTC_ALRIE) && (RTC_CRL & RTC_CRL_ALARMF))
+  {
+    RTC_CRL &= ~RTC_CRL_ALARMF;
+    if(alarmCallback != nullptr)
+      alarmCallback(alarmData);
+  }
+  EXTI_PR = EXTI_LINE17;                    // write 1 to clear
+}
+
+
+/******************************************************************************
+**    @brief Seconds & overflow interrupt. An overflow replaces the seconds
+**      callback, as in HAL_RTCEx_RTCIRQHandler().
+\*****************************************************************************/
+extern "C" void RTC_IRQHandler(void)
+{
+  if((RTC_CRH & RTC_SECIE) && (RTC_CRL & RTC_CRL_SECF))
+  {
+    if(RTC_CRL & RTC_CRL_OWF)
+    {
+      RTC_CRL &= ~RTC_CRL_OWF;
+      HAL_RTCEx_RTCEventErrorCallback(&nativeRtcHandle);
+    }
+    else if(secondsCallback != nullptr)
+      secondsCallback(nullptr);
+    RTC_CRL &= ~RTC_CRL_SECF;
+  }
+}
+
+#endif               // !STM32LIBS_HOST_SIM
+
+#endif               // RTC_NATIVE_INIT
@@ -0,0 +1,56 @@
+// STM32LIBS_NATIVE.h
+// register level replacement of the STM32duino RTC driver (rtc.c + HAL RTC) for STM32LIBS_RTC
+//
+// Built with -D RTC_NATIVE_INIT=1. The library calls the same few functions
+// it uses from the core (RTC_init(), the prescaler & clock source setters,
+// the alarm & seconds callbacks); STM32LIBS_NATIVE.cpp implements them on
+// the registers in STM32LIBS_REGS.h and owns RTC_IRQHandler and
+// RTC_Alarm_IRQHandler. The core's RTC driver must be left out, add to
+// hal_conf_extra.h:
+//
+//   #define HAL_RTC_MODULE_DISABLED
+//
+// On the host simulator only the init functions are replaced, interrupts
+// still come from STM32LIBS_SIM.
+
+#ifndef _STM32LIBS_NATIVE_H
+#define _STM32LIBS_NATIVE_H
+
+#if RTC_NATIVE_INIT && !defined(STM32LIBS_HOST_SIM)
+
+#include <stdint.h>
+
+#ifdef HAL_RTC_MODULE_ENABLED
+#error "RTC_NATIVE_INIT replaces the core's RTC driver, add #define HAL_RTC_MODULE_DISABLED to hal_conf_extra.h"
+#endif
+
+// as in the core's rtc.h
+#ifndef RTC_IRQ_PRIO
+#define RTC_IRQ_PRIO        2
+#endif
+#ifndef RTC_IRQ_SUBPRIO
+#define RTC_IRQ_SUBPRIO     0
+#endif
+
+// sourceClock_t comes from the core's clock.h (Arduino.h). The rtc.h types
+// below are left out with the RTC module disabled.
+typedef enum { HOUR_FORMAT_12, HOUR_FORMAT_24 } hourFormat_t;
+typedef enum { HOUR_AM, HOUR_PM } hourAM_PM_t;
+typedef void (*voidCallbackPtr)(void *);
+typedef struct { uint32_t State; } RTC_HandleTypeDef;     // only passed to the overflow hook
+
+void RTC_init(hourFormat_t format, sourceClock_t source, bool reset = false);
+void RTC_SetClockSource(sourceClock_t source);
+void RTC_getPrediv(int8_t *predivA, int16_t *predivS);
+void RTC_setPrediv(int8_t predivA, int16_t predivS);
+void attachAlarmCallback(voidCallbackPtr func, void *data);
+void detachAlarmCallback(void);
+void attachSecondsIrqCallback(voidCallbackPtr func);
+void detachSecondsIrqCallback(void);
+
+// called instead of the seconds callback when OWF is set, as the HAL does
+extern "C" void HAL_RTCEx_RTCEventErrorCallback(RTC_HandleTypeDef *hrtc);
+
+#endif               // RTC_NATIVE_INIT && !STM32LIBS_HOST_SIM
+
+#endif               // end _STM32LIBS_NATIVE_H
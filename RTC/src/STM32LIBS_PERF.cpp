@@ -0,0 +1,141 @@
+/******************************************************************************
+  * @file    STM32LIBS_PERF.cpp
+  * @brief   Performance counters, built with -D RTC_PERF=1
+  ******************************************************************************
+  */
+
+#include "STM32LIBS_RTC.h"
+
+#if RTC_PERF
+
+#ifdef STM32LIBS_HOST_SIM
+#include <chrono>
+#endif
+
+static RTC_perf_t perfCounters[RTC_PERF_COUNTERS];
+
+// interrupts may already be masked by the caller: PRIMASK is restored,
+// not cleared. The simulator only interrupts on register accesses.
+#ifdef STM32LIBS_HOST_SIM
+#define PERF_LOCK()
+#define PERF_UNLOCK()
+#else
+#define PERF_LOCK()       uint32_t primask = __get_PRIMASK(); __disable_irq()
+#define PERF_UNLOCK()     __set_PRIMASK(primask)
+#endif
+
+
+#ifdef STM32LIBS_HOST_SIM
+uint32_t perfNow(void)
+{
+  return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+           std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+#endif
+
+
+void perfInit(void)
+{
+#ifndef STM32LIBS_HOST_SIM
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+}
+
+
+uint32_t perfTickHz(void)
+{
+#ifdef STM32LIBS_HOST_SIM
+  return 1000000000UL;
+#else
+  return SystemCoreClock;
+#endif
+}
+
+
+/******************************************************************************
+**    @brief Counts one call of ticks, from thread or interrupt context.
+\*****************************************************************************/
+void perfAdd(uint8_t id, uint32_t ticks)
+{
+  RTC_perf_t *p = &perfCounters[id];
+
+  PERF_LOCK();
+  p->calls++;
+  p->ticks += ticks;
+  if(ticks > p->max)
+    p->max = ticks;
+  PERF_UNLOCK();
+}
+
+
+/******************************************************************************
+**    @brief Copies one counter.
+**    @returns false for an unknown id.
+\*****************************************************************************/
+bool perfGet(uint8_t id, RTC_perf_t *perf)
+{
+  if(id >= RTC_PERF_COUNTERS || perf == nullptr)
+    return false;
+  PERF_LOCK();
+  *perf = perfCounters[id];
+  PERF_UNLOCK();
+  return true;
+}
+
+
+void perfReset(void)
+{
+  uint8_t i;
+
+  PERF_LOCK();
+  for(i = 0; i < RTC_PERF_COUNTERS; i++)
+    perfCounters[i] = RTC_perf_t();
+  PERF_UNLOCK();
+}
+
+
+static uint8_t *putLe(uint8_t *buf, uint64_t value, uint8_t bytes)
+{
+  while(bytes--)
+  {
+    *buf++ = (uint8_t)value;
+    value >>= 8;
+  }
+  return buf;
+}
+
+
+/******************************************************************************
+**    @brief Writes all counters as one binary record, layout in
+**      STM32LIBS_PERF.h. The counters are copied in one masked window so
+**      the record is consistent.
+**    @returns RTC_PERF_DUMP_SIZE, 0 if size is too small.
+\*****************************************************************************/
+uint16_t perfDump(uint8_t *buf, uint16_t size)
+{
+  RTC_perf_t copy[RTC_PERF_COUNTERS];
+  uint8_t *p = buf, i;
+
+  if(buf == nullptr || size < RTC_PERF_DUMP_SIZE)
+    return 0;
+  PERF_LOCK();
+  for(i = 0; i < RTC_PERF_COUNTERS; i++)
+    copy[i] = perfCounters[i];
+  PERF_UNLOCK();
+
+  p = putLe(p, RTC_PERF_DUMP_MAGIC, 4);
+  p = putLe(p, RTC_PERF_DUMP_VERSION, 1);
+  p = putLe(p, RTC_PERF_COUNTERS, 1);
+  p = putLe(p, 16, 2);
+  p = putLe(p, perfTickHz(), 4);
+  for(i = 0; i < RTC_PERF_COUNTERS; i++)
+  {
+    p = putLe(p, copy[i].calls, 4);
+    p = putLe(p, copy[i].max, 4);
+    p = putLe(p, copy[i].ticks, 8);
+  }
+  return (uint16_t)(p - buf);
+}
+
+#endif
@@ -0,0 +1,92 @@
+// STM32LIBS_PERF.h
+// performance counters for the STM32LIBS_RTC library
+//
+// Built with -D RTC_PERF=1. Every counter keeps the number of calls, the
+// total and the longest single call in ticks: DWT cycles (SystemCoreClock)
+// on target, ns of the host's monotonic clock on the simulator. With
+// RTC_PERF 0 (default) the macros are empty and nothing is stored.
+//
+//   RTC_perf_t p;
+//   if(rtc.getPerf(RTC_PERF_CONFIG_EXIT, &p))
+//     Serial.println((uint32_t)(p.ticks / p.calls));   // mean wait for a write to land
+//
+//   uint8_t buf[RTC_PERF_DUMP_SIZE];
+//   uint16_t n = rtc.dumpPerf(buf, sizeof(buf));        // binary record, see perfDump()
+//
+// Included by STM32LIBS_RTC.h after the core headers (DWT, PRIMASK).
+
+#ifndef _STM32LIBS_PERF_H
+#define _STM32LIBS_PERF_H
+
+#include <stdint.h>
+
+#ifndef RTC_PERF
+#define RTC_PERF            0
+#endif
+
+enum {
+  RTC_PERF_CONFIG_ENTER,    // write queued -> configuration window opened (RTOFF wait)
+  RTC_PERF_CONFIG_EXIT,     // configuration window closed -> write landed (RTOFF & RSF wait)
+  RTC_PERF_RTOFF_TIMEOUT,   // RTOFF waits given up after REG_TIMEOUT, calls only
+  RTC_PERF_BKP_READ,        // backup register bus reads
+  RTC_PERF_BKP_WRITE,       // backup register bus writes
+  RTC_PERF_ALARM_ARM,       // setAlarmAsync(): alarm set or re-armed (cron, scheduler, wheel)
+  RTC_PERF_ALARM_ISR,       // alarm interrupt, library work & callbacks
+  RTC_PERF_SECONDS_ISR,     // seconds interrupt
+  RTC_PERF_COUNTERS,
+};
+
+typedef struct
+{
+  uint32_t calls;
+  uint32_t max;           // longest call, ticks
+  uint64_t ticks;         // total
+} RTC_perf_t;
+
+// perfDump() record, little endian:
+//   0  uint32 RTC_PERF_DUMP_MAGIC
+//   4  uint8  RTC_PERF_DUMP_VERSION, uint8 counters, uint16 bytes per counter (16)
+//   8  uint32 ticks per second
+//  12  per counter: uint32 calls, uint32 max, uint64 ticks
+#define RTC_PERF_DUMP_MAGIC     0x50435452UL    // "RTCP"
+#define RTC_PERF_DUMP_VERSION   1
+#define RTC_PERF_DUMP_SIZE      (12 + 16 * RTC_PERF_COUNTERS)
+
+#if RTC_PERF
+
+#ifdef STM32LIBS_HOST_SIM
+uint32_t perfNow(void);
+#else
+static inline uint32_t perfNow(void) { return DWT->CYCCNT; }
+#endif
+
+void perfInit(void);                    // starts the cycle counter, counters are kept
+void perfAdd(uint8_t id, uint32_t ticks);
+bool perfGet(uint8_t id, RTC_perf_t *perf);
+void perfReset(void);
+uint16_t perfDump(uint8_t *buf, uint16_t size);
+uint32_t perfTickHz(void);
+
+#define RTC_PERF_START(t)           uint32_t t = perfNow()
+#define RTC_PERF_MARK(t)            (t) = perfNow()
+#define RTC_PERF_STOP(id, t)        perfAdd(id, perfNow() - (t))
+#define RTC_PERF_COUNT(id)          perfAdd(id, 0)
+#define RTC_PERF_COUNT_IF(id, cond) do { if(cond) perfAdd(id, 0); } while(0)
+
+#else
+
+static inline void perfInit(void) {}
+static inline bool perfGet(uint8_t id, RTC_perf_t *perf) { (void)id; (void)perf; return false; }
+static inline void perfReset(void) {}
+static inline uint16_t perfDump(uint8_t *buf, uint16_t size) { (void)buf; (void)size; return 0; }
+static inline uint32_t perfTickHz(void) { return 0; }
+
+#define RTC_PERF_START(t)
+#define RTC_PERF_MARK(t)
+#define RTC_PERF_STOP(id, t)
+#define RTC_PERF_COUNT(id)
+#define RTC_PERF_COUNT_IF(id, cond)
+
+#endif
+
+#endif
@@ -4,10 +4,85 @@
 #ifndef _STM32LIBS_REGS_H
 #define _STM32LIBS_REGS_H
 
+#include <stdint.h>
+
+/*
+ * Register access policies. Every register define below goes through
+ * STM32LIBS_REG_POLICY::reg<ADDR>(), chosen at compile time:
+ *
+ *   STM32LIBS_MmioRegs          - target, a plain volatile access (single ldr/str)
+ *   STM32LIBS_SimRegs           - host, the simulated peripherals (STM32LIBS_SIM.h)
+ *   STM32LIBS_CountingRegs<P>   - policy P plus read/write counters
+ *
+ * Override with -D STM32LIBS_REG_POLICY=... . Addresses are template arguments
+ * so no policy adds any runtime dispatch.
+ */
+struct STM32LIBS_MmioRegs {
+  typedef volatile uint32_t &ref;
+
+  template<uint32_t ADDR> static inline ref reg(void)
+  {
+    return *reinterpret_cast<volatile uint32_t *>(ADDR);
+  }
+  static inline ref reg(uint32_t addr)
+  {
+    return *reinterpret_cast<volatile uint32_t *>(addr);
+  }
+};
+
+template<class POLICY> class STM32CountedReg {
+  public:
+    explicit STM32CountedReg(typename POLICY::ref reg, uint32_t *reads, uint32_t *writes):
+      _reg(reg), _reads(reads), _writes(writes) {}
+    operator uint32_t() const { (*_reads)++; return _reg; }
+    STM32CountedReg &operator=(const STM32CountedReg &reg) { return *this = (uint32_t)reg; }
+    STM32CountedReg &operator=(uint64_t val) { (*_writes)++; _reg = (uint32_t)val; return *this; }
+    STM32CountedReg &operator|=(uint64_t val) { return *this = (uint32_t)*this | val; }
+    STM32CountedReg &operator&=(uint64_t val) { return *this = (uint32_t)*this & val; }
+    STM32CountedReg &operator^=(uint64_t val) { return *this = (uint32_t)*this ^ val; }
+
+  private:
+    typename POLICY::ref _reg;
+    uint32_t *_reads;
+    uint32_t *_writes;
+};
+
+template<class POLICY> struct STM32LIBS_CountingRegs {
+  typedef STM32CountedReg<POLICY> ref;
+  static uint32_t reads;
+  static uint32_t writes;
+
+  template<uint32_t ADDR> static inline ref reg(void)
+  {
+    return ref(POLICY::template reg<ADDR>(), &reads, &writes);
+  }
+  static inline ref reg(uint32_t addr)
+  {
+    return ref(POLICY::reg(addr), &reads, &writes);
+  }
+};
+template<class POLICY> uint32_t STM32LIBS_CountingRegs<POLICY>::reads = 0;
+template<class POLICY> uint32_t STM32LIBS_CountingRegs<POLICY>::writes = 0;
+
+#ifdef STM32LIBS_HOST_SIM
+#include "STM32LIBS_SIM.h"
+#endif
+
+#ifndef STM32LIBS_REG_POLICY
+#ifdef STM32LIBS_HOST_SIM
+#define STM32LIBS_REG_POLICY    STM32LIBS_SimRegs
+#else
+#define STM32LIBS_REG_POLICY    STM32LIBS_MmioRegs
+#endif
+#endif
+
+#define STM32_REG(ADDR)       (STM32LIBS_REG_POLICY::reg<(ADDR)>())   // fixed address
+#define STM32_REG_AT(ADDR)    (STM32LIBS_REG_POLICY::reg(ADDR))       // computed address
+
 // STM32 Power control registers
 #define PWR_REG_BASE    0x40007000UL
-#define PWR_CR          (*(volatile uint32_t *)(PWR_REG_BASE))  // power control reg 
-#define PWR_CSR         (*(volatile uint32_t *)(PWR_REG_BASE + 0x00000004UL))  // power control/status reg 
+#define PWR_CR          STM32_REG(PWR_REG_BASE)  // power control reg 
+#define PWR_CSR         STM32_REG(PWR_REG_BASE + 0x00000004UL)  // power control/status reg 
 
 // power control defines
 #define DBP             0x0100         // disable backup domain write protection
@@ -17,10 +92,11 @@
 
 // Reset & clock control registers (32 bit regs)
 #define RCC_REG_BASE    0x40021000UL
-#define RCC_BDCR        (*(volatile uint32_t *)(RCC_REG_BASE + 0x00000020UL))  // RTC ctl reg low
-#define RCC_APB1ENR     (*(volatile uint32_t *)(RCC_REG_BASE + 0x0000001CUL)) 
-#define RCC_APB2ENR     (*(volatile uint32_t *)(RCC_REG_BASE + 0x00000018UL)) 
-#define RCC_CIR         (*(volatile uint32_t *)(RCC_REG_BASE + 0x00000008UL)
+#define RCC_BDCR        STM32_REG(RCC_REG_BASE + 0x00000020UL)  // RTC ctl reg low
+#define RCC_APB1ENR     STM32_REG(RCC_REG_BASE + 0x0000001CUL) 
+#define RCC_APB2ENR     STM32_REG(RCC_REG_BASE + 0x00000018UL) 
+#define RCC_CIR         STM32_REG(RCC_REG_BASE + 0x00000008UL)
+#define RCC_CSR         STM32_REG(RCC_REG_BASE + 0x00000024UL)  // ctl/status reg (LSI)
 
 // 
 #define LSEON           0x00000001UL   // external 32.768 KHz clk enable (LSE)
@@ -31,25 +107,33 @@
 #define RTC_ENAB        0x00008000UL   // sends clk to RTC
 #define BDCR_INIT       0x00008101UL   // RTCEN, LSE clk, LSEON
 #define PWREN           0x18000000UL   // power enab + backup enab
+#define RTCSEL_MASK     0x00000300UL   // RTC clock source select
+#define RTCSEL_LSE      0x00000100UL
+#define RTCSEL_LSI      0x00000200UL
+#define RTCSEL_HSE      0x00000300UL   // HSE / 128
+#define LSION           0x00000001UL   // RCC_CSR internal 40 KHz clk enable (LSI)
+#define LSIRDY          0x00000002UL   // status - internal clk is stable
 
 // RTC register memory mapped addresses
 #define RTC_REG_BASE    0x40002800UL
-#define RTC_CRH         (*(volatile uint32_t *)(RTC_REG_BASE))  // RTC ctl reg high
-#define RTC_CRL         (*(volatile uint32_t *)(RTC_REG_BASE + 0x00000004UL))  // RTC ctl reg low
-#define RTC_PRLH        (*(volatile uint32_t *)(RTC_REG_BASE + 0x00000008UL))  // RTC prescaler reg high
-#define RTC_PRLL        (*(volatile uint32_t *)(RTC_REG_BASE + 0x0000000CUL))  // RTC prescaler reg low
-#define RTC_DIVH        (*(volatile uint32_t *)(RTC_REG_BASE + 0x00000010UL))  // RTC prescaler divide reg high
-#define RTC_DIVL        (*(volatile uint32_t *)(RTC_REG_BASE + 0x00000014UL))  // RTC prescaler divide reg low
-#define RTC_CNTH        (*(volatile uint32_t *)(RTC_REG_BASE + 0x00000018UL))  // RTC count reg high
-#define RTC_CNTL        (*(volatile uint32_t *)(RTC_REG_BASE + 0x0000001CUL))  // RTC count reg low
-#define RTC_ALRH        (*(volatile uint32_t *)(RTC_REG_BASE + 0x00000020UL))  // RTC alarm reg high
-#define RTC_ALRL        (*(volatile uint32_t *)(RTC_REG_BASE + 0x00000024UL))  // RTC alarm reg low
+#define RTC_CRH         STM32_REG(RTC_REG_BASE)  // RTC ctl reg high
+#define RTC_CRL         STM32_REG(RTC_REG_BASE + 0x00000004UL)  // RTC ctl reg low
+#define RTC_PRLH        STM32_REG(RTC_REG_BASE + 0x00000008UL)  // RTC prescaler reg high
+#define RTC_PRLL        STM32_REG(RTC_REG_BASE + 0x0000000CUL)  // RTC prescaler reg low
+#define RTC_DIVH        STM32_REG(RTC_REG_BASE + 0x00000010UL)  // RTC prescaler divide reg high
+#define RTC_DIVL        STM32_REG(RTC_REG_BASE + 0x00000014UL)  // RTC prescaler divide reg low
+#define RTC_CNTH        STM32_REG(RTC_REG_BASE + 0x00000018UL)  // RTC count reg high
+#define RTC_CNTL        STM32_REG(RTC_REG_BASE + 0x0000001CUL)  // RTC count reg low
+#define RTC_ALRH        STM32_REG(RTC_REG_BASE + 0x00000020UL)  // RTC alarm reg high
+#define RTC_ALRL        STM32_REG(RTC_REG_BASE + 0x00000024UL)  // RTC alarm reg low
 
 // RTC CRL control reg bits
 #define RTOFF           0x0020UL
 #define CNF             0x0010UL
 #define RSF             0x0008UL
 #define RTC_CRL_ALARMF  0x0002UL
+#define RTC_CRL_SECF    0x0001UL
+#define RTC_CRL_OWF     0x0004UL
 #define ALARMF_MASK     0x0010UL
 #define RTOFF_RSF       0x0028UL
 
@@ -61,65 +145,75 @@
 // NVIC registers
 #define NVIC_REG_BASE   0xE000E100UL
 #define NVIC_ISER_BASE  NVIC_REG_BASE + 0x00000000UL
-#define NVIC_ISER0      (*(volatile uint32_t *)(NVIC_ISER_BASE + 0x00000000UL)) 
-#define NVIC_ISER1      (*(volatile uint32_t *)(NVIC_ISER_BASE + 0x00000004UL)) 
-#define NVIC_ISER2      (*(volatile uint32_t *)(NVIC_ISER_BASE + 0x00000008UL)) 
+#define NVIC_ISER0      STM32_REG(NVIC_ISER_BASE + 0x00000000UL) 
+#define NVIC_ISER1      STM32_REG(NVIC_ISER_BASE + 0x00000004UL) 
+#define NVIC_ISER2      STM32_REG(NVIC_ISER_BASE + 0x00000008UL) 
 
 #define NVIC_ICER_BASE  NVIC_REG_BASE + 0x00000080UL
-#define NVIC_ICER0      (*(volatile uint32_t *)(NVIC_ICER_BASE + 0x00000000UL)) 
-#define NVIC_ICER1      (*(volatile uint32_t *)(NVIC_ICER_BASE + 0x00000004UL)) 
-#define NVIC_ICER2      (*(volatile uint32_t *)(NVIC_ICER_BASE + 0x00000008UL)) 
+#define NVIC_ICER0      STM32_REG(NVIC_ICER_BASE + 0x00000000UL) 
+#define NVIC_ICER1      STM32_REG(NVIC_ICER_BASE + 0x00000004UL) 
+#define NVIC_ICER2      STM32_REG(NVIC_ICER_BASE + 0x00000008UL) 
 
 #define NVIC_ISPR_BASE  NVIC_REG_BASE + 0x00000100UL
-#define NVIC_ISPR0      (*(volatile uint32_t *)(NVIC_ISPR_BASE + 0x00000000UL)) 
-#define NVIC_ISPR1      (*(volatile uint32_t *)(NVIC_ISPR_BASE + 0x00000004UL)) 
-#define NVIC_ISPR2      (*(volatile uint32_t *)(NVIC_ISPR_BASE + 0x00000008UL)) 
+#define NVIC_ISPR0      STM32_REG(NVIC_ISPR_BASE + 0x00000000UL) 
+#define NVIC_ISPR1      STM32_REG(NVIC_ISPR_BASE + 0x00000004UL) 
+#define NVIC_ISPR2      STM32_REG(NVIC_ISPR_BASE + 0x00000008UL) 
 
 #define NVIC_ICPR_BASE  NVIC_REG_BASE + 0x00000180UL
-#define NVIC_ICPR0      (*(volatile uint32_t *)(NVIC_ICPR_BASE + 0x00000000UL)) 
-#define NVIC_ICPR1      (*(volatile uint32_t *)(NVIC_ICPR_BASE + 0x00000004UL)) 
-#define NVIC_ICPR2      (*(volatile uint32_t *)(NVIC_ICPR_BASE + 0x00000008UL)) 
+#define NVIC_ICPR0      STM32_REG(NVIC_ICPR_BASE + 0x00000000UL) 
+#define NVIC_ICPR1      STM32_REG(NVIC_ICPR_BASE + 0x00000004UL) 
+#define NVIC_ICPR2      STM32_REG(NVIC_ICPR_BASE + 0x00000008UL) 
 
 #define NVIC_IABR_BASE  NVIC_REG_BASE + 0x00000200UL
-#define NVIC_IABR0      (*(volatile uint32_t *)(NVIC_IABR_BASE + 0x00000000UL)) 
-#define NVIC_IABR1      (*(volatile uint32_t *)(NVIC_IABR_BASE + 0x00000004UL)) 
-#define NVIC_IABR2      (*(volatile uint32_t *)(NVIC_IABR_BASE + 0x00000008UL)) 
+#define NVIC_IABR0      STM32_REG(NVIC_IABR_BASE + 0x00000000UL) 
+#define NVIC_IABR1      STM32_REG(NVIC_IABR_BASE + 0x00000004UL) 
+#define NVIC_IABR2      STM32_REG(NVIC_IABR_BASE + 0x00000008UL) 
 
 #define NVIC_IPR_BASE  NVIC_REG_BASE + 0x00000300UL
-#define NVIC_IPR0      (*(volatile uint32_t *)(NVIC_IPR_BASE + 0x00000000UL)) 
-#define NVIC_IPR20     (*(volatile uint32_t *)(NVIC_IPR_BASE + 0x00000020UL)) 
+#define NVIC_IPR0      STM32_REG(NVIC_IPR_BASE + 0x00000000UL) 
+#define NVIC_IPR20     STM32_REG(NVIC_IPR_BASE + 0x00000020UL) 
 
 #define NVIC_STIR_BASE  NVIC_REG_BASE + 0x00000E00UL
-#define NVIC_STIR      (*(volatile uint32_t *)(NVIC_STIR_BASE + 0x00000000UL)) 
+#define NVIC_STIR      STM32_REG(NVIC_STIR_BASE + 0x00000000UL) 
 
 // EXTI registers
 #define EXTI_REG_BASE   0x40010400UL
-#define EXTI_IMR        (*(volatile uint32_t *)(EXTI_REG_BASE))  // EXTI interrupt ctl reg
-#define EXTI_EMR        (*(volatile uint32_t *)(EXTI_REG_BASE + 0x00000004UL))  // EXTI event ctl reg
-#define EXTI_RTSR       (*(volatile uint32_t *)(EXTI_REG_BASE + 0x00000008UL))  // EXTI rising edge sel reg
-#define EXTI_FTSR       (*(volatile uint32_t *)(EXTI_REG_BASE + 0x0000000CUL))  // EXTI falling edge sel reg
-#define EXTI_PR         (*(volatile uint32_t *)(EXTI_REG_BASE + 0x00000014UL))  // EXTI pending reg
-#define EXTI_SWIER      (*(volatile uint32_t *)(EXTI_REG_BASE + 0x00000010UL))  // EXTI SW int reg
+#define EXTI_IMR        STM32_REG(EXTI_REG_BASE)  // EXTI interrupt ctl reg
+#define EXTI_EMR        STM32_REG(EXTI_REG_BASE + 0x00000004UL)  // EXTI event ctl reg
+#define EXTI_RTSR       STM32_REG(EXTI_REG_BASE + 0x00000008UL)  // EXTI rising edge sel reg
+#define EXTI_FTSR       STM32_REG(EXTI_REG_BASE + 0x0000000CUL)  // EXTI falling edge sel reg
+#define EXTI_PR         STM32_REG(EXTI_REG_BASE + 0x00000014UL)  // EXTI pending reg
+#define EXTI_SWIER      STM32_REG(EXTI_REG_BASE + 0x00000010UL)  // EXTI SW int reg
 
 // EXTI control 
 #define EXTI_LINE17     0x00020000UL
 
 // interrupt vector table offsets
 #define IVEC_BASE       0x00000000UL
-#define IVEC_RTC_ALARM  (*(volatile uint32_t *)(IVEC_BASE + 0x000000E4UL))       // int vector for rtc alarm
+#define IVEC_RTC_ALARM  STM32_REG(IVEC_BASE + 0x000000E4UL)       // int vector for rtc alarm
 
 // backup registers
 #define BKP_REG_BASE    0x40006C00UL
-#define BKP_REGS        (*(volatile uint32_t *)(BKP_REG_BASE + 0x00000004))
-#define BKP_REGS1       (*(volatile uint32_t *)(BKP_REG_BASE + 0x00000014))
-#define BKP_REGS2       (*(volatile uint32_t *)(BKP_REG_BASE + 0x00000018))
-#define BKP_REGS3       (*(volatile uint32_t *)(BKP_REG_BASE + 0x0000001C))
-#define BKP_REGS4       (*(volatile uint32_t *)(BKP_REG_BASE + 0x00000020))
-#define BKP_CR          (*(volatile uint32_t *)(BKP_REG_BASE + 0x00000030))
-#define BKP_CSR         (*(volatile uint32_t *)(BKP_REG_BASE + 0x00000034))
+#define BKP_REGS        STM32_REG(BKP_REG_BASE + 0x00000004)
+#define BKP_REGS1       STM32_REG(BKP_REG_BASE + 0x00000014)
+#define BKP_REGS2       STM32_REG(BKP_REG_BASE + 0x00000018)
+#define BKP_REGS3       STM32_REG(BKP_REG_BASE + 0x0000001C)
+#define BKP_REGS4       STM32_REG(BKP_REG_BASE + 0x00000020)
+#define BKP_CR          STM32_REG(BKP_REG_BASE + 0x00000030)
+#define BKP_CSR         STM32_REG(BKP_REG_BASE + 0x00000034)
+#define BKP_DR_MAX      42             // DR1 - DR10 on all parts, DR11 - DR42 on high density & XL
+// INDX 0 == DR1. DR1 - DR10 at 0x04 - 0x28, DR11 - DR42 at 0x40 - 0xBC (after RTCCR, CR, CSR)
+#define BKP_DR_OFFSET(INDX)   (((INDX) < 10) ? 0x00000004UL + ((INDX) * 4) : 0x00000040UL + (((INDX) - 10) * 4))
+#define BKP_DR(INDX)    STM32_REG_AT(BKP_REG_BASE + BKP_DR_OFFSET(INDX))
 
 typedef struct {
-   uint32_t bkup_regs[50];
+   uint32_t reserved0;
+   uint32_t dr1_10[10];       // 0x04
+   uint32_t rtccr;            // 0x2C
+   uint32_t cr;               // 0x30
+   uint32_t csr;              // 0x34
+   uint32_t reserved1[2];
+   uint32_t dr11_42[32];      // 0x40
 }BACKUP_REGS;
 typedef BACKUP_REGS *pBkpRegs;
 
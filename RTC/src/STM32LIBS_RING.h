@@ -0,0 +1,68 @@
+// STM32LIBS_RING.h
+// fixed size single producer / single consumer lock-free ring buffer
+//
+// One side (an interrupt handler) only calls push(), the other (loop())
+// only calls pop() / size(). The indexes are free running 32 bit counters;
+// each one is written by one side only, so no interrupt masking or
+// read-modify-write instructions are needed, just acquire / release
+// ordering (a DMB on Cortex-M3). A full ring drops the new item and counts
+// an overrun, items already queued are never overwritten.
+
+#ifndef _STM32LIBS_RING_H
+#define _STM32LIBS_RING_H
+
+#include <stdint.h>
+#include <atomic>
+
+template<typename T, uint16_t SIZE>
+class STM32LIBS_RING {
+  static_assert(SIZE >= 2 && (SIZE & (SIZE - 1)) == 0, "STM32LIBS_RING size must be a power of 2");
+
+  public:
+    STM32LIBS_RING(void): _head(0), _tail(0), _overruns(0) {}
+
+    // producer side
+    bool push(const T &item)
+    {
+      uint32_t head = _head.load(std::memory_order_relaxed);
+
+      if(head - _tail.load(std::memory_order_acquire) == SIZE)
+      {
+        _overruns.store(_overruns.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return false;
+      }
+      _buf[head & (SIZE - 1)] = item;
+      _head.store(head + 1, std::memory_order_release);
+      return true;
+    }
+
+    // consumer side, copies up to max items, returns the number copied
+    uint16_t pop(T *items, uint16_t max)
+    {
+      uint32_t tail = _tail.load(std::memory_order_relaxed);
+      uint32_t n = _head.load(std::memory_order_acquire) - tail;
+      uint16_t i;
+
+      if(n > max)
+        n = max;
+      for(i = 0; i < n; i++)
+        items[i] = _buf[(tail + i) & (SIZE - 1)];
+      _tail.store(tail + n, std::memory_order_release);
+      return n;
+    }
+
+    uint16_t size(void)
+    {
+      return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_relaxed);
+    }
+    uint16_t capacity(void) { return SIZE; }
+    uint32_t overruns(void) { return _overruns.load(std::memory_order_relaxed); }
+
+  private:
+    T _buf[SIZE];
+    std::atomic<uint32_t> _head;          // written by the producer only
+    std::atomic<uint32_t> _tail;          // written by the consumer only
+    std::atomic<uint32_t> _overruns;      // written by the producer only
+};
+
+#endif               // end _STM32LIBS_RING_H
@@ -50,7 +50,8 @@ const char *monthNames[12] = {"January", "February", "March", "April", "May", "J
 \*******************************************************************/
 void STM32LIBS_RTC::begin(uint8_t initAction)
 {
-  bool resetRTC = false;
+  bool resetRTC;
+  uint32_t start = micros();
   /*
    ** Do basic RTC initialization. This may be redundant on a reset or power on.
    ** Determine the state of the RTC. Possible states are:
@@ -60,17 +61,34 @@ void STM32LIBS_RTC::begin(uint8_t initAction)
   */
   RCC_APB1ENR |= PWREN;                     // power & backup interface clocks enabled
   PWR_CR |= DBP;                            // allow access to RTC domain
+  perfInit();
   
-  getBackup(0, 10);                         // get all backup registers 
+  flushBackup();                            // nothing pending is lost on a second begin()
+  _bkpValid = 0;                            // re-read each register on first use
+  getBackup(0);                             // status flags
+  _bkpCount = (_RTC_BackupRegs[0] & BACKUP_REGS_MASK) >> BACKUP_REGS_SHIFT;
+  if(!isConfigured() || _bkpCount < 10 || _bkpCount > BKP_DR_MAX)
+    _bkpCount = _probeBackup();             // first start, remembered in the status register
+  _dtCacheValid = 0;
+  resetRTC = (initAction == INIT_RTC_RESET);     // the big bang!
+  _beginWarm = (RTC_WARM_START && !resetRTC && _warmStartable());
+  if(_beginWarm)
+    _warmStart();                           // before any RTC register access
+  else
+    _coldStart(resetRTC);
+  _bindInterrupts();                        // RTC_init() may not have run
+  if(resetRTC)
+  {
+    _bkpValid = 0;                          // the domain reset cleared the registers
+    _bkpDirty = 0;
+    getBackup(0);
+  }
+
   if (initAction == INIT_TIME_RESET) 
   {
     RTC_CRH &= ~(RTC_ALRIE | RTC_SECIE);    // clear alarm & seconds interrupt
-    rtc_config(CONFIG_ENTER);
-    RTC_CNTH = 0x0UL;
-    RTC_CNTL = 0x0UL;
-    RTC_ALRH = 0x0UL;
-    RTC_ALRL = 0x0UL;
-    rtc_config(CONFIG_ENTER);
+    _queueWrite(WRITE_ALR, 0, false);       // counter & alarm in one configuration write
+    _waitWrite(_queueWrite(WRITE_CNT, 0, false));
     _statusFlagChange((BACKUP_TIME_SET_FLAG | BACKUP_ALARM_SET_FLAG), false);    // clear internal time & alarm flags
     disableAlarm();
   }
@@ -78,21 +96,114 @@ void STM32LIBS_RTC::begin(uint8_t initAction)
   {
     disableAlarm();
   }
-  else if(initAction == INIT_RTC_RESET)     // the big bang!
-  {
-    resetRTC = true;
-  }
 
   /*
-   ** Force LSE clock which is the external 32.768 KHz osc. It keeps running when Vbat is powered
-   ** by an external battery.
-  */
+   ** set configuration flag & the backup register count in backup regs
+  */             
+  setBackup(0, (getBackup(0) & ~BACKUP_REGS_MASK) | ((uint16_t)_bkpCount << BACKUP_REGS_SHIFT) |
+               BACKUP_CONFIGURED_FLAG);    // set internal configured flag
+  _beginUs = micros() - start;
+}
+
+
+/********************************************************************
+ **   @brief Checks if begin() can skip the clock & HAL init: the RTC runs
+ **     from a stable LSE (kept by Vbat through the reset) and the backup
+ **     status word says the library configured it.
+\*******************************************************************/
+bool STM32LIBS_RTC::_warmStartable(void)
+{
+  const uint32_t running = RTC_ENAB | RTCSEL_LSE | LSEON | LSERDY;
+
+  return (RCC_BDCR & (RTC_ENAB | RTCSEL_MASK | LSEON | LSERDY)) == running &&
+         isConfigured() && _bkpCount >= 10 && _bkpCount <= BKP_DR_MAX;
+}
+
+
+/********************************************************************
+ **   @brief Restores what setClockSource() & RTC_init() would have set up
+ **     without touching the running RTC: no LSE restart, no prescaler
+ **     write (which would undo a calibrated PRL), no RSF wait.
+ **   @note After a reset the RTC registers read stale values until RSF is
+ **     set again (within 2 RTCCLK). The first counter read waits for it
+ **     instead of begin().
+\*******************************************************************/
+void STM32LIBS_RTC::_warmStart(void)
+{
+  _clockSource = LSE_CLOCK;
+  _clockState = CLOCK_READY;
+  _clockStatus = RTC_OK;
+  _lseWait = false;
+  _heldFlags = 0;
+  _cachePrescaler();
+  RTC_CRL &= ~RSF;
+  _rsfWait = true;
+}
+
+
+/********************************************************************
+ **   @brief Binds the core's HAL handle and enables the alarm interrupt,
+ **     the part of RTC_init() the rest of the library depends on: the
+ **     core's RTC interrupt handlers and HAL_RTCEx_SetSecond_IT() go
+ **     through the handle. begin() calls it on every path, RTC_init() is
+ **     skipped on a warm start and while the LSE starts.
+\*******************************************************************/
+void STM32LIBS_RTC::_bindInterrupts(void)
+{
+#if RTC_INIT_OPTIONAL && !RTC_NATIVE_INIT
+  RTC_HandleTypeDef *hrtc = RTC_GetHandle();
+
+  hrtc->Instance = RTC;
+  hrtc->Init.AsynchPrediv = _prl;
+  hrtc->Init.OutPut = RTC_OUTPUTSOURCE_NONE;
+  hrtc->Lock = HAL_UNLOCKED;
+  hrtc->State = HAL_RTC_STATE_READY;
+#endif
+  HAL_NVIC_SetPriority(RTC_Alarm_IRQn, RTC_IRQ_PRIO, RTC_IRQ_SUBPRIO);
+  HAL_NVIC_EnableIRQ(RTC_Alarm_IRQn);
+}
+
+
+/********************************************************************
+ **   @brief Starts the RTC clock. Forces the LSE, the external 32.768 KHz
+ **     osc, which keeps running when Vbat is powered by an external battery.
+ **   @note The crystal can take a second or more to start. With
+ **     RTC_LSE_ASYNC the RTC is left without a clock meanwhile and
+ **     serviceClock() finishes the job. LSI can't bridge the gap: RTCSEL
+ **     only changes again after a backup domain reset, which stops the LSE.
+ **     An RTC an earlier begin() left on LSI stays there, begin(INIT_RTC_RESET)
+ **     tries the LSE again.
+\*******************************************************************/
+void STM32LIBS_RTC::_coldStart(bool resetRTC)
+{
   _clockSource = LSE_CLOCK;
   setClockSource(_clockSource);
-    
-  /*
-   ** init the RTC
-  */
+  _clockState = CLOCK_READY;
+  _lseWait = false;
+  _heldFlags = 0;
+
+  if(RTC_LSE_ASYNC && (resetRTC || (RCC_BDCR & RTC_ENAB) == 0))
+  {
+    if(resetRTC)
+    {
+      RCC_BDCR |= BKP_RESET;
+      RCC_BDCR &= ~BKP_RESET;
+    }
+    RCC_BDCR |= LSEON;
+    _lseStart = millis();
+    _softEpoch = 0;                         // CNT after a domain reset
+    _softMs = _lseStart;
+    _prlUser = false;
+    _cachePrescaler();
+    _clockState = CLOCK_LSE_WAIT;
+    _clockStatus = RTC_BUSY;
+    _lseWait = true;
+    serviceClock();                         // LSERDY may be set already
+    return;
+  }
+
+  if(!resetRTC && (RCC_BDCR & (RTC_ENAB | RTCSEL_MASK)) == (RTC_ENAB | RTCSEL_LSI))
+    _clockSource = LSI_CLOCK;
   RTC_init(HOUR_FORMAT_24,
            (_clockSource == LSE_CLOCK) ? ::LSE_CLOCK :
            (_clockSource == HSE_CLOCK) ? ::HSE_CLOCK : ::LSI_CLOCK
@@ -100,11 +211,148 @@ void STM32LIBS_RTC::begin(uint8_t initAction)
              , resetRTC
 #endif
           );
-  /*
-   ** set configuration flag in backup regs
-  */             
-  _statusFlagChange(BACKUP_CONFIGURED_FLAG, true);    // set internal configured flag
+  _rsfWait = false;                         // RTC_init() waited for RSF
+  _cachePrescaler();
+  _clockStatus = (_clockSource == LSE_CLOCK && (RCC_BDCR & LSERDY)) ? RTC_OK : RTC_FAIL_LSERDY;
+  if(_clockSource == LSI_CLOCK)
+    _startCal();                            // RTC_init() loaded the nominal prescaler
+}
+
+
+/********************************************************************
+ **   @brief Finishes a cold start begin() left running, poll it from loop().
+ **     Once LSERDY is set the RTC is enabled on the LSE and loaded with the
+ **     time kept meanwhile (held alarm & prescaler writes too). If the LSE
+ **     is not ready after RTC_LSE_TIMEOUT ms the RTC falls back to LSI and
+ **     its prescaler is calibrated against micros() for RTC_LSI_CAL_MS.
+ **   @returns RTC_BUSY while starting or calibrating, RTC_OK on LSE,
+ **     RTC_FAIL_LSERDY on LSI.
+ **   @note The time carried over is rounded to the second. LSI (30 - 60 KHz)
+ **     runs at its nominal 40 KHz until the calibration ends.
+ **     The only place the clock is switched: the switch waits for RTOFF
+ **     twice, so it is left to this thread context call, the counter reads
+ **     keep counting from millis() until then. LSIRDY is polled too.
+\*******************************************************************/
+uint8_t STM32LIBS_RTC::serviceClock(void)
+{
+  if(_clockState == CLOCK_LSE_WAIT)
+  {
+    if(RCC_BDCR & LSERDY)
+    {
+      _enableClock(RTCSEL_LSE, _prl);
+      _clockState = CLOCK_READY;
+      _clockStatus = RTC_OK;
+    }
+    else if(millis() - _lseStart >= RTC_LSE_TIMEOUT)
+    {
+      RCC_BDCR &= ~LSEON;                   // no crystal, or it does not start
+      RCC_CSR |= LSION;
+      _lseStart = millis();
+      _clockState = CLOCK_LSI_WAIT;
+    }
+  }
+  else if(_clockState == CLOCK_LSI_WAIT)
+  {
+    if((RCC_CSR & LSIRDY) || millis() - _lseStart >= REG_TIMEOUT)
+    {
+      _clockSource = LSI_CLOCK;
+      _prlUser = false;
+      _enableClock(RTCSEL_LSI, LSI_VALUE - 1);
+      _clockStatus = RTC_FAIL_LSERDY;
+      _startCal();
+    }
+  }
+  else if(_clockState == CLOCK_LSI_CAL && micros() - _calUs >= RTC_LSI_CAL_MS * 1000UL)
+    _finishCal();
+  return _clockStatus;
+}
+
+
+/********************************************************************
+ **   @brief Selects the RTC clock and loads the counter kept by millis(),
+ **     the prescaler and a held alarm in one configuration window. The
+ **     backup status flags of the held writes are set once CNT is loaded.
+ **   @param rtcsel - RTCSEL_LSE or RTCSEL_LSI.
+ **   @note An alarm that passed while the LSE started is set to the next
+ **     second: it is delivered by the alarm interrupt, not from here.
+\*******************************************************************/
+void STM32LIBS_RTC::_enableClock(uint32_t rtcsel, uint32_t prl)
+{
+  uint32_t e, cnt, alr, start = millis();
+  uint16_t flags;
+  bool alarm;
+  RTC_PERF_START(t);
+
+  RCC_BDCR |= rtcsel | RTC_ENAB;            // RTCSEL can't change until the next domain reset
+  while((RTC_CRL & RTOFF) == 0 && (millis() - start) < REG_TIMEOUT);
+  RTC_PERF_STOP(RTC_PERF_CONFIG_ENTER, t);
+  RTC_PERF_COUNT_IF(RTC_PERF_RTOFF_TIMEOUT, (RTC_CRL & RTOFF) == 0);
+  __disable_irq();
+  e = millis() - _softMs;
+  _lseWait = false;
+  RTC_CRL |= CNF;
+  RTC_PRLH = (prl >> 16) & 0x000F;
+  RTC_PRLL = prl & 0xFFFF;
+  cnt = _softEpoch + (e + 500) / 1000;
+  RTC_CNTH = cnt >> 16;
+  RTC_CNTL = cnt & 0xFFFF;
+  alarm = (RTC_CRH & RTC_ALRIE) != 0;
+  if(alarm)
+  {
+    alr = (_alarmShadow <= cnt) ? cnt + 1 : _alarmShadow;   // passed, CNT won't match it
+    RTC_ALRH = alr >> 16;
+    RTC_ALRL = alr & 0xFFFF;
+  }
+  RTC_CRL &= ~CNF;
+  flags = _heldFlags & (alarm ? 0xFFFF : ~BACKUP_ALARM_SET_FLAG);
+  _heldFlags = 0;
+  __enable_irq();
+  RTC_PERF_MARK(t);
+  while((RTC_CRL & RTOFF) == 0 && (millis() - start) < REG_TIMEOUT);
+  RTC_PERF_STOP(RTC_PERF_CONFIG_EXIT, t);
+  RTC_PERF_COUNT_IF(RTC_PERF_RTOFF_TIMEOUT, (RTC_CRL & RTOFF) == 0);
+
+  _prl = prl;
+  _dtCacheValid = 0;
+  RTC_CRL &= ~RSF;
+  _rsfWait = true;
+  if(flags != 0 && (RTC_CRL & RTOFF))       // the time is in CNT now, not just in millis()
+    _statusFlagChange(flags, true);
+}
+
+
+/********************************************************************
+ **   @brief Starts measuring LSI ticks against micros().
+\*******************************************************************/
+void STM32LIBS_RTC::_startCal(void)
+{
+  _readCounter(&_calCnt, &_calDiv);
+  _calUs = micros();
+  _calWrites = _wrIssued;
+  _clockState = CLOCK_LSI_CAL;
+}
+
+
+/********************************************************************
+ **   @brief LSI frequency from the ticks counted since _startCal(), loaded
+ **     as the prescaler. A counter or prescaler write meanwhile restarts
+ **     the measurement.
+\*******************************************************************/
+void STM32LIBS_RTC::_finishCal(void)
+{
+  uint32_t cnt, div, us;
+  uint64_t ticks;
 
+  if(_wrIssued != _calWrites || (_wrQueued | _wrActive) != 0)
+  {
+    _startCal();
+    return;
+  }
+  _readCounter(&cnt, &div);
+  us = micros() - _calUs;
+  ticks = (uint64_t)(cnt - _calCnt) * (_prl + 1) + _calDiv - div;
+  _clockState = CLOCK_READY;
+  setPrescalerAsync((uint32_t)((ticks * 1000000ULL + us / 2) / us) - 1);
 }
 
 
@@ -121,6 +369,7 @@ void STM32LIBS_RTC::end(void)
     RTC_CRH = 0x0;
     _statusFlagChange((BACKUP_CONFIGURED_FLAG | BACKUP_TIME_SET_FLAG | BACKUP_ALARM_SET_FLAG), false); // clear all rtc flags 
   }
+  flushBackup();
 }
 
 
@@ -174,23 +423,64 @@ void STM32LIBS_RTC::getPrediv(int8_t *predivA, int16_t *predivS)
 void STM32LIBS_RTC::setPrediv(int8_t predivA, int16_t predivS)
 {
   RTC_setPrediv(predivA, predivS);
+  _prlUser = (predivS >= 0);
+  if(_prlUser)
+    _prl = predivS;
+}
+
+
+/********************************************************************
+  * @brief  queue a prescaler reload write, see serviceWrites(). The
+  *   counter steps every prl + 1 RTCCLK cycles, the divider restarts from
+  *   prl when the write lands.
+  * @param  prl: 0 - 0xFFFFF.
+  * @retval write handle for writeStatus(), 0 if prl is out of range.
+\*******************************************************************/
+uint32_t STM32LIBS_RTC::setPrescalerAsync(uint32_t prl)
+{
+  if(prl > 0xFFFFF)
+    return 0;
+  return _queueWrite(WRITE_PRL, prl, false);
+}
+
+
+/********************************************************************
+  * @brief  remember the prescaler reload value. PRL can't be read back,
+  *   RTC_init() loads the clock frequency - 1 (1 Hz counter) unless
+  *   setPrediv() gave one.
+\*******************************************************************/
+void STM32LIBS_RTC::_cachePrescaler(void)
+{
+  if(_prlUser)
+    return;
+  switch(RCC_BDCR & RTCSEL_MASK)
+  {
+    case RTCSEL_LSI:
+      _prl = LSI_VALUE - 1;
+      break;
+    case RTCSEL_HSE:
+      _prl = HSE_VALUE / 128 - 1;
+      break;
+    default:
+      _prl = LSE_VALUE - 1;
+      break;
+  }
 }
 
 
 /********************************************************************
   * @brief  Set & enable alarm using date & time values
   * @param  pointer to RTC_datetime_t structure containing the alarm
-  * @retval None
+  * @retval RTC_OK or RTC_INVALID_PARAM if the alarm is invalid or not in the future
 \*******************************************************************/
 uint8_t STM32LIBS_RTC::setAlarmDateTime(RTC_datetime_t *alarm_datetime)
 {
   uint8_t retn;
-  uint32_t alarm_epoch = dateTimeToEpoch(alarm_datetime);
+  uint32_t alarm_epoch;
 
-  if(alarm_datetime->hour_format == RTC_HOUR_FORMAT_12 && alarm_datetime->am_pm == RTC_HOUR_PM)
-  {
-    alarm_epoch += (SECS_PER_DAY / 2);
-  }
+  retn = dateTimeToEpoch(alarm_datetime, &alarm_epoch);
+  if(retn != RTC_OK)
+    return retn;
 
   if(alarm_epoch <= getEpoch())    // alarm must be in the future
     retn = RTC_INVALID_PARAM;
@@ -204,38 +494,33 @@ uint8_t STM32LIBS_RTC::setAlarmDateTime(RTC_datetime_t *alarm_datetime)
 /********************************************************************
   * @brief  Set & enable alarm using an epoch number
   * @param  epoch - 32 bit number of seconds since 1970
-  * @retval None
+  * @retval RTC_OK, RTC_INVALID_PARAM if not in the future or the
+  *   configuration write error.
+  * @note   Waits for the write to land (3 RTCCLK) with interrupts enabled.
 \*******************************************************************/
 uint8_t STM32LIBS_RTC::setAlarmFromEpoch(uint32_t alarm_epoch)
 {
-  uint8_t retn = RTC_OK;
-  if(alarm_epoch <= getEpoch())   // alarm must be > current time
-    return RTC_INVALID_PARAM;
-
-  __disable_irq();
-
-  // disable RTC alarm interrupt 
-  RTC_CRH &= ~RTC_ALRIE;
-
-  // write the alarm registers
-  retn = rtc_config(CONFIG_ENTER);
-  RTC_ALRH = alarm_epoch >> 16;
-  RTC_ALRL = alarm_epoch & 0xFFFF;
-  retn = rtc_config(CONFIG_EXIT);
+  return _waitWrite(setAlarmAsync(alarm_epoch));
+}
 
-  // clear RTC alarm pending flag in CRL reg
-  RTC_CRL &= ~RTC_CRL_ALARMF;
-  // enable RTC alarm interrupt flag in CRH reg
-  RTC_CRH |= RTC_ALRIE;
-  // enable alarm interrupt in EXTI IMR reg
-  EXTI_IMR |= EXTI_LINE17;
-  // set EXTI rising edge alarm trigger 
-  EXTI_RTSR |= EXTI_LINE17; 
 
-  __enable_irq();
+/********************************************************************
+  * @brief  Queue an alarm write, see serviceWrites(). The alarm
+  *   interrupt is enabled when the write completes.
+  * @param  alarm_epoch - 32 bit number of seconds since 1970
+  * @retval write handle for writeStatus(), 0 if the alarm is not in
+  *   the future.
+\*******************************************************************/
+uint32_t STM32LIBS_RTC::setAlarmAsync(uint32_t alarm_epoch)
+{
+  uint32_t handle;
+  RTC_PERF_START(t);
 
-  _statusFlagChange(BACKUP_ALARM_SET_FLAG, true);
-  return retn;
+  if(alarm_epoch <= getEpoch())   // alarm must be > current time
+    return 0;
+  handle = _queueWrite(WRITE_ALR, alarm_epoch, true);
+  RTC_PERF_STOP(RTC_PERF_ALARM_ARM, t);
+  return handle;
 }
 
 
@@ -245,6 +530,15 @@ uint8_t STM32LIBS_RTC::setAlarmFromEpoch(uint32_t alarm_epoch)
 \*******************************************************************/
 void STM32LIBS_RTC::disableAlarm(void)
 {
+  if(_cronActive)
+  {
+    _cronActive = false;
+    _bindAlarm();
+  }
+  __disable_irq();
+  _wrArm = false;                             // a queued alarm write stays disabled
+  _wrArmActive = false;
+  __enable_irq();
   if (isConfigured()) 
   {
     RTC_CRL &= ~RTC_CRL_ALARMF;               // clear alarm flag
@@ -254,6 +548,92 @@ void STM32LIBS_RTC::disableAlarm(void)
 }
 
 
+/********************************************************************
+  * @brief  set a recurring alarm. The alarm is armed for the next
+  *   occurrence of cron and re-armed after each alarm interrupt, before
+  *   the attachInterrupt() callback is called.
+  * @param  cron: spec built with cronCompile() or cronFromMatch(), copied.
+  * @retval RTC_OK, RTC_INVALID_PARAM if cron never matches, or the
+  *   configuration write error.
+  * @note   Waits for the first write to land. The interrupt only queues
+  *   the re-arm, serviceWrites() from loop() finishes it.
+\*******************************************************************/
+uint8_t STM32LIBS_RTC::setCronAlarm(const RTC_cron_t *cron)
+{
+  uint8_t retn;
+  uint32_t handle;
+
+  if(cron == nullptr)
+    return RTC_INVALID_PARAM;
+  _cron = *cron;
+  _cronActive = true;
+  _bindAlarm();
+  if((retn = _armCron(&handle)) == RTC_OK)
+    retn = _waitWrite(handle);
+  if(retn != RTC_OK)
+    disableAlarm();
+  return retn;
+}
+
+
+/********************************************************************
+  * @brief  queue the RTC alarm for the next cron occurrence, no wait:
+  *   called from the alarm interrupt.
+  * @param  handle: the write handle, see writeStatus().
+  * @retval RTC_OK or RTC_INVALID_PARAM if cron never matches.
+\*******************************************************************/
+uint8_t STM32LIBS_RTC::_armCron(uint32_t *handle)
+{
+  uint32_t next;
+
+  // retry if the second turns over between the search & the queueing
+  do {
+    next = cronNextOccurrence(&_cron, getEpoch());
+    if(next == 0)
+      return RTC_INVALID_PARAM;
+  } while((*handle = setAlarmAsync(next)) == 0);
+  return RTC_OK;
+}
+
+
+/********************************************************************
+  * @brief  alarm interrupt when the library needs to see it first:
+  *   advance queued configuration writes, post the alarm event, re-arm
+  *   a cron alarm, then the user callback.
+\*******************************************************************/
+void STM32LIBS_RTC::_alarmISR(void *data)
+{
+  STM32LIBS_RTC *rtc = (STM32LIBS_RTC *)data;
+  uint32_t handle;
+  RTC_PERF_START(t);
+
+  rtc->serviceWrites();
+  if(rtc->_eventMask & RTC_EVENT_MASK(RTC_EVENT_ALARM))
+    rtc->_postEvent(RTC_EVENT_ALARM);
+  if(rtc->_cronActive && rtc->_armCron(&handle) != RTC_OK)
+    rtc->disableAlarm();                    // no more occurrences
+  if(rtc->_alarmCallback != nullptr)
+    rtc->_alarmCallback(rtc->_alarmData);
+  RTC_PERF_STOP(RTC_PERF_ALARM_ISR, t);
+}
+
+
+/********************************************************************
+  * @brief  hook the user callback straight to the core alarm interrupt,
+  *   or _alarmISR if a cron alarm or alarm events are enabled, or the
+  *   performance counters time the interrupt.
+\*******************************************************************/
+void STM32LIBS_RTC::_bindAlarm(void)
+{
+  if(_alarmViaISR())
+    attachAlarmCallback(_alarmISR, this);
+  else if(_alarmCallback != nullptr)
+    attachAlarmCallback(_alarmCallback, _alarmData);
+  else
+    detachAlarmCallback();
+}
+
+
 /********************************************************************
   * @brief  attach a callback to the RTC alarm interrupt.
   * @param  callback: pointer to the callback function
@@ -262,7 +642,9 @@ void STM32LIBS_RTC::disableAlarm(void)
 \*******************************************************************/
 void STM32LIBS_RTC::attachInterrupt(voidFuncPtr callback, void *data)
 {
-  attachAlarmCallback(callback, data);
+  _alarmCallback = callback;
+  _alarmData = data;
+  _bindAlarm();
 }
 
 
@@ -273,9 +655,86 @@ void STM32LIBS_RTC::attachInterrupt(voidFuncPtr callback, void *data)
 \*******************************************************************/
 void STM32LIBS_RTC::detachInterrupt(void)
 {
-  detachAlarmCallback();
+  _alarmCallback = nullptr;
+  _alarmData = nullptr;
+  _bindAlarm();
+}
+
+
+/********************************************************************
+  * @brief  select the RTC events posted to the event queue. Events are
+  *   read in loop() with readEvents(), nothing is lost between two reads
+  *   unless the queue (RTC_EVENT_QUEUE_SIZE) fills up.
+  * @param  mask: RTC_EVENT_MASK(RTC_EVENT_ALARM) | RTC_EVENT_MASK(RTC_EVENT_SECOND)
+  *   | RTC_EVENT_MASK(RTC_EVENT_OVERFLOW), 0 to stop.
+  * @note   Overflow is flagged in the seconds interrupt, so it keeps the
+  *   seconds interrupt running even without second events.
+\*******************************************************************/
+void STM32LIBS_RTC::enableEvents(uint8_t mask)
+{
+  _eventMask = mask;
+  _bindAlarm();
+  if(mask & (RTC_EVENT_MASK(RTC_EVENT_SECOND) | RTC_EVENT_MASK(RTC_EVENT_OVERFLOW)))
+    attachSecondsIrqCallback(_secondsISR);
+  else
+    detachSecondsIrqCallback();
+}
+
+
+/********************************************************************
+  * @brief  move queued events to events[], oldest first.
+  * @param  max: size of events[].
+  * @retval number of events copied.
+\*******************************************************************/
+uint16_t STM32LIBS_RTC::readEvents(RTC_event_t *events, uint16_t max)
+{
+  if(events == nullptr)
+    return 0;
+  return _events.pop(events, max);
+}
+
+
+void STM32LIBS_RTC::_secondsISR(void *data)
+{
+  (void)data;
+  STM32LIBS_RTC &rtc = getInstance();
+  RTC_PERF_START(t);
+
+  rtc.serviceWrites();
+  if(rtc._eventMask & RTC_EVENT_MASK(RTC_EVENT_SECOND))
+    rtc._postEvent(RTC_EVENT_SECOND);
+  RTC_PERF_STOP(RTC_PERF_SECONDS_ISR, t);
+}
+
+
+/********************************************************************
+  * @brief  queue an event with the counter & divider. Interrupt context.
+\*******************************************************************/
+void STM32LIBS_RTC::_postEvent(uint8_t type)
+{
+  RTC_event_t ev;
+
+  ev.type = type;
+  _readCounter(&ev.epoch, &ev.div);
+  if(!_events.push(ev))
+    _eventOverruns[type]++;
+}
+
+
+/********************************************************************
+  * @brief  HAL hook: the core's RTC_IRQHandler calls it instead of the
+  *   seconds callback when the counter overflow flag is set.
+\*******************************************************************/
+void HAL_RTCEx_RTCEventErrorCallback(RTC_HandleTypeDef *hrtc)
+{
+  (void)hrtc;
+  STM32LIBS_RTC &rtc = STM32LIBS_RTC::getInstance();
+
+  if(rtc._eventMask & RTC_EVENT_MASK(RTC_EVENT_OVERFLOW))
+    rtc._postEvent(RTC_EVENT_OVERFLOW);
 }
 
+
 // Kept for compatibility. Use STM32LowPower library.
 void STM32LIBS_RTC::standbyMode(void)
 {
@@ -310,6 +769,165 @@ char* STM32LIBS_RTC::getMonthName(uint8_t month)
 }
 
 
+// "00" - "99", two characters per number
+static const char digits2[201] =
+  "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+  "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+  "8081828384858687888990919293949596979899";
+
+static inline char *put2(char *p, uint8_t v)
+{
+  if(v > 99)
+    v = 99;
+  p[0] = digits2[v * 2];
+  p[1] = digits2[v * 2 + 1];
+  return p + 2;
+}
+
+static inline char *putStr(char *p, const char *str)
+{
+  while(*str)
+    *p++ = *str++;
+  return p;
+}
+
+static char *putDate(char *p, const RTC_datetime_t *dt, char sep)
+{
+  p = put2(p, dt->year / 100);
+  p = put2(p, dt->year % 100);
+  if(sep)
+    *p++ = sep;
+  p = put2(p, dt->month);
+  if(sep)
+    *p++ = sep;
+  return put2(p, dt->day);
+}
+
+static char *putTime(char *p, uint8_t hours, const RTC_datetime_t *dt, char sep)
+{
+  p = put2(p, hours);
+  if(sep)
+    *p++ = sep;
+  p = put2(p, dt->minutes);
+  if(sep)
+    *p++ = sep;
+  return put2(p, dt->seconds);
+}
+
+/********************************************************************
+  * @brief  Formats a datetime into a caller buffer. No heap, no printf.
+  * @param  buf - output, NUL terminated. size - bytes available,
+  *   RTC_DATETIME_STR_MAX always fits.
+  * @param  datetime - from getDateTime(), getLocalDateTime() or
+  *   epochToDateTime(), 12 or 24 hour format.
+  * @param  format - DT_FORMAT_xxx. ISO 8601, RFC 3339 & compact are always
+  *   24 hour time, the others follow datetime->hour_format.
+  * @param  utcOffset - DT_FORMAT_RFC3339 only: seconds east of UTC,
+  *   ex: getUtcOffset() for a local datetime. 0 prints "Z".
+  * @retval string length, 0 if format is unknown or buf is too small
+  *   (buf is then an empty string).
+\*******************************************************************/
+uint8_t STM32LIBS_RTC::getDateTimeStr(char *buf, uint8_t size, const RTC_datetime_t *datetime, uint8_t format,
+                                      int32_t utcOffset)
+{
+  char tmp[RTC_DATETIME_STR_MAX];
+  char *p = (size >= RTC_DATETIME_STR_MAX) ? buf : tmp;   // short buffer: format aside, copy if it fits
+  char *start = p;
+  bool h12 = (datetime->hour_format == RTC_HOUR_FORMAT_12);
+  uint8_t hours24 = datetime->hours, len;
+
+  if(buf == nullptr || size == 0)
+    return 0;
+  if(h12)
+    hours24 = (datetime->hours % 12) + ((datetime->am_pm == RTC_HOUR_PM) ? 12 : 0);
+
+  switch(format)
+  {
+    case DT_FORMAT_ISO8601:
+    case DT_FORMAT_RFC3339:
+      p = putDate(p, datetime, '-');
+      *p++ = 'T';
+      p = putTime(p, hours24, datetime, ':');
+      if(format == DT_FORMAT_ISO8601)
+        break;
+      if(utcOffset == 0)
+      {
+        *p++ = 'Z';
+        break;
+      }
+      *p++ = (utcOffset < 0) ? '-' : '+';
+      if(utcOffset < 0)
+        utcOffset = -utcOffset;
+      p = put2(p, (utcOffset / 3600) % 100);
+      *p++ = ':';
+      p = put2(p, (utcOffset / 60) % 60);
+      break;
+    case DT_FORMAT_COMPACT:
+      p = putDate(p, datetime, 0);
+      *p++ = 'T';
+      p = putTime(p, hours24, datetime, 0);
+      break;
+    case DT_FORMAT_DATE:
+      p = putDate(p, datetime, '-');
+      break;
+    case DT_FORMAT_TIME:
+    case DT_FORMAT_DATETIME:
+    case DT_FORMAT_US:
+    case DT_FORMAT_LONG:
+      if(format == DT_FORMAT_DATETIME)
+      {
+        p = putDate(p, datetime, '-');
+        *p++ = ' ';
+      }
+      else if(format == DT_FORMAT_US)
+      {
+        p = put2(p, datetime->month);
+        *p++ = '/';
+        p = put2(p, datetime->day);
+        *p++ = '/';
+        p = put2(p, datetime->year / 100);
+        p = put2(p, datetime->year % 100);
+        *p++ = ' ';
+      }
+      else if(format == DT_FORMAT_LONG)
+      {
+        p = putStr(p, getWeekdayName(datetime->weekday));
+        *p++ = ',';
+        *p++ = ' ';
+        p = putStr(p, getMonthName(datetime->month));
+        *p++ = ' ';
+        if(datetime->day >= 10)
+          *p++ = '0' + datetime->day / 10;
+        *p++ = '0' + datetime->day % 10;
+        *p++ = ',';
+        *p++ = ' ';
+        p = put2(p, datetime->year / 100);
+        p = put2(p, datetime->year % 100);
+        *p++ = ' ';
+      }
+      p = putTime(p, datetime->hours, datetime, ':');
+      if(h12)
+        p = putStr(p, (datetime->am_pm == RTC_HOUR_PM) ? " PM" : " AM");
+      break;
+    default:
+      *buf = 0;
+      return 0;
+  }
+  *p = 0;
+  len = p - start;
+  if(start == tmp)
+  {
+    if(len >= size)
+    {
+      *buf = 0;
+      return 0;
+    }
+    memcpy(buf, tmp, len + 1);
+  }
+  return len;
+}
+
+
 /********************************************************************
   *  @brief  configure RTC source clock for low power
   *  @param  none
@@ -360,116 +978,201 @@ void STM32LIBS_RTC::configForLowPower(Source_Clock source)
 
 
 /******************************************************************************
-**    @brief Writes an array of user data to the STM32F1xx data registers. Up to 9 
-**    16-bit values can be stored and these registers are non-volatile if the 
-**    Vbat input is powered with a coin-cell or other equivalent power source.
+**    @brief Writes an array of user data to the STM32F1xx data registers. Up to 
+**    eepromSize() 16-bit values can be stored (9, or 41 on high density parts)
+**    and these registers are non-volatile if the Vbat input is powered with a
+**    coin-cell or other equivalent power source.
 **    @param data_array - pointer to user data array.
-**    @param indx - User register (0 - 8)
-**    @param len - number of registers to read (1 - 9).
-**    @note: The datasheet says there are 42 regs available but not all devices
-**      support more than 10.
-**      Indx + len should not be greater than 9.
+**    @param indx - User register (0 - eepromSize() - 1)
+**    @param len - number of registers to write (1 - eepromSize()).
+**    @note: begin() probes how many registers the part implements, registers
+**      past the end are not written.
+**    @note Registers already holding the value are not written again.
 \*****************************************************************************/
 void STM32LIBS_RTC::eepromWrite(uint16_t data_array[], uint8_t indx, uint8_t len)
 {
   uint8_t i;
-  uint8_t _indx = indx;
 
+  if(data_array == NULL)
+    return;
   indx += 1;                // can't use first reg
   for(i=0; i<len; i++)
   {
-    if(indx > 9)
+    if(indx >= _bkpCount)
       break;
 
-    _RTC_BackupRegs[indx++] = data_array[i];
+    setBackup(indx++, data_array[i]);
   }
-  setBackup(_indx+1, len);
 }
 
 
 /******************************************************************************
 **    @brief Reads user data from the RTC backup registers (poor mans EEPROM)
-**      Up to nine (9) 16-bit values can be read and these registers are non-volatile 
+**      Up to eepromSize() 16-bit values can be read and these registers are non-volatile 
 **      if the Vbat input is powered with a coin-cell or other equivalent power.
 **    @param data_array - pointer to user data array.
-**    @param indx - User register (0 - 8)
+**    @param indx - User register (0 - eepromSize() - 1)
 **    @param len - number of registers to read.
-**    @note indx + len should not be greater than 9.
+**    @note indx + len should not be greater than eepromSize().
+**    @note Each register is read from the bus once, then from the shadow copy.
 \*****************************************************************************/
 void STM32LIBS_RTC::eepromRead(uint16_t data_array[], uint8_t indx, uint8_t len)
 {
   uint8_t i;
-  uint8_t _indx = indx;
 
   if(data_array != NULL)
   {
-    getBackup(indx+1, len);         // read backup regs into local array
-    indx = _indx+1;
+    indx += 1;
     for(i=0; i<len; i++)
     {
-      if(indx > 9)
+      if(indx >= _bkpCount)
         return;
 
-      data_array[i] = _RTC_BackupRegs[indx++];  // copy local array to caller array
+      data_array[i] = getBackup(indx++);
     }
   }
 }
 
 
+/******************************************************************************
+**    @brief Selects when changed backup registers reach the bus.
+**    @param mode - BACKUP_WRITE_THROUGH: on every change (default).
+**      BACKUP_WRITE_BACK: on flushBackup(), changes not flushed are lost on
+**      a reset. Switching back to write through flushes.
+\*****************************************************************************/
+void STM32LIBS_RTC::setBackupMode(uint8_t mode)
+{
+  _bkpMode = mode;
+  if(mode == BACKUP_WRITE_THROUGH)
+    flushBackup();
+}
+
+
+/******************************************************************************
+**    @brief Writes the dirty backup registers to the bus.
+**    @returns number of registers written.
+\*****************************************************************************/
+uint8_t STM32LIBS_RTC::flushBackup(void)
+{
+  uint8_t indx, n = 0;
+
+  __disable_irq();
+  while(_bkpDirty != 0)
+  {
+    RTC_PERF_START(t);
+    indx = __builtin_ctzll(_bkpDirty);
+    BKP_DR(indx) = _RTC_BackupRegs[indx];
+    _bkpDirty &= _bkpDirty - 1;
+    RTC_PERF_STOP(RTC_PERF_BKP_WRITE, t);
+    n++;
+  }
+  _bkpWrites += n;
+  __enable_irq();
+  return n;
+}
+
+
 /******************************************************************************
 **    setBackup()
 **
-**    Private access to first four STM32F10x backup regs. These are used to
-**    store status and alarm settings during power down. There are 42 16-bit
-**    registers that are non-volatile if the Vbat input is powered with a 
-**    coin-cell or other equivalent power source.
+**    Private write to the backup register shadow copy. A write of the value
+**    already there is dropped, otherwise the register is marked dirty and
+**    written now (write through) or by flushBackup() (write back). The first
+**    register holds the status flags, the others are the user "EEPROM".
 \*****************************************************************************/
-void STM32LIBS_RTC::setBackup(uint8_t indx, uint8_t len)
+void STM32LIBS_RTC::setBackup(uint8_t indx, uint16_t value)
 {
-  pBkpRegs pb;
-  pb = reinterpret_cast<BACKUP_REGS *>(BKP_REG_BASE + 0x00000004);
+  uint64_t bit = 1ULL << indx;
 
-  while(len > 0)
-  {
-    if(indx > 9)
-      break;
+  if(indx >= _bkpCount)
+    return;
 
-    pb->bkup_regs[indx] = _RTC_BackupRegs[indx];
-    indx++;
-    len--;
+  __disable_irq();
+  if((_bkpValid & bit) && _RTC_BackupRegs[indx] == value)
+  {
+    _bkpWritesSaved++;
+    __enable_irq();
+    return;
   }
-  
+  _RTC_BackupRegs[indx] = value;
+  _bkpValid |= bit;
+  _bkpDirty |= bit;
+  __enable_irq();
+
+  if(_bkpMode == BACKUP_WRITE_THROUGH)
+    flushBackup();
 }
       
       
 /******************************************************************************
 **    getBackup()
 **
-**    Reads up to 42 half word (16 bit) values from the STM32F10x backup regs.
-**    The backup regs are non-volatile if the Vbat input is powered with a 
-**    coin-cell or other 3V power source.
+**    Reads a half word (16 bit) backup register through the shadow copy, the
+**    bus is only read the first time. The backup regs are non-volatile if the
+**    Vbat input is powered with a coin-cell or other 3V power source.
 \*****************************************************************************/      
-void STM32LIBS_RTC::getBackup(uint8_t indx, uint8_t len)
+uint16_t STM32LIBS_RTC::getBackup(uint8_t indx)
 {
-  pBkpRegs pb;
-  pb = reinterpret_cast<BACKUP_REGS *>(BKP_REG_BASE + 0x00000004);
+  uint64_t bit = 1ULL << indx;
+
+  if(indx >= _bkpCount)
+    return 0;
 
-  while(len > 0)
+  __disable_irq();
+  if(_bkpValid & bit)
+    _bkpReadsSaved++;
+  else
   {
-    if(indx > 9)
-      break;
-    
-    _RTC_BackupRegs[indx] = (uint16_t)(pb->bkup_regs[indx] & 0xFFFF);
-    indx++;
-    len--;
+    RTC_PERF_START(t);
+    _RTC_BackupRegs[indx] = (uint16_t)(BKP_DR(indx) & 0xFFFF);
+    RTC_PERF_STOP(RTC_PERF_BKP_READ, t);
+    _bkpValid |= bit;
+    _bkpReads++;
   }
+  __enable_irq();
+  return _RTC_BackupRegs[indx];
 }
 
 
 /******************************************************************************
-**    clearBackup()
+**    _probeBackup()
 **
-**    Clears all backup registers. *** WARNING *** this resets the RTC domain 
+**    Counts the implemented backup data registers: DR1 - DR10 on low & medium
+**    density parts, DR1 - DR42 on high density & XL (and some clones stop
+**    in between). Unimplemented registers read 0 and ignore writes, so a
+**    register holding a value exists and an empty one is tested with a
+**    pattern and cleared again. Stored data is not disturbed.
+\*****************************************************************************/
+bool STM32LIBS_RTC::_bkpImplemented(uint8_t indx)
+{
+  bool found;
+
+  if((BKP_DR(indx) & 0xFFFF) != 0)
+    return true;
+  BKP_DR(indx) = 0xA55A;
+  found = ((BKP_DR(indx) & 0xFFFF) == 0xA55A);
+  BKP_DR(indx) = 0;
+  return found;
+}
+
+uint8_t STM32LIBS_RTC::_probeBackup(void)
+{
+  uint8_t n;
+
+  if(!_bkpImplemented(10))                  // DR11
+    return 10;
+  if(_bkpImplemented(BKP_DR_MAX - 1))       // DR42
+    return BKP_DR_MAX;
+  for(n = 11; n < BKP_DR_MAX - 1 && _bkpImplemented(n); n++)
+    ;
+  return n;
+}
+
+
+/******************************************************************************
+**    clearBackup()
+**
+**    Clears all backup registers. *** WARNING *** this resets the RTC domain 
 **    including time and alarm settings.
 \*****************************************************************************/ 
 void STM32LIBS_RTC::clearBackup(void)
@@ -479,31 +1182,55 @@ void STM32LIBS_RTC::clearBackup(void)
 
    // backup domain reset disables RTC access - reenable
    PWR_CR |= DBP;
+
+   // all registers read 0 now
+   memset(_RTC_BackupRegs, 0, sizeof(_RTC_BackupRegs));
+   _bkpValid = (1ULL << _bkpCount) - 1;
+   _bkpDirty = 0;
 }
 
 
 /******************************************************************************
-// setDateTime()
-//
-// datetime - ptr to _dateTimeStruct
-// useRaw: if true use 'time_stamp' to set RTC count register. Otherwise convert
-// date & time info in datetime to a 32 bit value representing the number of 
-// seconds since midnight of Jan 1, 2000.
+**    @brief Sets the RTC date & time.
+**    @param datetime - ptr to RTC_datetime_t structure. 12 hour values are
+**      converted using the am_pm element.
+**    @returns RTC_OK, RTC_INVALID_PARAM if a date/time element is out of range
+**      or RTC_TIME_NOT_SET if the RTC is not configured.
 \*****************************************************************************/
-void STM32LIBS_RTC::setDateTime(RTC_datetime_t *datetime)
+uint8_t STM32LIBS_RTC::setDateTime(RTC_datetime_t *datetime)
 {
-  if(isConfigured())
-  {
-    uint32_t _epoch = dateTimeToEpoch((RTC_datetime_t *)datetime); // convert date/time units to 32 bit epoch
-    //
-    // if 12 hour format add extra 12 hours for PM
-    //
-    if(datetime->hour_format == RTC_HOUR_FORMAT_12 && datetime->am_pm == RTC_HOUR_PM)
-    {
-      _epoch += (SECS_PER_DAY / 2);
-    }
+  uint8_t retn;
+  uint32_t _epoch;
+
+  if(!isConfigured())
+    return RTC_TIME_NOT_SET;
+
+  retn = dateTimeToEpoch(datetime, &_epoch);   // convert date/time units to 32 bit epoch
+  if(retn == RTC_OK)
     setEpoch(_epoch);
-  }
+  return retn;
+}
+
+
+/******************************************************************************
+**    @brief Sets the RTC date & time from text, see parseDateTimeStr().
+**    @param errPos - optional, returns the position of the first bad
+**      character or the characters used.
+**    @returns RTC_OK, RTC_INVALID_PARAM if str is not a valid timestamp
+**      or RTC_TIME_NOT_SET if the RTC is not configured.
+\*****************************************************************************/
+uint8_t STM32LIBS_RTC::setDateTimeStr(const char *str, uint8_t len, uint8_t *errPos)
+{
+  uint8_t retn;
+  uint32_t _epoch;
+
+  if(!isConfigured())
+    return RTC_TIME_NOT_SET;
+
+  retn = parseDateTimeStr(str, len, &_epoch, errPos);
+  if(retn == RTC_OK)
+    setEpoch(_epoch);
+  return retn;
 }
 
 
@@ -517,16 +1244,94 @@ void STM32LIBS_RTC::setDateTime(RTC_datetime_t *datetime)
 **      use the optional hour_format parameter. 
 **    @note If the optional hour_format parameter is used this value becomes the
 **      new default format.
+**    @note The last decoded datetime is cached. If less than a day has passed
+**      since the previous call it is advanced instead of decoded again, see
+**      getDecodeStats().
 **
 \*****************************************************************************/
 void STM32LIBS_RTC::getDateTime(RTC_datetime_t *_datetime, uint8_t hour_format)
 {
-  //uint8_t _hour_fmt;
+  _decodeDateTime(_datetime, hour_format, getEpoch(), DT_CACHE_UTC);
+}
+
+
+/******************************************************************************
+**    @brief Same as getDateTime() but in the local time of the zone set by
+**      setTimeZone(), UTC until then.
+**    @param datetime - ptr to RTC_datetime_t structure to fill, epoch is the
+**      local time as seconds since 1970.
+**    @note The offset is looked up in a window between two DST transitions,
+**      see STM32LIBS_TZ.h, the local datetime has its own decode cache.
+**
+\*****************************************************************************/
+void STM32LIBS_RTC::getLocalDateTime(RTC_datetime_t *_datetime, uint8_t hour_format)
+{
+  _decodeDateTime(_datetime, hour_format, tzToLocal(&_tz, getEpoch()), DT_CACHE_LOCAL);
+}
+
+
+/******************************************************************************
+**    @brief Sets the time zone used by getLocalDateTime().
+**    @param spec - POSIX TZ string, ex: "CET-1CEST,M3.5.0,M10.5.0/3" or
+**      "EST5EDT,M3.2.0,M11.1.0". nullptr = UTC.
+**    @returns false if spec is not valid, local time is then UTC.
+**
+\*****************************************************************************/
+bool STM32LIBS_RTC::setTimeZone(const char *spec)
+{
+  bool retn = (spec == nullptr) ? tzCompile(&_tz, "UTC0") : tzCompile(&_tz, spec);
+
+  _dtCacheValid &= ~(1 << DT_CACHE_LOCAL);
+  return retn;
+}
+
+
+/******************************************************************************
+**    @brief Current offset of local time from UTC.
+**    @param isDst - optional, returns true while daylight saving time is on.
+**    @returns seconds east of UTC.
+**
+\*****************************************************************************/
+int32_t STM32LIBS_RTC::getUtcOffset(bool *isDst)
+{
+  int32_t offset = tzOffset(&_tz, getEpoch());
+
+  if(isDst != nullptr)
+    *isDst = _tz.isDst;
+  return offset;
+}
+
+
+/******************************************************************************
+**    @brief Decodes an epoch through one of the datetime caches.
+**    @param cache - DT_CACHE_UTC or DT_CACHE_LOCAL.
+**
+\*****************************************************************************/
+void STM32LIBS_RTC::_decodeDateTime(RTC_datetime_t *_datetime, uint8_t hour_format, uint32_t _epoch, uint8_t cache)
+{
+  RTC_datetime_t *_dt = &_dtCache[cache];
+  uint32_t _delta = _epoch - _dt->epoch;
+
   if(hour_format != RTC_HOUR_FORMAT_UNDEF)
     _datetime->hour_format = hour_format;
+  else
+    hour_format = _datetime->hour_format;
 
-  // epochToDateTime always yeilds 24 hour time
-  epochToDateTime((RTC_datetime_t *)_datetime, getEpoch());
+  // the loop usually asks again a few seconds later: advance the last decoded
+  // datetime instead of decoding the epoch again (always 24 hour time)
+  if((_dtCacheValid & (1 << cache)) && _delta < SECS_PER_DAY)
+  {
+    _advanceDateTime(_dt, _delta);
+    _dtCacheHits++;
+  }
+  else
+  {
+    epochToDateTime(_dt, _epoch);
+    _dtCacheValid |= 1 << cache;
+    _dtCacheMisses++;
+  }
+  *_datetime = *_dt;
+  _datetime->hour_format = hour_format;
 
   // if 12 hour format is requested, convert to 12 hour AM/PM
   if(_datetime->hour_format == RTC_HOUR_FORMAT_12)
@@ -541,36 +1346,221 @@ void STM32LIBS_RTC::getDateTime(RTC_datetime_t *_datetime, uint8_t hour_format)
 }
 
 
+/******************************************************************************
+**    @brief Moves a decoded (24 hour) datetime forward by less than a day,
+**      carrying into minutes, hours, day, month and year.
+**
+**    @param datetime - ptr to RTC_datetime_t structure decoded by epochToDateTime.
+**    @param secs - seconds to advance, 0 - 86399.
+**
+\*****************************************************************************/
+void STM32LIBS_RTC::_advanceDateTime(RTC_datetime_t *datetime, uint32_t secs)
+{
+  uint32_t _carry;
+  uint8_t monthLength;
+
+  datetime->epoch += secs;
+  secs += datetime->seconds;
+  if(secs < SECS_PER_MIN)                   // common case: same minute
+  {
+    datetime->seconds = secs;
+    return;
+  }
+  _carry = secs / SECS_PER_MIN;
+  datetime->seconds = secs - (_carry * SECS_PER_MIN);
+
+  _carry += datetime->minutes;
+  if(_carry < 60)
+  {
+    datetime->minutes = _carry;
+    return;
+  }
+  datetime->minutes = _carry % 60;
+
+  _carry = datetime->hours + (_carry / 60);
+  if(_carry < 24)
+  {
+    datetime->hours = _carry;
+    return;
+  }
+  datetime->hours = _carry - 24;            // < 1 day, at most one midnight
+
+  datetime->weekday = (datetime->weekday == 6) ? 0 : datetime->weekday + 1;
+  monthLength = monthDays[datetime->month - 1];
+  if(datetime->month == 2 && calIsLeapYear(datetime->year))
+    monthLength = 29;
+  if(++datetime->day > monthLength)
+  {
+    datetime->day = 1;
+    if(++datetime->month > 12)
+    {
+      datetime->month = 1;
+      datetime->year++;
+    }
+  }
+}
+
+
 /******************************************************************************
 **    @brief Gets the epoch from the RTC count regs (num of secs from 1970)
 **
 **    @return 32 bit epoch 
-**
+**    @note CNTL can carry into CNTH between the two reads (off by 65536 s),
+**      so CNTH is read again and the pair retried if it changed. No
+**      interrupt masking; getDateTime(), the alarm checks and the sub-second
+**      reads all go through here or _readCounter().
 \*****************************************************************************/
 uint32_t STM32LIBS_RTC::getEpoch(void)
 {
-   uint32_t _tm;
-   _tm = (RTC_CNTH << 16UL) | RTC_CNTL;
-   return _tm;
+   uint16_t hi, lo;
+   uint32_t cnt, div;
+
+   if((_rsfWait || _lseWait) && _syncCounter(&cnt, &div))
+     return cnt;
+   do {
+     hi = RTC_CNTH;
+     lo = RTC_CNTL;
+   } while(RTC_CNTH != hi);
+   return ((uint32_t)hi << 16) | lo;
+}
+
+/******************************************************************************
+**    @brief Slow path of the counter reads. After a warm start or a clock
+**      switch waits for RSF: until the first RTCCLK edge the APB1 side of
+**      CNT / DIV / CRL is stale. While the LSE starts there is no RTCCLK,
+**      the counter comes from millis() until serviceClock() switches.
+**    @returns true if cnt & div were filled in.
+\*****************************************************************************/
+bool STM32LIBS_RTC::_syncCounter(uint32_t *cnt, uint32_t *div)
+{
+  uint32_t start, e;
+
+  if(_lseWait)
+  {
+    e = millis() - _softMs;
+    *cnt = _softEpoch + e / 1000;
+    *div = _prl - (e % 1000) * (_prl + 1) / 1000;
+    return true;
+  }
+  start = millis();
+  while((RTC_CRL & RSF) == 0 && (millis() - start) < REG_TIMEOUT);
+  _rsfWait = false;
+  return false;
+}
+
+
+/******************************************************************************
+**    @brief Counter & prescaler divider from the same second. The divider
+**      counts down from PRL to 0 and the counter steps on its reload, so a
+**      reload between the reads shows up as a counter change: read again.
+**    @param cnt - returns the counter (epoch).
+**    @param div - returns the divider, 0 - PRL.
+\*****************************************************************************/
+void STM32LIBS_RTC::_readCounter(uint32_t *cnt, uint32_t *div)
+{
+  uint16_t hi, lo;
+  uint32_t d;
+
+  if((_rsfWait || _lseWait) && _syncCounter(cnt, div))
+    return;
+  // CNTH, CNTL, DIV, then CNTL & CNTH again: any step or carry in between retries
+  do {
+    hi = RTC_CNTH;
+    lo = RTC_CNTL;
+    d = ((RTC_DIVH & 0x000F) << 16) | RTC_DIVL;
+  } while(RTC_CNTL != lo || RTC_CNTH != hi);
+  *cnt = ((uint32_t)hi << 16) | lo;
+  *div = (d > _prl) ? _prl : d;
+}
+
+
+/******************************************************************************
+**    @brief One consistent view of the RTC: counter, divider, alarm and the
+**      control registers, all from the same second.
+**    @param snap - returns the snapshot.
+**    @note ALR is write only, alarm is the value last written by this
+**      library (0 if none since reset).
+\*****************************************************************************/
+void STM32LIBS_RTC::getSnapshot(RTC_snapshot_t *snap)
+{
+  uint16_t hi, lo;
+
+  if(snap == nullptr)
+    return;
+  if((_rsfWait || _lseWait) && _syncCounter(&snap->epoch, &snap->div))
+  {
+    snap->crl = RTC_CRL;
+    snap->crh = RTC_CRH;
+  }
+  else
+  {
+    do {
+      hi = RTC_CNTH;
+      lo = RTC_CNTL;
+      snap->div = ((RTC_DIVH & 0x000F) << 16) | RTC_DIVL;
+      snap->crl = RTC_CRL;
+      snap->crh = RTC_CRH;
+    } while(RTC_CNTL != lo || RTC_CNTH != hi);
+    snap->epoch = ((uint32_t)hi << 16) | lo;
+  }
+  if(snap->div > _prl)
+    snap->div = _prl;
+  snap->prl = _prl;
+  snap->alarm = _alarmShadow;
 }
 
+
+/******************************************************************************
+**    @brief Epoch with the fraction of the current second from the
+**      prescaler divider, no hardware timer needed.
+**    @param ts - returns seconds, RTCCLK ticks into the second & ticks per
+**      second (30.5 us resolution with the LSE).
+\*****************************************************************************/
+void STM32LIBS_RTC::getTimestamp(RTC_timestamp_t *ts)
+{
+  uint32_t div;
+
+  if(ts == nullptr)
+    return;
+  _readCounter(&ts->epoch, &div);
+  ts->hz = _prl + 1;
+  ts->ticks = _prl - div;
+}
+
+
+/******************************************************************************
+**    @brief Milliseconds since 1970 from the counter & prescaler divider.
+**    @returns epoch * 1000 + milliseconds into the second.
+\*****************************************************************************/
+uint64_t STM32LIBS_RTC::getEpochMillis(void)
+{
+  uint32_t cnt, div;
+
+  _readCounter(&cnt, &div);
+  return (uint64_t)cnt * 1000 + ((_prl - div) * 1000UL) / (_prl + 1);
+}
+
+
 /******************************************************************************
 **    @brief Sets the epoch number in the RTC count regs (num of secs from 1970)
 **    @param _epoch - 32 bit number of seconds since 1970
+**    @note Waits for the write to land (3 RTCCLK) with interrupts enabled.
 **
 \*****************************************************************************/
 void STM32LIBS_RTC::setEpoch(uint32_t _epoch)
 {
-  __disable_irq();
-
-  rtc_config(CONFIG_ENTER);
-  RTC_CNTH = _epoch >> 16;
-  RTC_CNTL = _epoch & 0xFFFF;
-  rtc_config(CONFIG_EXIT);
+  _waitWrite(setEpochAsync(_epoch));
+}
 
-  __enable_irq();
 
-  _statusFlagChange(BACKUP_TIME_SET_FLAG, true);
+/******************************************************************************
+**    @brief Queues a counter write, see serviceWrites().
+**    @param _epoch - 32 bit number of seconds since 1970
+**    @returns write handle for writeStatus().
+\*****************************************************************************/
+uint32_t STM32LIBS_RTC::setEpochAsync(uint32_t _epoch)
+{
+  return _queueWrite(WRITE_CNT, _epoch, false);
 }
 
 
@@ -578,45 +1568,215 @@ void STM32LIBS_RTC::setEpoch(uint32_t _epoch)
 **    @brief Converts date / time elements to a 32 bit epoch (num of secs since 1970).
 **
 **    @param datetime - ptr to RTC_datetime_t structure containing datetime elements.
-**    @returns A 32 bit epoch.
+**      Hours are always taken as 24 hour time.
+**    @returns A 32 bit epoch, 0 if a date/time element is out of range.
 **    @note: The epoch variable in the datetime struct is updated also.
 **
 \*****************************************************************************/
 uint32_t STM32LIBS_RTC::dateTimeToEpoch(RTC_datetime_t *datetime)
 {
-  int16_t i;
-  uint32_t _seconds;   
-  int16_t _year = (datetime->year - 1970);    // 1970 is the beginning of time!
+  uint32_t _seconds = 0;
 
-  if(_year < 0)
-    _year = 0;
+  if(!calDateTimeToEpoch(datetime->year, datetime->month, datetime->day,
+                         datetime->hours, datetime->minutes, datetime->seconds, &_seconds))
+    _seconds = 0;
 
-   // seconds from 1970 till 1 jan 00:00:00 of the given year
-   _seconds = _year * (SECS_PER_DAY * 365);
-   for (i = 0; i < _year; i++) {
-      if (IS_LEAP_YEAR(i)) {
-         _seconds += SECS_PER_DAY;   // add extra days for leap years
-      }
-   }
-  
-   // add days for this year, months start from 1
-   for (i = 1; i < datetime->month; i++) 
-   {
-      if ( (i == 2) && IS_LEAP_YEAR(_year)) 
-      { 
-         _seconds += SECS_PER_DAY * 29;
-      } 
-      else 
-      {
-         _seconds += SECS_PER_DAY * monthDays[i-1];  // monthDay array starts from 0
-      }
-   }
-   _seconds += (datetime->day-1) * SECS_PER_DAY;
-   _seconds += datetime->hours * SECS_PER_HOUR;
-   _seconds += datetime->minutes * SECS_PER_MIN;
-   _seconds += datetime->seconds;
-   datetime->epoch = _seconds;
-   return (uint32_t) _seconds; 
+  datetime->epoch = _seconds;
+  return _seconds;
+}
+
+
+/******************************************************************************
+**    @brief Validates date / time elements and converts them to a 32 bit epoch.
+**
+**    @param datetime - ptr to RTC_datetime_t structure containing datetime elements.
+**      If hour_format is RTC_HOUR_FORMAT_12, hours are 1 - 12 plus am_pm.
+**    @param _epoch - returns the 32 bit epoch.
+**    @returns RTC_OK or RTC_INVALID_PARAM if an element is out of range.
+**    @note: The epoch variable in the datetime struct is updated on success.
+**
+\*****************************************************************************/
+uint8_t STM32LIBS_RTC::dateTimeToEpoch(RTC_datetime_t *datetime, uint32_t *_epoch)
+{
+  uint8_t _hours = datetime->hours;
+
+  if(datetime->hour_format == RTC_HOUR_FORMAT_12)
+  {
+    if(_hours < 1 || _hours > 12)
+      return RTC_INVALID_PARAM;
+    _hours %= 12;                           // 12 AM is midnight
+    if(datetime->am_pm == RTC_HOUR_PM)
+      _hours += 12;
+  }
+
+  if(!calDateTimeToEpoch(datetime->year, datetime->month, datetime->day,
+                         _hours, datetime->minutes, datetime->seconds, _epoch))
+    return RTC_INVALID_PARAM;
+
+  datetime->epoch = *_epoch;
+  return RTC_OK;
+}
+
+
+// fixed width decimal field, on failure p is left at the bad character
+static bool parseDigits(const char **p, const char *end, uint8_t n, uint16_t *val)
+{
+  uint16_t v = 0;
+  uint8_t d;
+
+  for(; n > 0; n--, (*p)++)
+  {
+    if(*p >= end || (d = (uint8_t)(**p - '0')) > 9)
+      return false;
+    v = v * 10 + d;
+  }
+  *val = v;
+  return true;
+}
+
+static inline bool parseEnd(const char *p, const char *end)
+{
+  return p >= end || *p == 0 || *p == '\r' || *p == '\n';
+}
+
+static inline bool parseChar(const char **p, const char *end, char c)
+{
+  if(*p >= end || **p != c)
+    return false;
+  (*p)++;
+  return true;
+}
+
+
+/******************************************************************************
+**    @brief Validates a text timestamp and converts it to a 32 bit epoch
+**      in one pass. No sscanf, no heap.
+**
+**    @param str - ISO 8601 extended "2020-06-22T08:39:00" (' ' may replace
+**      'T') or basic / compact "20200622T083900", "20200622083900". Seconds
+**      are optional, a date alone is midnight. Optional fraction (.nnn,
+**      dropped) and zone: 'Z', +hh, +hh:mm / +hhmm, the epoch is then UTC.
+**    @param len - characters available, the text also ends at NUL, CR or LF.
+**    @param _epoch - returns the epoch.
+**    @param errPos - optional, returns the position of the first bad
+**      character (a field out of range: its first character) or on
+**      success the characters used.
+**    @returns RTC_OK or RTC_INVALID_PARAM.
+**
+\*****************************************************************************/
+uint8_t STM32LIBS_RTC::parseDateTimeStr(const char *str, uint8_t len, uint32_t *_epoch, uint8_t *errPos)
+{
+  const char *p = str, *end = str + len, *field;
+  uint16_t year, month, day, hours = 0, minutes = 0, seconds = 0, zh = 0, zm = 0;
+  uint8_t monthLength;
+  int32_t offset = 0;
+  int64_t secs;
+  bool ext, west;
+
+  if(str == nullptr || _epoch == nullptr)
+  {
+    if(errPos != nullptr)
+      *errPos = 0;
+    return RTC_INVALID_PARAM;
+  }
+
+  // date
+  field = p;
+  if(!parseDigits(&p, end, 4, &year))
+    goto fail;
+  if(year < CAL_YEAR_MIN || year > CAL_YEAR_MAX)
+    goto failField;
+  ext = parseChar(&p, end, '-');
+  field = p;
+  if(!parseDigits(&p, end, 2, &month))
+    goto fail;
+  if(month < 1 || month > 12)
+    goto failField;
+  if(ext && !parseChar(&p, end, '-'))
+    goto fail;
+  field = p;
+  if(!parseDigits(&p, end, 2, &day))
+    goto fail;
+  monthLength = calDaysBeforeMonth[month] - calDaysBeforeMonth[month - 1] + ((month == 2 && calIsLeapYear(year)) ? 1 : 0);
+  if(day < 1 || day > monthLength)
+    goto failField;
+  if(parseEnd(p, end))
+    goto done;
+
+  // time, 'T' optional in the compact form
+  if(!parseChar(&p, end, 'T') && !(ext && parseChar(&p, end, ' ')) && ext)
+    goto fail;
+  field = p;
+  if(!parseDigits(&p, end, 2, &hours))
+    goto fail;
+  if(hours > 23)
+    goto failField;
+  if(ext && !parseChar(&p, end, ':'))
+    goto fail;
+  field = p;
+  if(!parseDigits(&p, end, 2, &minutes))
+    goto fail;
+  if(minutes > 59)
+    goto failField;
+  if(ext ? parseChar(&p, end, ':') : (p < end && (uint8_t)(*p - '0') <= 9))
+  {
+    field = p;
+    if(!parseDigits(&p, end, 2, &seconds))
+      goto fail;
+    if(seconds > 59)
+      goto failField;
+    if(parseChar(&p, end, '.') || parseChar(&p, end, ','))
+    {
+      if(p >= end || (uint8_t)(*p - '0') > 9)
+        goto fail;
+      while(p < end && (uint8_t)(*p - '0') <= 9)
+        p++;
+    }
+  }
+
+  // zone
+  if(!parseChar(&p, end, 'Z') && p < end && (*p == '+' || *p == '-'))
+  {
+    west = (*p++ == '-');
+    field = p;
+    if(!parseDigits(&p, end, 2, &zh))
+      goto fail;
+    if(zh > 23)
+      goto failField;
+    if(ext ? parseChar(&p, end, ':') : (p < end && (uint8_t)(*p - '0') <= 9))
+    {
+      field = p;
+      if(!parseDigits(&p, end, 2, &zm))
+        goto fail;
+      if(zm > 59)
+        goto failField;
+    }
+    offset = zh * 3600L + zm * 60L;
+    if(west)
+      offset = -offset;
+  }
+
+done:
+  if(!parseEnd(p, end))
+    goto fail;
+  secs = (int64_t)calDaysFromCivil(year, month, day) * CAL_SECS_PER_DAY +
+         hours * 3600L + minutes * 60L + seconds - offset;
+  if(secs < 0 || secs > 0xFFFFFFFFLL)
+  {
+    p = str;                                // outside 1970 - 2106
+    goto fail;
+  }
+  *_epoch = (uint32_t)secs;
+  if(errPos != nullptr)
+    *errPos = p - str;
+  return RTC_OK;
+
+failField:
+  p = field;
+fail:
+  if(errPos != nullptr)
+    *errPos = p - str;
+  return RTC_INVALID_PARAM;
 }
 
 
@@ -627,113 +1787,267 @@ uint32_t STM32LIBS_RTC::dateTimeToEpoch(RTC_datetime_t *datetime)
 **    @param _epoch - 32 bit number of seconds since 1970.
 **    @note - Date & Time are returned in 24 hour format. Caller must convert to
 **      12 hour format if needed.
+**    @note - Constant time, see STM32LIBS_CALENDAR.h.
 **
 \*****************************************************************************/
 void STM32LIBS_RTC::epochToDateTime(RTC_datetime_t *datetime, uint32_t _epoch)
 {
-   // working variables
-   uint8_t _month, monthLength;
-   uint32_t _days = 0;
-   uint32_t _time = _epoch;
+   uint32_t _sod;
+   uint32_t _days = calSplitEpoch(_epoch, &_sod);   // days since 1970 & secs of the day
 
    datetime->epoch = _epoch;
-   datetime->seconds = _time % 60;
-   _time /= 60;                     // time = minutes
-   datetime->minutes = _time % 60;
-   _time /= 60;                     // time = hours
-   datetime->hours = _time % 24;
-   _time /= 24;                     // time = days
-   // calc day of the week
-   datetime->weekday = ((_time + 4) % 7);   // jan 1 1970 was a thursday
- 
-   datetime->year = 0;
-   while((unsigned)(_days += (IS_LEAP_YEAR(datetime->year) ? 366 : 365)) <= _time) 
-   {
-      datetime->year++;
-   }
-
-   _days -= IS_LEAP_YEAR(datetime->year) ? 366 : 365;
-   _time -= _days; // now it is days in this year, starting at 0
-  
-   _days = 0;
-   monthLength = 0;
-   for (_month=0; _month<12; _month++) 
-   {
-      if (_month == 1) // february
-      { 
-         if (IS_LEAP_YEAR(datetime->year)) 
-         {
-         monthLength = 29;
-         } 
-         else 
-         {
-         monthLength=28;
-         }
-      } 
-      else 
-      {
-         monthLength = monthDays[_month];
-      }
-    
-      if (_time >= monthLength) 
-      {
-         _time -= monthLength;
-      } 
-      else 
-      {
-         break;
-      }
-   }
-   datetime->year += 1970;
-   datetime->month = _month + 1;  // jan is month 1  
-   datetime->day = _time + 1;     // day of month starting with 1
+   calSplitTime(_sod, &datetime->hours, &datetime->minutes, &datetime->seconds);
+   datetime->weekday = calWeekday(_days);
+   calCivilFromDays(_days, &datetime->year, &datetime->month, &datetime->day);
 }
 
 
 /******************************************************************************
-**    @brief RTC register CONFIGURATION mode enable/disable.
+**    @brief Advances the configuration write engine without waiting.
+**
+**    CNT, ALR and PRL can only be written in configuration mode, entered
+**    when RTOFF says the previous write is done; after CNF is cleared the
+**    write takes 3 RTCCLK cycles (~92 us on the LSE). Instead of spinning
+**    through that, each call does the step the flags allow: write everything
+**    queued in one CNF window, or retire the write in flight once RTOFF & RSF
+**    are set. Interrupts are masked for those few register accesses only.
 **
-**    @param _config - CONFIG_ENTER or CONFIG_EXIT
-**    @note The RTC count, alarm, or prescale regs can only be update when 
-**      configuration mode is enabled.
+**    @returns RTC_BUSY while writes are queued or in flight, else RTC_OK.
+**    @note Call it from loop(); writeStatus() and the library's alarm &
+**      seconds interrupts call it too. A write still waiting after
+**      REG_TIMEOUT ms fails with RTC_FAIL_CONFIG_ENTER / _EXIT.
 **
 \*****************************************************************************/
-uint8_t STM32LIBS_RTC::rtc_config(uint8_t _config)
+uint8_t STM32LIBS_RTC::serviceWrites(void)
 {
-  uint32_t tmo = millis();
   uint8_t retn = RTC_OK;
+  uint16_t flags;
+
+  if((_wrQueued | _wrActive) == 0)
+    return RTC_OK;
 
-  switch(_config)
+  __disable_irq();
+  if(_wrActive != 0)
   {
-    case CONFIG_ENTER:
-      while((RTC_CRL & RTOFF) == 0)       // wait for last write to terminate
-      {
-        if(millis() - tmo > REG_TIMEOUT)
-        {
-          retn = RTC_FAIL_CONFIG_ENTER;
-          break;
-        }
-      }    
-      if(retn == RTC_OK)
+    if((RTC_CRL & RTOFF_RSF) == RTOFF_RSF)
+    {
+      RTC_PERF_STOP(RTC_PERF_CONFIG_EXIT, _wrPerf);
+      _finishWrites(RTC_OK);
+    }
+    else if(millis() - _wrStart > REG_TIMEOUT)
+    {
+      RTC_PERF_STOP(RTC_PERF_CONFIG_EXIT, _wrPerf);
+      RTC_PERF_COUNT(RTC_PERF_RTOFF_TIMEOUT);
+      _finishWrites(RTC_FAIL_CONFIG_EXIT);
+    }
+  }
+  if(_wrActive == 0 && _wrQueued != 0)
+  {
+    if(_lseWait)
+      _holdWrites();                        // no RTC clock yet, see serviceClock()
+    else if(RTC_CRL & RTOFF)
+      _startWrites();
+    else if(millis() - _wrStart > REG_TIMEOUT)
+    {
+      RTC_PERF_STOP(RTC_PERF_CONFIG_ENTER, _wrPerf);
+      RTC_PERF_COUNT(RTC_PERF_RTOFF_TIMEOUT);
+      _wrActive = _wrQueued;                // fail everything queued
+      _wrQueued = 0;
+      _wrBatch = _wrIssued;
+      _finishWrites(RTC_FAIL_CONFIG_ENTER);
+    }
+  }
+  if((_wrQueued | _wrActive) != 0)
+    retn = RTC_BUSY;
+  flags = _wrFlags;                         // status flags of completed writes
+  _wrFlags = 0;
+  __enable_irq();
+
+  if(flags != 0)
+    _statusFlagChange(flags, true);
+  return retn;
+}
+
+
+/******************************************************************************
+**    @brief State of a write queued by setEpochAsync(), setAlarmAsync() or
+**      setPrescalerAsync(). Polls serviceWrites() first.
+**    @param handle - returned by the xxxAsync() call.
+**    @returns RTC_BUSY, RTC_OK, the configuration error of the write, or
+**      RTC_INVALID_PARAM for handle 0 (rejected request).
+**    @note Queued writes to the same register are merged, the last value
+**      wins and all their handles complete together. Only the most recent
+**      failure is remembered.
+**
+\*****************************************************************************/
+uint8_t STM32LIBS_RTC::writeStatus(uint32_t handle)
+{
+  if(handle == 0 || handle > _wrIssued)
+    return RTC_INVALID_PARAM;
+  serviceWrites();
+  if(handle > _wrDone)
+    return RTC_BUSY;
+  if(handle >= _wrFailFirst && handle <= _wrFailLast)
+    return _wrFailStatus;
+  return RTC_OK;
+}
+
+
+/******************************************************************************
+**    @brief Queues a configuration write and starts it if RTOFF allows.
+**    @param reg - WRITE_CNT, WRITE_ALR or WRITE_PRL.
+**    @param arm - alarm only: enable the alarm interrupt when written.
+**    @returns write handle.
+**
+\*****************************************************************************/
+uint32_t STM32LIBS_RTC::_queueWrite(uint8_t reg, uint32_t value, bool arm)
+{
+  uint32_t handle;
+
+  __disable_irq();
+  if((_wrQueued | _wrActive) == 0)
+  {
+    _wrStart = millis();
+    RTC_PERF_MARK(_wrPerf);
+  }
+  _wrValue[reg] = value;
+  _wrQueued |= 1 << reg;
+  if(reg == WRITE_ALR)
+    _wrArm = arm;
+  handle = ++_wrIssued;
+  __enable_irq();
+
+  serviceWrites();
+  return handle;
+}
+
+
+/******************************************************************************
+**    @brief Writes the queued registers in one configuration window.
+**      Interrupts are masked by the caller.
+**
+\*****************************************************************************/
+void STM32LIBS_RTC::_startWrites(void)
+{
+  RTC_PERF_STOP(RTC_PERF_CONFIG_ENTER, _wrPerf);
+  _wrActive = _wrQueued;
+  _wrQueued = 0;
+  _wrBatch = _wrIssued;
+  _wrArmActive = _wrArm;
+  if(_wrActive & (1 << WRITE_ALR))
+    RTC_CRH &= ~RTC_ALRIE;                  // no match on a half written alarm
+
+  RTC_CRL |= CNF;                           // enter config mode
+  RTC_CRL &= ~RSF;                          // clear the reg sync flag
+  if(_wrActive & (1 << WRITE_CNT))
+  {
+    _wrLatch[WRITE_CNT] = _wrValue[WRITE_CNT];
+    RTC_CNTH = _wrLatch[WRITE_CNT] >> 16;
+    RTC_CNTL = _wrLatch[WRITE_CNT] & 0xFFFF;
+  }
+  if(_wrActive & (1 << WRITE_ALR))
+  {
+    _wrLatch[WRITE_ALR] = _wrValue[WRITE_ALR];
+    RTC_ALRH = _wrLatch[WRITE_ALR] >> 16;
+    RTC_ALRL = _wrLatch[WRITE_ALR] & 0xFFFF;
+  }
+  if(_wrActive & (1 << WRITE_PRL))
+  {
+    _wrLatch[WRITE_PRL] = _wrValue[WRITE_PRL];
+    RTC_PRLH = (_wrLatch[WRITE_PRL] >> 16) & 0x000F;
+    RTC_PRLL = _wrLatch[WRITE_PRL] & 0xFFFF;
+  }
+  RTC_CRL &= ~CNF;                          // exit config mode, the write starts
+  _wrStart = millis();
+  RTC_PERF_MARK(_wrPerf);
+}
+
+
+/******************************************************************************
+**    @brief Completes the queued writes while the LSE starts: the counter
+**      goes to the millis() clock, alarm & prescaler are written when
+**      serviceClock() enables the RTC. Interrupts are masked by the caller.
+**
+\*****************************************************************************/
+void STM32LIBS_RTC::_holdWrites(void)
+{
+  uint8_t reg;
+
+  _wrActive = _wrQueued;
+  _wrQueued = 0;
+  _wrBatch = _wrIssued;
+  _wrArmActive = _wrArm;
+  for(reg = 0; reg < WRITE_REGS; reg++)
+    if(_wrActive & (1 << reg))
+      _wrLatch[reg] = _wrValue[reg];
+  if(_wrActive & (1 << WRITE_CNT))
+  {
+    _softEpoch = _wrLatch[WRITE_CNT];
+    _softMs = millis();
+  }
+  _finishWrites(RTC_OK);
+  _heldFlags |= _wrFlags;                   // not in the backup domain until CNT is loaded
+  _wrFlags = 0;
+}
+
+
+/******************************************************************************
+**    @brief Retires the write in flight. Interrupts are masked by the caller.
+**    @param status - RTC_OK or the configuration error.
+**
+\*****************************************************************************/
+void STM32LIBS_RTC::_finishWrites(uint8_t status)
+{
+  if(status != RTC_OK)
+  {
+    _wrFailFirst = _wrDone + 1;
+    _wrFailLast = _wrBatch;
+    _wrFailStatus = status;
+  }
+  else
+  {
+    if(_wrActive & (1 << WRITE_CNT))
+    {
+      _dtCacheValid = 0;                    // time jumped, decode from scratch
+      _wrFlags |= BACKUP_TIME_SET_FLAG;
+    }
+    if(_wrActive & (1 << WRITE_PRL))
+    {
+      _prl = _wrLatch[WRITE_PRL];
+      _prlUser = true;
+    }
+    if(_wrActive & (1 << WRITE_ALR))
+    {
+      _alarmShadow = _wrLatch[WRITE_ALR];
+      if(_wrArmActive)
       {
-        RTC_CRL |= CNF;                  // enter config mode
-        RTC_CRL &= ~RSF;                 // clear the reg sync flag 
+        RTC_CRL &= ~RTC_CRL_ALARMF;         // clear RTC alarm pending flag
+        RTC_CRH |= RTC_ALRIE;               // enable RTC alarm interrupt
+        EXTI_IMR |= EXTI_LINE17;            // alarm interrupt on EXTI line 17
+        EXTI_RTSR |= EXTI_LINE17;           // rising edge trigger
+        _wrFlags |= BACKUP_ALARM_SET_FLAG;
       }
-      break;
+    }
+  }
+  _wrDone = _wrBatch;
+  _wrActive = 0;
+  _wrStart = millis();                      // the next write waits from here
+  RTC_PERF_MARK(_wrPerf);
+}
+
+
+/******************************************************************************
+**    @brief Polls until a queued write completes, interrupts stay enabled.
+**    @returns writeStatus() of the handle.
+**
+\*****************************************************************************/
+uint8_t STM32LIBS_RTC::_waitWrite(uint32_t handle)
+{
+  uint8_t retn;
 
-    case CONFIG_EXIT:
-      RTC_CRL &= ~CNF;                    // exit config mode
-      while((RTC_CRL & RTOFF_RSF) != RTOFF_RSF)    // wait for last write & reg sync
-      {       
-        if(millis() - tmo > REG_TIMEOUT)
-        {
-          retn = RTC_FAIL_CONFIG_EXIT;
-          break;
-        }
-      }    
-      break;         
-   }
-   return retn;
+  while((retn = writeStatus(handle)) == RTC_BUSY)
+    ;
+  return retn;
 }
 
 
@@ -745,10 +2059,15 @@ uint8_t STM32LIBS_RTC::rtc_config(uint8_t _config)
 \*****************************************************************************/
 void STM32LIBS_RTC::_statusFlagChange(uint16_t sbit, bool fset)
 {
+  uint16_t status = getBackup(0);
+
   if(fset)
-    _RTC_BackupRegs[0] |= sbit;
-  else   
-    _RTC_BackupRegs[0] &= ~sbit;
+    status |= sbit;
+  else
+  {
+    status &= ~sbit;
+    _heldFlags &= ~sbit;                    // nor set later by _enableClock()
+  }
 
-  setBackup(0, 1);
+  setBackup(0, status);                     // dropped if no flag changed
 }
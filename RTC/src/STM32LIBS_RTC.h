@@ -45,15 +45,35 @@
 #ifndef __STM32LIBS_RTC_H
 #define __STM32LIBS_RTC_H
 
+// -D RTC_NATIVE_INIT=1: register level init & interrupts (STM32LIBS_NATIVE.cpp)
+// instead of the core's RTC driver, see STM32LIBS_NATIVE.h
+#ifndef RTC_NATIVE_INIT
+#define RTC_NATIVE_INIT         0
+#endif
+
+#ifdef STM32LIBS_HOST_SIM
+#include "STM32LIBS_SIM.h"      // host build: simulated RTC & Arduino core shims
+#else
 #include "Arduino.h"
+#endif
 #include "STM32LIBS_REGS.h"
+#include "STM32LIBS_CALENDAR.h"
+#include "STM32LIBS_CRON.h"
+#include "STM32LIBS_TZ.h"
+#include "STM32LIBS_RING.h"
 #include <time.h>
+
+#ifndef STM32LIBS_HOST_SIM
 #include "stm32f1xx_hal.h"  
 
+#if RTC_NATIVE_INIT
+#include "STM32LIBS_NATIVE.h"
+#elif !defined(HAL_RTC_MODULE_ENABLED)
 // Check if RTC HAL enable in variants/board_name/stm32yzxx_hal_conf.h
-#ifndef HAL_RTC_MODULE_ENABLED
 #error "RTC configuration is missing. Check flag HAL_RTC_MODULE_ENABLED in variants/board_name/stm32yzxx_hal_conf.h"
 #endif
+#endif
+#include "STM32LIBS_PERF.h"
 
 
 const uint8_t monthDays[]={31,28,31,30,31,30,31,31,30,31,30,31}; 
@@ -94,6 +114,115 @@ enum {
 };
 
 
+// getDateTimeStr() layouts, 12 hour datetimes print AM / PM where marked
+enum {
+  DT_FORMAT_ISO8601,      // 2020-06-22T08:39:00
+  DT_FORMAT_RFC3339,      // 2020-06-22T08:39:00Z, 2020-06-22T08:39:00+02:00 with a UTC offset
+  DT_FORMAT_COMPACT,      // 20200622T083900 (ISO 8601 basic, file names)
+  DT_FORMAT_DATE,         // 2020-06-22
+  DT_FORMAT_TIME,         // 08:39:00 [AM]
+  DT_FORMAT_DATETIME,     // 2020-06-22 08:39:00 [AM]
+  DT_FORMAT_US,           // 06/22/2020 08:39:00 [AM]
+  DT_FORMAT_LONG,         // Monday, June 22, 2020 08:39:00 [AM]
+  DT_FORMATS,
+};
+#define RTC_DATETIME_STR_MAX    42      // longest string incl. terminator (DT_FORMAT_LONG)
+
+// backup register cache modes, see setBackupMode()
+enum {
+  BACKUP_WRITE_THROUGH,   // changed registers are written at once
+  BACKUP_WRITE_BACK,      // changed registers are written by flushBackup()
+};
+
+// backup data registers, DR1 (status flags) - DR42, begin() probes how many exist
+#define RTC_BACKUP_REGS         BKP_DR_MAX
+
+
+// RTC events posted from the interrupt handlers to the event queue
+enum {
+  RTC_EVENT_ALARM,
+  RTC_EVENT_SECOND,
+  RTC_EVENT_OVERFLOW,     // 32 bit counter wrapped
+  RTC_EVENT_TYPES,
+};
+#define RTC_EVENT_MASK(TYPE)    (1 << (TYPE))
+
+typedef struct
+{
+  uint32_t epoch;         // counter when the event was posted
+  uint32_t div;           // prescaler divider, counts down from PRL to 0 during the second
+  uint8_t type;           // RTC_EVENT_xxx
+} RTC_event_t;
+
+// sub-second time from the prescaler divider
+typedef struct
+{
+  uint32_t epoch;         // seconds since 1970
+  uint32_t ticks;         // RTCCLK ticks into the second, 0 to hz - 1
+  uint32_t hz;            // ticks per second (PRL + 1)
+} RTC_timestamp_t;
+
+// consistent view of the RTC registers, see getSnapshot()
+typedef struct
+{
+  uint32_t epoch;         // counter
+  uint32_t div;           // prescaler divider, counts down from prl to 0
+  uint32_t prl;           // prescaler reload
+  uint32_t alarm;         // alarm, as last written (ALR is write only)
+  uint16_t crl;           // flags: SECF, ALRF, OWF, RSF, CNF, RTOFF
+  uint16_t crh;           // interrupt enables: SECIE, ALRIE, OWIE
+} RTC_snapshot_t;
+
+// begin() can set up the RTC interrupts without RTC_init(): the core's HAL
+// handle is reachable (RTC_GetHandle(), STM32duino 1.9.0+) or not used
+#if RTC_NATIVE_INIT || defined(STM32LIBS_HOST_SIM) || (defined(STM32_CORE_VERSION) && (STM32_CORE_VERSION >= 0x01090000))
+#define RTC_INIT_OPTIONAL       1
+#else
+#define RTC_INIT_OPTIONAL       0
+#endif
+
+// begin() skips the clock & HAL init when the RTC kept running from Vbat,
+// -D RTC_WARM_START=0 always runs them. Off on older cores.
+#ifndef RTC_WARM_START
+#define RTC_WARM_START          RTC_INIT_OPTIONAL
+#endif
+#if RTC_WARM_START && !RTC_INIT_OPTIONAL
+#error "RTC_WARM_START needs STM32duino core 1.9.0 or later (RTC_GetHandle()) or RTC_NATIVE_INIT"
+#endif
+
+// cold start: begin() returns while the LSE crystal starts, serviceClock()
+// enables the RTC once LSERDY is set or falls back to LSI after
+// RTC_LSE_TIMEOUT ms. Call serviceClock() from loop(): until it switches
+// the time runs on millis() and no alarm fires.
+// -D RTC_LSE_ASYNC=0 waits in RTC_init() instead.
+// Off on older cores, like RTC_WARM_START.
+#ifndef RTC_LSE_ASYNC
+#define RTC_LSE_ASYNC           RTC_INIT_OPTIONAL
+#endif
+#if RTC_LSE_ASYNC && !RTC_INIT_OPTIONAL
+#error "RTC_LSE_ASYNC needs STM32duino core 1.9.0 or later (RTC_GetHandle()) or RTC_NATIVE_INIT"
+#endif
+#ifndef RTC_LSE_TIMEOUT
+#define RTC_LSE_TIMEOUT         5000    // ms, the HAL's LSE_STARTUP_TIMEOUT
+#endif
+#ifndef RTC_LSI_CAL_MS
+#define RTC_LSI_CAL_MS          1000    // LSI fallback: prescaler measured against micros() this long
+#endif
+
+// alarm interrupt priority, as in the core's rtc.h
+#ifndef RTC_IRQ_PRIO
+#define RTC_IRQ_PRIO            2
+#endif
+#ifndef RTC_IRQ_SUBPRIO
+#define RTC_IRQ_SUBPRIO         0
+#endif
+
+// event queue length, power of 2, override with -D RTC_EVENT_QUEUE_SIZE=n
+#ifndef RTC_EVENT_QUEUE_SIZE
+#define RTC_EVENT_QUEUE_SIZE    16
+#endif
+
+
 // leap year calculator expects year argument as years offset from 1970
 #define IS_LEAP_YEAR(Y)   ( ((1970+(Y))>0) && !((1970+(Y))%4) && ( ((1970+(Y))%100) || !((1970+(Y))%400) ) )
 
@@ -136,6 +265,8 @@ class STM32LIBS_RTC {
     #define BACKUP_TIME_SET_FLAG      0x0001
     #define BACKUP_ALARM_SET_FLAG     0x0002
     #define BACKUP_CONFIGURED_FLAG    0x0004
+    #define BACKUP_REGS_SHIFT         8         // probed register count, bits 8 - 13
+    #define BACKUP_REGS_MASK          0x3F00
     
 
     // misc status & error codes
@@ -148,6 +279,7 @@ class STM32LIBS_RTC {
       RTC_FAIL_CONFIG_EXIT,
       RTC_TIMEOUT,
       RTC_INVALID_PARAM,
+      RTC_BUSY,             // asynchronous write still in progress
     };
 
     #define REG_TIMEOUT 2000
@@ -173,44 +305,91 @@ class STM32LIBS_RTC {
     void attachInterrupt(voidFuncPtr callback, void *data = nullptr);
     void detachInterrupt(void);
 
+    // ISR -> loop() event queue
+    void enableEvents(uint8_t mask);        // RTC_EVENT_MASK(RTC_EVENT_xxx) | ..., 0 = off
+    uint16_t readEvents(RTC_event_t *events, uint16_t max);
+    uint16_t eventsPending(void) { return _events.size(); }
+    uint32_t getEventOverruns(uint8_t type) { return (type < RTC_EVENT_TYPES) ? _eventOverruns[type] : 0; }
+
     // date/time functions
-    void setDateTime(RTC_datetime_t *datetime);
+    uint8_t setDateTime(RTC_datetime_t *datetime);
+    uint8_t setDateTimeStr(const char *str, uint8_t len, uint8_t *errPos = nullptr);
     void getDateTime(RTC_datetime_t *_datetime = nullptr, uint8_t hour_format = RTC_HOUR_FORMAT_UNDEF);
 
+    // local time, see STM32LIBS_TZ.h
+    bool setTimeZone(const char *spec);     // POSIX TZ string, nullptr = UTC
+    void getLocalDateTime(RTC_datetime_t *_datetime = nullptr, uint8_t hour_format = RTC_HOUR_FORMAT_UNDEF);
+    int32_t getUtcOffset(bool *isDst = nullptr);
+
     // conversion functions
     uint32_t getEpoch(void);
     void setEpoch(uint32_t ts);
+    uint64_t getEpochMillis(void);
+    void getTimestamp(RTC_timestamp_t *ts);
+    void getSnapshot(RTC_snapshot_t *snap);
+    uint32_t setEpochAsync(uint32_t ts);    // returns a write handle, see serviceWrites()
     uint32_t dateTimeToEpoch(RTC_datetime_t *datetime);
+    uint8_t dateTimeToEpoch(RTC_datetime_t *datetime, uint32_t *_epoch);
+    uint8_t parseDateTimeStr(const char *str, uint8_t len, uint32_t *_epoch, uint8_t *errPos = nullptr);
     void epochToDateTime(RTC_datetime_t *datetime, uint32_t _epoch);
 
     // alarm functions
     uint8_t setAlarmDateTime(RTC_datetime_t *datetime);
     uint8_t setAlarmFromEpoch(uint32_t alarm_epoch);
+    uint32_t setAlarmAsync(uint32_t alarm_epoch);
     void disableAlarm(void);
 
+    // recurring alarm, re-armed after each alarm until disableAlarm()
+    uint8_t setCronAlarm(const RTC_cron_t *cron);
+    bool isCronAlarm(void) { return _cronActive; }
+
     // char string functions
     char *getWeekdayName(uint8_t DOW);      
     char *getMonthName(uint8_t month);
-    char *getDateTimeStr(uint8_t format);    
+    uint8_t getDateTimeStr(char *buf, uint8_t size, const RTC_datetime_t *datetime, uint8_t format,
+                           int32_t utcOffset = 0);
 
     // primitive Functions 
     void getPrediv(int8_t *predivA, int16_t *predivS);
     void setPrediv(int8_t predivA, int16_t predivS);
     Source_Clock getClockSource(void);
     void setClockSource(Source_Clock source);
+    uint32_t setPrescalerAsync(uint32_t prl);
+    uint8_t serviceClock(void);             // poll from loop() after begin(): RTC_BUSY, RTC_OK (LSE) or RTC_FAIL_LSERDY (LSI)
+
+    // asynchronous configuration mode writes (counter, alarm, prescaler)
+    uint8_t serviceWrites(void);            // poll from loop(), RTC_BUSY while writes are pending
+    uint8_t writeStatus(uint32_t handle);   // RTC_BUSY, RTC_OK or the error of the write
 
     // user backup register functions - simulates EEPROM
     void eepromWrite(uint16_t data_array[], uint8_t indx, uint8_t len);
     void eepromRead(uint16_t data_array[], uint8_t indx, uint8_t len);
+    uint8_t eepromSize(void) { return _bkpCount - 1; }       // user registers, 9 or 41
+    uint8_t getBackupRegCount(void) { return _bkpCount; }   // implemented registers, 10 or 42
+
+    // backup register shadow copy
+    void setBackupMode(uint8_t mode);       // BACKUP_WRITE_THROUGH (default) or BACKUP_WRITE_BACK
+    uint8_t flushBackup(void);              // write the dirty registers, returns the number written
+    void getBackupStats(uint32_t *reads, uint32_t *writes, uint32_t *readsSaved, uint32_t *writesSaved)
+    {
+      if(reads != nullptr)
+        *reads = _bkpReads;
+      if(writes != nullptr)
+        *writes = _bkpWrites;
+      if(readsSaved != nullptr)
+        *readsSaved = _bkpReadsSaved;
+      if(writesSaved != nullptr)
+        *writesSaved = _bkpWritesSaved;
+    }
 
     // Kept for compatibility: use STM32LowPower library.
     void standbyMode();
 
-    // misc debug
-    volatile uint32_t debug1;
-    volatile uint32_t debug2;
-    volatile uint32_t debug3;
-    volatile uint32_t debug4;
+    // performance counters, -D RTC_PERF=1, see STM32LIBS_PERF.h
+    bool getPerf(uint8_t id, RTC_perf_t *perf) { return perfGet(id, perf); }
+    void resetPerf(void) { perfReset(); }
+    uint16_t dumpPerf(uint8_t *buf, uint16_t size) { return perfDump(buf, size); }
+    uint32_t getPerfTickHz(void) { return perfTickHz(); }
 
     bool isConfigured(void)
     {
@@ -218,31 +397,164 @@ class STM32LIBS_RTC {
     }
     bool isAlarmEnabled(void)
     {
-      return ((_RTC_BackupRegs[0] & BACKUP_ALARM_SET_FLAG) > 0);
+      return (((_RTC_BackupRegs[0] | _heldFlags) & BACKUP_ALARM_SET_FLAG) > 0);
     }
     bool isTimeSet(void)
     {
-      return ((_RTC_BackupRegs[0] & BACKUP_TIME_SET_FLAG) > 0);
+      return (((_RTC_BackupRegs[0] | _heldFlags) & BACKUP_TIME_SET_FLAG) > 0);
+    }
+
+    // duration of the last begin(), warm = clock & HAL init skipped
+    void getBeginStats(uint32_t *us, bool *warm)
+    {
+      if(us != nullptr)
+        *us = _beginUs;
+      if(warm != nullptr)
+        *warm = _beginWarm;
+    }
+
+    // getDateTime() decode cache statistics
+    void getDecodeStats(uint32_t *hits, uint32_t *misses)
+    {
+      if(hits != nullptr)
+        *hits = _dtCacheHits;
+      if(misses != nullptr)
+        *misses = _dtCacheMisses;
     }
 
 
     friend class STM32LowPower;
 
   private:
-    STM32LIBS_RTC(void): _clockSource(LSI_CLOCK) {}
+    STM32LIBS_RTC(void): _clockSource(LSI_CLOCK), _prl(LSE_VALUE - 1), _prlUser(false), _alarmShadow(0),
+      _wrQueued(0), _wrActive(0), _wrArm(false), _wrArmActive(false), _wrIssued(0), _wrBatch(0), _wrDone(0),
+      _wrFailFirst(0), _wrFailLast(0), _wrFailStatus(RTC_OK), _wrStart(0), _wrFlags(0), _RTC_BackupRegs(), _bkpCount(10), _bkpValid(0), _bkpDirty(0),
+      _bkpMode(BACKUP_WRITE_THROUGH), _bkpReads(0), _bkpWrites(0), _bkpReadsSaved(0), _bkpWritesSaved(0),
+      _dtCacheValid(0), _dtCacheHits(0), _dtCacheMisses(0),
+      _tz(), _beginUs(0), _beginWarm(false), _rsfWait(false),
+      _clockState(CLOCK_READY), _clockStatus(RTC_OK), _lseWait(false), _lseStart(0), _softEpoch(0), _softMs(0), _heldFlags(0),
+      _calCnt(0), _calDiv(0), _calUs(0), _calWrites(0), _alarmCallback(nullptr), _alarmData(nullptr), _cronActive(false), _eventMask(0), _eventOverruns() {}
   
     Source_Clock _clockSource;
-    uint8_t rtc_config(uint8_t _config);
+    uint32_t _prl;                          // PRL is write only, value loaded by RTC_init()
+    bool _prlUser;                          // set by setPrediv()
+    uint32_t _alarmShadow;                  // ALR is write only, last value written
+    void _cachePrescaler(void);
+    void _readCounter(uint32_t *cnt, uint32_t *div);
+
+    // configuration write engine: queued values are written in one CNF
+    // window once RTOFF is set, completion is seen by a later poll
+    enum {
+      WRITE_CNT,
+      WRITE_ALR,
+      WRITE_PRL,
+      WRITE_REGS,
+    };
+    uint32_t _queueWrite(uint8_t reg, uint32_t value, bool arm);
+    void _startWrites(void);
+    void _finishWrites(uint8_t status);
+    uint8_t _waitWrite(uint32_t handle);
+    uint32_t _wrValue[WRITE_REGS];          // queued values
+    uint32_t _wrLatch[WRITE_REGS];          // values of the write in flight
+    uint8_t _wrQueued;                      // 1 << WRITE_xxx, waiting for RTOFF
+    uint8_t _wrActive;                      // 1 << WRITE_xxx, written, waiting for RTOFF & RSF
+    bool _wrArm;                            // queued alarm enables the alarm interrupt
+    bool _wrArmActive;
+    uint32_t _wrIssued;                     // last handle given out
+    uint32_t _wrBatch;                      // last handle in the write in flight
+    uint32_t _wrDone;                       // handles up to here are complete
+    uint32_t _wrFailFirst, _wrFailLast;     // handles of the last failed write
+    uint8_t _wrFailStatus;
+    uint32_t _wrStart;                      // millis() the engine started waiting
+#if RTC_PERF
+    uint32_t _wrPerf;                       // perfNow() the engine started waiting
+#endif
+    uint16_t _wrFlags;                      // backup status flags to set, outside the critical section
     void configForLowPower(Source_Clock source);
     void _statusFlagChange(uint16_t sbit, bool fset);
 
     // private backup functions
-    void setBackup(uint8_t indx, uint8_t len);
-    void getBackup(uint8_t indx, uint8_t len);
+    void setBackup(uint8_t indx, uint16_t value);
+    uint16_t getBackup(uint8_t indx);
     void clearBackup(void);
+    bool _bkpImplemented(uint8_t indx);
+    uint8_t _probeBackup(void);
 
     uint8_t _RTC_Status;
-    uint16_t _RTC_BackupRegs[11];
+    uint16_t _RTC_BackupRegs[RTC_BACKUP_REGS];   // shadow copy
+    uint8_t _bkpCount;                      // implemented registers
+    uint64_t _bkpValid;                     // bit n: register n read or written since begin()
+    uint64_t _bkpDirty;                     // bit n: register n not written to the bus yet
+    uint8_t _bkpMode;
+    uint32_t _bkpReads;                     // bus accesses
+    uint32_t _bkpWrites;
+    uint32_t _bkpReadsSaved;                // served by / dropped in the shadow copy
+    uint32_t _bkpWritesSaved;
+
+    // last datetime decoded by getDateTime() / getLocalDateTime() (24 hour time)
+    enum {
+      DT_CACHE_UTC,
+      DT_CACHE_LOCAL,
+      DT_CACHES,
+    };
+    void _decodeDateTime(RTC_datetime_t *_datetime, uint8_t hour_format, uint32_t _epoch, uint8_t cache);
+    void _advanceDateTime(RTC_datetime_t *datetime, uint32_t secs);
+    RTC_datetime_t _dtCache[DT_CACHES];
+    uint8_t _dtCacheValid;                  // bit n: _dtCache[n] valid
+    uint32_t _dtCacheHits;
+    uint32_t _dtCacheMisses;
+    RTC_tz_t _tz;
+
+    // warm start, see begin()
+    bool _warmStartable(void);
+    void _warmStart(void);
+    void _bindInterrupts(void);
+    uint32_t _beginUs;
+    bool _beginWarm;
+    bool _rsfWait;                          // RSF not seen since the reset, registers not synced yet
+
+    // cold start, see serviceClock(). While the LSE starts the RTC has no
+    // clock: the counter is kept from millis(), writes are held for the switch
+    enum {
+      CLOCK_READY,
+      CLOCK_LSE_WAIT,                       // LSEON set, waiting for LSERDY
+      CLOCK_LSI_WAIT,                       // LSE timed out, LSION set, waiting for LSIRDY
+      CLOCK_LSI_CAL,                        // fell back to LSI, measuring it
+    };
+    void _coldStart(bool resetRTC);
+    void _enableClock(uint32_t rtcsel, uint32_t prl);
+    void _startCal(void);
+    void _finishCal(void);
+    void _holdWrites(void);
+    bool _syncCounter(uint32_t *cnt, uint32_t *div);
+    uint8_t _clockState;
+    uint8_t _clockStatus;
+    bool _lseWait;                          // no RTC clock yet, counter from millis()
+    uint32_t _lseStart;                     // millis() LSEON, then LSION was set
+    uint32_t _softEpoch;                    // counter at _softMs
+    uint32_t _softMs;
+    uint16_t _heldFlags;                    // status flags of held writes, set by _enableClock()
+    uint32_t _calCnt, _calDiv, _calUs;      // LSI calibration start
+    uint32_t _calWrites;                    // _wrIssued at the start, a write restarts the measurement
+
+    // user alarm callback, called through _alarmISR while a cron alarm
+    // or alarm events are enabled
+    static void _alarmISR(void *data);
+    bool _alarmViaISR(void) { return RTC_PERF || _cronActive || (_eventMask & RTC_EVENT_MASK(RTC_EVENT_ALARM)); }
+    static void _secondsISR(void *data);
+    void _bindAlarm(void);
+    uint8_t _armCron(uint32_t *handle);
+    voidFuncPtr _alarmCallback;
+    void *_alarmData;
+    RTC_cron_t _cron;
+    bool _cronActive;
+
+    // event queue, producers are the RTC interrupts (same NVIC priority)
+    friend void HAL_RTCEx_RTCEventErrorCallback(RTC_HandleTypeDef *hrtc);
+    void _postEvent(uint8_t type);
+    STM32LIBS_RING<RTC_event_t, RTC_EVENT_QUEUE_SIZE> _events;
+    volatile uint8_t _eventMask;
+    volatile uint32_t _eventOverruns[RTC_EVENT_TYPES];
 
 };
 
@@ -0,0 +1,151 @@
+/******************************************************************************
+  * @file    STM32LIBS_SCHEMA.h
+  * @brief   Compile time bit field layouts in the RTC backup registers
+  *
+  * Small fields (enums, booleans, 5 bit counters) stored one per eeprom
+  * register use up the 9 user registers quickly. A schema lists the field
+  * widths once; offsets, masks and the number of registers are constants,
+  * so get<>() / set<>() compile to shifts and masks on the 1 - 3 registers
+  * the field occupies, nothing else is read or written. A schema that does
+  * not fit in the eeprom registers fails to compile.
+  *
+  *   enum { MODE, ENABLED, RETRIES, LEVEL };                 // field indexes
+  *   typedef STM32LIBS_SCHEMA<0, 3, 1, 5, 12> Settings;      // eeprom register 0, 21 bits -> 2 registers
+  *
+  *   Settings::set<RETRIES>(7);
+  *   uint32_t level = Settings::get<LEVEL>();
+  *
+  * Fields are packed MSB first from the first register, in the order listed.
+  * Registers go through the backup register shadow copy (reads after the
+  * first come from RAM, unchanged writes are dropped). Don't let a schema
+  * overlap STM32LIBS_KV or other eepromWrite() users.
+  ******************************************************************************
+  */
+
+#ifndef __STM32LIBS_SCHEMA_H
+#define __STM32LIBS_SCHEMA_H
+
+#include "STM32LIBS_RTC.h"
+
+// eeprom registers schemas may use, 9 on every part. High density parts
+// have 41, build with -D RTC_EEPROM_REGS=41 to use them.
+#ifndef RTC_EEPROM_REGS
+#define RTC_EEPROM_REGS         9
+#endif
+
+static_assert(RTC_EEPROM_REGS >= 1 && RTC_EEPROM_REGS <= BKP_DR_MAX - 1, "RTC_EEPROM_REGS must be 1 - 41");
+
+template<uint8_t FIRST, uint8_t... WIDTHS>
+class STM32LIBS_SCHEMA {
+  private:
+    static constexpr uint8_t _width(uint8_t i)
+    {
+      const uint8_t w[] = {WIDTHS...};
+      return w[i];
+    }
+    static constexpr uint16_t _offset(uint8_t i)
+    {
+      const uint8_t w[] = {WIDTHS...};
+      uint16_t off = 0;
+
+      for(uint8_t k = 0; k < i; k++)
+        off += w[k];
+      return off;
+    }
+    static constexpr bool _widthsValid(void)
+    {
+      const uint8_t w[] = {WIDTHS...};
+
+      for(uint8_t k = 0; k < sizeof...(WIDTHS); k++)
+        if(w[k] < 1 || w[k] > 32)
+          return false;
+      return true;
+    }
+
+  public:
+    static constexpr uint8_t fields = sizeof...(WIDTHS);
+    static constexpr uint16_t bits = _offset(sizeof...(WIDTHS));
+    static constexpr uint8_t regs = (bits + 15) / 16;
+
+    static_assert(sizeof...(WIDTHS) > 0, "schema has no fields");
+    static_assert(_widthsValid(), "schema field widths must be 1 - 32 bits");
+    static_assert(FIRST + regs <= RTC_EEPROM_REGS, "schema does not fit in the eeprom registers (RTC_EEPROM_REGS)");
+
+    // one field, reads / writes only the registers it occupies
+    template<uint8_t I>
+    static uint32_t get(void)
+    {
+      static_assert(I < fields, "no such schema field");
+      uint16_t buf[_Field<I>::span];
+
+      STM32LIBS_RTC::getInstance().eepromRead(buf, FIRST + _Field<I>::reg, _Field<I>::span);
+      return _extract<I>(_load(buf, _Field<I>::span));
+    }
+
+    template<uint8_t I>
+    static void set(uint32_t value)
+    {
+      static_assert(I < fields, "no such schema field");
+      uint16_t buf[_Field<I>::span];
+      STM32LIBS_RTC &rtc = STM32LIBS_RTC::getInstance();
+
+      rtc.eepromRead(buf, FIRST + _Field<I>::reg, _Field<I>::span);
+      _store(buf, _Field<I>::span, _insert<I>(_load(buf, _Field<I>::span), value));
+      rtc.eepromWrite(buf, FIRST + _Field<I>::reg, _Field<I>::span);
+    }
+
+    // whole record in a regs long buffer: read(), several unpack / pack, write()
+    static void read(uint16_t *buf) { STM32LIBS_RTC::getInstance().eepromRead(buf, FIRST, regs); }
+    static void write(const uint16_t *buf) { STM32LIBS_RTC::getInstance().eepromWrite((uint16_t *)buf, FIRST, regs); }
+
+    template<uint8_t I>
+    static uint32_t unpack(const uint16_t *buf)
+    {
+      static_assert(I < fields, "no such schema field");
+      return _extract<I>(_load(buf + _Field<I>::reg, _Field<I>::span));
+    }
+
+    template<uint8_t I>
+    static void pack(uint16_t *buf, uint32_t value)
+    {
+      static_assert(I < fields, "no such schema field");
+      _store(buf + _Field<I>::reg, _Field<I>::span, _insert<I>(_load(buf + _Field<I>::reg, _Field<I>::span), value));
+    }
+
+  private:
+    // register, registers spanned & shift of field I in the spanned registers
+    template<uint8_t I>
+    struct _Field {
+      static constexpr uint8_t width = _width(I);
+      static constexpr uint8_t reg = _offset(I) / 16;
+      static constexpr uint8_t span = (_offset(I) % 16 + _width(I) + 15) / 16;
+      static constexpr uint8_t shift = span * 16 - _offset(I) % 16 - _width(I);
+      static constexpr uint64_t mask = ((1ULL << _width(I)) - 1) << shift;
+    };
+
+    static uint64_t _load(const uint16_t *p, uint8_t n)
+    {
+      uint64_t acc = 0;
+
+      for(uint8_t i = 0; i < n; i++)
+        acc = (acc << 16) | p[i];
+      return acc;
+    }
+    static void _store(uint16_t *p, uint8_t n, uint64_t acc)
+    {
+      for(uint8_t i = n; i > 0; i--, acc >>= 16)
+        p[i - 1] = (uint16_t)acc;
+    }
+    template<uint8_t I>
+    static uint32_t _extract(uint64_t acc)
+    {
+      return (uint32_t)((acc & _Field<I>::mask) >> _Field<I>::shift);
+    }
+    template<uint8_t I>
+    static uint64_t _insert(uint64_t acc, uint32_t value)
+    {
+      return (acc & ~_Field<I>::mask) | (((uint64_t)value << _Field<I>::shift) & _Field<I>::mask);
+    }
+};
+
+#endif // __STM32LIBS_SCHEMA_H
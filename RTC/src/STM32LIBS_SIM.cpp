@@ -0,0 +1,765 @@
+/******************************************************************************
+  * @file    STM32LIBS_SIM.cpp
+  * @brief   Host simulation of the STM32F10x RTC peripheral for STM32LIBS_RTC
+  *
+  * Models the parts of the chip the library touches:
+  *   - RCC_BDCR / RCC_CSR clock selection, LSE startup, backup domain reset
+  *   - PWR_CR DBP backup domain write protection
+  *   - RTC prescaler (PRL/DIV), 32 bit counter, alarm, CRL flags and the
+  *     CNF / RTOFF / RSF configuration handshake (writes land 3 RTCCLK later)
+  *   - backup data registers DR1 - DR42 (10 on low/medium density parts)
+  *   - EXTI line 17 and the alarm / seconds interrupts
+  *
+  * Only compiled when STM32LIBS_HOST_SIM is defined.
+  ******************************************************************************
+  */
+
+#ifdef STM32LIBS_HOST_SIM
+
+#include "STM32LIBS_SIM.h"
+#include "STM32LIBS_REGS.h"
+#include <map>
+#include <chrono>
+
+#define SIM_NS_PER_SEC      1000000000ULL
+#define SIM_WRITE_TICKS     3               // RTCCLK cycles for a config write to complete
+#define SIM_BKPEN_PWREN     0x18000000UL
+#define SIM_BDCR_WMASK      (LSEON | LSEBYP | RTCSEL_MASK | RTC_ENAB | BKP_RESET)
+
+#define LATCH_PRL           0x01
+#define LATCH_CNT           0x02
+#define LATCH_ALR           0x04
+
+// registers without a model behave as plain memory
+static std::map<uint32_t, uint32_t> &simMemory(void)
+{
+  static std::map<uint32_t, uint32_t> mem;
+  return mem;
+}
+
+static RTC_HandleTypeDef simRtcHandle;
+
+#if !RTC_NATIVE_INIT
+static int8_t simPredivA = -1;
+#endif
+static int16_t simPredivS = -1;
+
+static uint64_t hostNs(void)
+{
+  return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+           std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+/******************************************************************************
+**    Power on reset, Vbat not connected.
+\*****************************************************************************/
+void STM32LIBS_SIM::reset(void)
+{
+  _ns = 0;
+  _tickNs = 0;
+  _ticks = 0;
+  _busNs = 100;                 // ~ 7 APB1 cycles per RTC register access
+  _speed = 0;
+  _hostNs = 0;
+  _lseStartupNs = 0;
+  _lseFails = false;
+  _lsiHz = SIM_LSI_HZ;
+  _bkpCount = 10;
+  regReads = regWrites = alarmIrqs = secondIrqs = 0;
+  irqOffMaxNs = 0;
+  alarmIsrMaxNs = 0;
+  halUnbound = 0;
+  simMemory().clear();
+  resetBackupDomain();
+  powerCycle(true);
+}
+
+
+/******************************************************************************
+**    Backup domain reset (BDRST or Vbat lost).
+\*****************************************************************************/
+void STM32LIBS_SIM::resetBackupDomain(void)
+{
+  _bdcr = 0;
+  _lseReadyNs = 0;
+  _prl = 0x8000;
+  _div = 0x8000;
+  _cnt = 0;
+  _alr = 0xFFFFFFFF;
+  _prlLatch = _prl;
+  _cntLatch = _cnt;
+  _alrLatch = _alr;
+  _latched = 0;
+  _writeDoneTick = 0;
+  _crl = RTOFF;
+  _crh = 0;
+  _rsfPending = false;
+  memset(_bkp, 0, sizeof(_bkp));
+}
+
+
+/******************************************************************************
+**    System reset. The backup domain (RTC core, BDCR, backup registers) keeps
+**    running if Vbat is powered.
+\*****************************************************************************/
+void STM32LIBS_SIM::powerCycle(bool vbat)
+{
+  if(!vbat)
+    resetBackupDomain();
+
+  _apb1enr = 0;
+  _csr = 0;
+  _pwrCr = 0;
+  _crh = 0;                     // APB interface regs are reset, flags are lost
+  _crl = (_writeDoneTick == 0) ? RTOFF : 0;
+  _rsfPending = true;           // RSF set again after the next RTCCLK edge
+  _extiImr = _extiEmr = _extiRtsr = _extiFtsr = _extiPr = 0;
+  _irqMask = false;
+  _inIrq = false;
+  _alarmIrqPending = false;
+  _secondIrqPending = false;
+  _nvicAlarm = false;
+  _nvicSeconds = false;
+  memset(&simRtcHandle, 0, sizeof(simRtcHandle));
+  _alarmCb = nullptr;
+  _alarmData = nullptr;
+  _secondsCb = nullptr;
+}
+
+
+void STM32LIBS_SIM::setBackupRegCount(uint8_t count)
+{
+  _bkpCount = (count > SIM_BKP_REGS_MAX) ? SIM_BKP_REGS_MAX : count;
+}
+
+
+void STM32LIBS_SIM::setRealTime(double speed)
+{
+  _speed = speed;
+  _hostNs = hostNs();
+}
+
+
+uint32_t STM32LIBS_SIM::clockHz(void)
+{
+  switch(_bdcr & RTCSEL_MASK)
+  {
+    case RTCSEL_LSE: return SIM_LSE_HZ;
+    case RTCSEL_LSI: return _lsiHz;
+    case RTCSEL_HSE: return SIM_HSE_HZ;
+  }
+  return 0;
+}
+
+
+bool STM32LIBS_SIM::clockRunning(void)
+{
+  if((_bdcr & RTC_ENAB) == 0)
+    return false;
+
+  switch(_bdcr & RTCSEL_MASK)
+  {
+    case RTCSEL_LSE: return (_bdcr & LSEON) && !_lseFails && _ns >= _lseReadyNs;
+    case RTCSEL_LSI: return (_csr & LSION) != 0;
+    case RTCSEL_HSE: return true;
+  }
+  return false;
+}
+
+
+/******************************************************************************
+**    Advances the virtual clock. RTCCLK ticks are only counted while the
+**    selected oscillator runs, so the interval is split at the LSE ready time.
+\*****************************************************************************/
+void STM32LIBS_SIM::advanceNs(uint64_t ns)
+{
+  uint64_t step, t;
+
+  while(ns > 0)
+  {
+    step = (ns > SIM_NS_PER_SEC) ? SIM_NS_PER_SEC : ns;
+    if((_bdcr & RTCSEL_MASK) == RTCSEL_LSE && (_bdcr & LSEON) && !_lseFails &&
+       _ns < _lseReadyNs && _ns + step > _lseReadyNs)
+      step = _lseReadyNs - _ns;
+
+    _ns += step;
+    ns -= step;
+    if(clockRunning())
+    {
+      _tickNs += step * clockHz();
+      t = _tickNs / SIM_NS_PER_SEC;
+      _tickNs -= t * SIM_NS_PER_SEC;         // before tick(), handlers may advance again
+      tick(t);
+    }
+  }
+  deliverIrqs();
+}
+
+
+void STM32LIBS_SIM::advanceTicks(uint64_t ticks)
+{
+  uint32_t hz = clockHz();
+
+  if(hz == 0 || !clockRunning())
+    return;
+  _ns += (ticks * SIM_NS_PER_SEC) / hz;
+  tick(ticks);
+  deliverIrqs();
+}
+
+
+void STM32LIBS_SIM::advanceSeconds(uint32_t secs)
+{
+  if(clockRunning())
+    advanceTicks((uint64_t)secs * (_prl + 1));
+  else
+    advanceNs((uint64_t)secs * SIM_NS_PER_SEC);
+}
+
+
+/******************************************************************************
+**    Runs the RTC core for a number of RTCCLK ticks: prescaler, counter, alarm,
+**    pending configuration writes and RSF.
+\*****************************************************************************/
+void STM32LIBS_SIM::tick(uint64_t ticks)
+{
+  uint64_t t, reloads, period, limit;
+  uint32_t oldCnt;
+
+  while(ticks > 0)
+  {
+    // run up to the next event that software could observe: write completion,
+    // alarm match or (with SECIE) the next second, then take the interrupts
+    period = (uint64_t)_prl + 1;
+    t = ticks;
+    if(_writeDoneTick != 0 && _writeDoneTick - _ticks < t)
+      t = _writeDoneTick - _ticks;
+    limit = (uint64_t)_div + 1;
+    if((_crh & RTC_SECIE) == 0)
+      limit += (uint64_t)(uint32_t)(_alr - _cnt - 1) * period;
+    if(limit < t)
+      t = limit;
+    if(t == 0)
+      t = 1;
+    _ticks += t;
+    ticks -= t;
+
+    if(_rsfPending && (_crl & CNF) == 0)
+    {
+      _crl |= RSF;
+      _rsfPending = false;
+    }
+
+    // prescaler counts down from PRL, one TR_CLK (second) per PRL + 1 ticks
+    if(t <= _div)
+    {
+      _div -= (uint32_t)t;
+      reloads = 0;
+    }
+    else
+    {
+      t -= (uint64_t)_div + 1;
+      reloads = 1 + t / period;
+      _div = _prl - (uint32_t)(t % period);
+    }
+
+    if(reloads > 0)
+    {
+      oldCnt = _cnt;
+      if((uint64_t)(uint32_t)(_alr - oldCnt - 1) < reloads)
+      {
+        _crl |= RTC_CRL_ALARMF;
+        if(_extiRtsr & EXTI_LINE17)
+          _extiPr |= EXTI_LINE17;             // rising edge on line 17
+        if((_extiPr & _extiImr) & EXTI_LINE17)
+          _alarmIrqPending = true;
+      }
+      if(reloads > (uint64_t)(0xFFFFFFFFUL - oldCnt))
+        _crl |= RTC_CRL_OWF;
+      _cnt = oldCnt + (uint32_t)reloads;
+      _crl |= RTC_CRL_SECF;
+      if(_crh & RTC_SECIE)
+        _secondIrqPending = true;
+    }
+
+    if(_writeDoneTick != 0 && _ticks >= _writeDoneTick)
+    {
+      commitWrites();
+      _writeDoneTick = 0;
+      _crl |= RTOFF;
+    }
+    deliverIrqs();
+  }
+}
+
+
+void STM32LIBS_SIM::commitWrites(void)
+{
+  if(_latched & LATCH_PRL)
+  {
+    _prl = _prlLatch & 0xFFFFF;
+    _div = _prl;
+  }
+  if(_latched & LATCH_CNT)
+    _cnt = _cntLatch;
+  if(_latched & LATCH_ALR)
+    _alr = _alrLatch;
+  _latched = 0;
+}
+
+
+/******************************************************************************
+**    Runs pending interrupt handlers the way the STM32duino core does:
+**    RTC_Alarm_IRQHandler (EXTI 17) and RTC_IRQHandler (seconds).
+\*****************************************************************************/
+void STM32LIBS_SIM::deliverIrqs(void)
+{
+  uint64_t start;
+
+  if(_irqMask || _inIrq)
+    return;
+
+  _inIrq = true;
+  while((_alarmIrqPending && _nvicAlarm) || (_secondIrqPending && _nvicSeconds))
+  {
+    if(_alarmIrqPending && _nvicAlarm)
+    {
+      _alarmIrqPending = false;
+      if((_crh & RTC_ALRIE) && (_crl & RTC_CRL_ALARMF))
+      {
+        _crl &= ~RTC_CRL_ALARMF;
+        alarmIrqs++;
+        start = _ns;
+        if(_alarmCb != nullptr)
+          _alarmCb(_alarmData);
+        if(_ns - start > alarmIsrMaxNs)
+          alarmIsrMaxNs = _ns - start;
+      }
+      _extiPr &= ~EXTI_LINE17;
+    }
+    if(_secondIrqPending && _nvicSeconds)
+    {
+      _secondIrqPending = false;
+      if((_crh & RTC_SECIE) && (_crl & RTC_CRL_SECF))
+      {
+        // HAL_RTCEx_RTCIRQHandler: an overflow replaces the seconds callback
+        secondIrqs++;
+        if(_crl & RTC_CRL_OWF)
+        {
+          _crl &= ~RTC_CRL_OWF;
+          HAL_RTCEx_RTCEventErrorCallback(&simRtcHandle);
+        }
+        else if(_secondsCb != nullptr)
+          _secondsCb(nullptr);
+        _crl &= ~RTC_CRL_SECF;
+      }
+    }
+  }
+  _inIrq = false;
+}
+
+
+void STM32LIBS_SIM::nvicEnable(uint8_t irq)
+{
+  if(irq == RTC_Alarm_IRQn)
+    _nvicAlarm = true;
+  else if(irq == RTC_IRQn)
+    _nvicSeconds = true;
+  deliverIrqs();                                // pending lines fire now
+}
+
+
+bool STM32LIBS_SIM::irqBound(void)
+{
+#if RTC_NATIVE_INIT
+  return _nvicAlarm;                            // no HAL handle
+#else
+  return _nvicAlarm && simRtcHandle.Instance == RTC;
+#endif
+}
+
+
+void STM32LIBS_SIM::setSecondsCallback(void (*cb)(void *))
+{
+  _secondsCb = cb;
+  if(cb != nullptr)
+    _crh |= RTC_SECIE;
+  else
+    _crh &= ~RTC_SECIE;
+}
+
+
+void STM32LIBS_SIM::irqDisable(void)
+{
+  if(!_irqMask)
+    _irqOffNs = _ns;
+  _irqMask = true;
+}
+
+
+void STM32LIBS_SIM::irqEnable(void)
+{
+  if(_irqMask && _ns - _irqOffNs > irqOffMaxNs)
+    irqOffMaxNs = _ns - _irqOffNs;
+  _irqMask = false;
+  deliverIrqs();
+}
+
+
+/******************************************************************************
+**    Every bus access costs a little virtual time, plus host time in real time
+**    mode.
+\*****************************************************************************/
+void STM32LIBS_SIM::sync(void)
+{
+  uint64_t ns = _busNs;
+  uint64_t now;
+
+  if(_speed > 0)
+  {
+    now = hostNs();
+    ns += (uint64_t)((double)(now - _hostNs) * _speed);
+    _hostNs = now;
+  }
+  advanceNs(ns);
+}
+
+
+int8_t STM32LIBS_SIM::bkpIndex(uint32_t addr)
+{
+  uint32_t off = addr - BKP_REG_BASE;
+
+  if(addr < BKP_REG_BASE || (off & 3) != 0)
+    return -1;
+  if(off >= 0x04 && off <= 0x28)
+    return (int8_t)((off - 0x04) / 4);        // DR1 - DR10
+  if(off >= 0x40 && off <= 0xBC)
+    return (int8_t)(10 + (off - 0x40) / 4);   // DR11 - DR42
+  return -1;
+}
+
+
+uint32_t STM32LIBS_SIM::read(uint32_t addr)
+{
+  int8_t bi;
+  uint32_t val;
+
+  sync();
+  regReads++;
+
+  switch(addr)
+  {
+    case PWR_REG_BASE:                return _pwrCr;
+    case RCC_REG_BASE + 0x1C:         return _apb1enr;
+    case RCC_REG_BASE + 0x24:         return _csr | ((_csr & LSION) ? LSIRDY : 0);
+    case RCC_REG_BASE + 0x20:
+      val = _bdcr;
+      if((_bdcr & LSEON) && !_lseFails && _ns >= _lseReadyNs)
+        val |= LSERDY;
+      return val;
+    case RTC_REG_BASE + 0x00:         return _crh;
+    case RTC_REG_BASE + 0x04:         return _crl;
+    case RTC_REG_BASE + 0x08:         return 0;         // PRL is write only
+    case RTC_REG_BASE + 0x0C:         return 0;
+    case RTC_REG_BASE + 0x10:         return (_div >> 16) & 0x0F;
+    case RTC_REG_BASE + 0x14:         return _div & 0xFFFF;
+    case RTC_REG_BASE + 0x18:         return _cnt >> 16;
+    case RTC_REG_BASE + 0x1C:         return _cnt & 0xFFFF;
+    case RTC_REG_BASE + 0x20:         return 0;         // ALR is write only
+    case RTC_REG_BASE + 0x24:         return 0;
+    case EXTI_REG_BASE + 0x00:        return _extiImr;
+    case EXTI_REG_BASE + 0x04:        return _extiEmr;
+    case EXTI_REG_BASE + 0x08:        return _extiRtsr;
+    case EXTI_REG_BASE + 0x0C:        return _extiFtsr;
+    case EXTI_REG_BASE + 0x14:        return _extiPr;
+  }
+
+  bi = bkpIndex(addr);
+  if(bi >= 0)
+    return (bi < _bkpCount) ? _bkp[bi] : 0;     // unimplemented regs read 0
+
+  return simMemory()[addr];
+}
+
+
+void STM32LIBS_SIM::write(uint32_t addr, uint32_t val)
+{
+  int8_t bi;
+  uint32_t oldCrl;
+  bool dbp = (_pwrCr & DBP) != 0;
+
+  sync();
+  regWrites++;
+
+  switch(addr)
+  {
+    case PWR_REG_BASE:
+      if(_apb1enr & SIM_BKPEN_PWREN)
+        _pwrCr = val;
+      break;
+
+    case RCC_REG_BASE + 0x1C:
+      _apb1enr = val;
+      break;
+
+    case RCC_REG_BASE + 0x24:
+      _csr = val & LSION;
+      break;
+
+    case RCC_REG_BASE + 0x20:
+      if(!dbp)
+        break;
+      if(val & BKP_RESET)
+      {
+        resetBackupDomain();
+        _bdcr = BKP_RESET;
+        break;
+      }
+      if((val & LSEON) && !(_bdcr & LSEON))
+        _lseReadyNs = _ns + _lseStartupNs;
+      if((_bdcr & RTCSEL_MASK) != 0)            // RTCSEL is locked until BDRST
+        val = (val & ~RTCSEL_MASK) | (_bdcr & RTCSEL_MASK);
+      _bdcr = val & SIM_BDCR_WMASK & ~BKP_RESET;
+      break;
+
+    case RTC_REG_BASE + 0x00:
+      if(dbp)
+        _crh = val & 0x07;
+      break;
+
+    case RTC_REG_BASE + 0x04:
+      if(!dbp)
+        break;
+      oldCrl = _crl;
+      // SECF, ALRF, OWF, RSF are cleared by writing 0, CNF is r/w, RTOFF r/o
+      _crl = (_crl & (val | ~0x0FUL) & ~CNF) | (val & CNF);
+      if((oldCrl & RSF) && !(_crl & RSF))
+        _rsfPending = true;
+      if((oldCrl & CNF) && !(_crl & CNF) && _latched)
+      {
+        _crl &= ~RTOFF;                          // write in progress
+        _writeDoneTick = _ticks + SIM_WRITE_TICKS;
+      }
+      break;
+
+    case RTC_REG_BASE + 0x08:
+    case RTC_REG_BASE + 0x0C:
+    case RTC_REG_BASE + 0x18:
+    case RTC_REG_BASE + 0x1C:
+    case RTC_REG_BASE + 0x20:
+    case RTC_REG_BASE + 0x24:
+      if(!dbp || !(_crl & CNF))                  // only taken in configuration mode
+        break;
+      val &= 0xFFFF;
+      if(addr == RTC_REG_BASE + 0x08)
+      {
+        _prlLatch = (_prlLatch & 0xFFFF) | ((val & 0x0F) << 16);
+        _latched |= LATCH_PRL;
+      }
+      else if(addr == RTC_REG_BASE + 0x0C)
+      {
+        _prlLatch = (_prlLatch & 0xF0000) | val;
+        _latched |= LATCH_PRL;
+      }
+      else if(addr == RTC_REG_BASE + 0x18)
+      {
+        _cntLatch = (_cntLatch & 0xFFFF) | (val << 16);
+        _latched |= LATCH_CNT;
+      }
+      else if(addr == RTC_REG_BASE + 0x1C)
+      {
+        _cntLatch = (_cntLatch & 0xFFFF0000) | val;
+        _latched |= LATCH_CNT;
+      }
+      else if(addr == RTC_REG_BASE + 0x20)
+      {
+        _alrLatch = (_alrLatch & 0xFFFF) | (val << 16);
+        _latched |= LATCH_ALR;
+      }
+      else
+      {
+        _alrLatch = (_alrLatch & 0xFFFF0000) | val;
+        _latched |= LATCH_ALR;
+      }
+      break;
+
+    case EXTI_REG_BASE + 0x00:    _extiImr = val; break;
+    case EXTI_REG_BASE + 0x04:    _extiEmr = val; break;
+    case EXTI_REG_BASE + 0x08:    _extiRtsr = val; break;
+    case EXTI_REG_BASE + 0x0C:    _extiFtsr = val; break;
+    case EXTI_REG_BASE + 0x14:    _extiPr &= ~val; break;     // write 1 to clear
+
+    default:
+      bi = bkpIndex(addr);
+      if(bi >= 0)
+      {
+        if(dbp && bi < _bkpCount)
+          _bkp[bi] = (uint16_t)val;
+      }
+      else
+        simMemory()[addr] = val;
+      break;
+  }
+  deliverIrqs();
+}
+
+
+/******************************************************************************
+**    What the STM32duino RTC_init() does on an F1: enable the backup domain,
+**    start and select the clock if the RTC is not running yet, then
+**    HAL_RTC_Init() on every call: wait for RSF and load a 1 Hz prescaler.
+\*****************************************************************************/
+void STM32LIBS_SIM::coreRtcInit(uint8_t source, bool resetDomain)
+{
+  uint32_t hz;
+
+  simRtcHandle.Instance = RTC;                  // NVIC is left to the caller
+  RCC_APB1ENR |= PWREN;
+  PWR_CR |= DBP;
+  if(resetDomain)
+  {
+    RCC_BDCR |= BKP_RESET;
+    RCC_BDCR &= ~BKP_RESET;
+  }
+  if(RCC_BDCR & RTC_ENAB)
+    ;                                           // running from Vbat, clock kept
+  else if(source == LSE_CLOCK)
+  {
+    RCC_BDCR |= LSEON;
+    advanceNs(_lseStartupNs);                   // HAL waits for LSERDY
+    if((RCC_BDCR & LSERDY) == 0)
+      return;
+    RCC_BDCR |= RTCSEL_LSE | RTC_ENAB;
+  }
+  else if(source == LSI_CLOCK)
+  {
+    RCC_CSR |= LSION;
+    RCC_BDCR |= RTCSEL_LSI | RTC_ENAB;
+  }
+  else
+    RCC_BDCR |= RTCSEL_HSE | RTC_ENAB;
+
+  // nominal frequency, as the core computes it
+  hz = (simPredivS >= 0) ? (uint32_t)simPredivS + 1 :
+       ((RCC_BDCR & RTCSEL_MASK) == RTCSEL_LSE) ? LSE_VALUE :
+       ((RCC_BDCR & RTCSEL_MASK) == RTCSEL_LSI) ? LSI_VALUE : HSE_VALUE / 128;
+  RTC_CRL &= ~RSF;                              // HAL_RTC_WaitForSynchro()
+  while((RTC_CRL & RSF) == 0);
+  while((RTC_CRL & RTOFF) == 0);
+  RTC_CRL |= CNF;
+  RTC_PRLH = (hz - 1) >> 16;
+  RTC_PRLL = (hz - 1) & 0xFFFF;
+  RTC_CRL &= ~CNF;
+  while((RTC_CRL & RTOFF) == 0);
+}
+
+
+/******************************************************************************
+**    Arduino core & STM32duino RTC shims
+\*****************************************************************************/
+uint32_t millis(void)
+{
+  return (uint32_t)(STM32LIBS_SIM::getInstance().getNs() / 1000000ULL);
+}
+
+uint32_t micros(void)
+{
+  return (uint32_t)(STM32LIBS_SIM::getInstance().getNs() / 1000ULL);
+}
+
+void delay(uint32_t ms)
+{
+  STM32LIBS_SIM::getInstance().advanceNs((uint64_t)ms * 1000000ULL);
+}
+
+void __disable_irq(void)
+{
+  STM32LIBS_SIM::getInstance().irqDisable();
+}
+
+void __enable_irq(void)
+{
+  STM32LIBS_SIM::getInstance().irqEnable();
+}
+
+#if !RTC_NATIVE_INIT                          // else STM32LIBS_NATIVE.cpp on the simulated registers
+void RTC_init(hourFormat_t format, sourceClock_t source, bool reset)
+{
+  (void)format;
+  STM32LIBS_SIM::getInstance().coreRtcInit(source, reset);
+}
+
+void RTC_SetClockSource(sourceClock_t source)
+{
+  (void)source;                                 // the core only records it for RTC_init()
+}
+
+void RTC_getPrediv(int8_t *predivA, int16_t *predivS)
+{
+  *predivA = simPredivA;
+  *predivS = simPredivS;
+}
+
+void RTC_setPrediv(int8_t predivA, int16_t predivS)
+{
+  simPredivA = predivA;
+  simPredivS = predivS;
+}
+#endif
+
+void attachAlarmCallback(voidCallbackPtr func, void *data)
+{
+  STM32LIBS_SIM::getInstance().setAlarmCallback(func, data);
+}
+
+void detachAlarmCallback(void)
+{
+  STM32LIBS_SIM::getInstance().setAlarmCallback(nullptr, nullptr);
+}
+
+RTC_HandleTypeDef *RTC_GetHandle(void)
+{
+  return &simRtcHandle;
+}
+
+void HAL_NVIC_SetPriority(IRQn_Type irq, uint32_t prio, uint32_t subprio)
+{
+  (void)irq;
+  (void)prio;
+  (void)subprio;
+}
+
+void HAL_NVIC_EnableIRQ(IRQn_Type irq)
+{
+  STM32LIBS_SIM::getInstance().nvicEnable((uint8_t)irq);
+}
+
+// HAL_RTCEx_SetSecond_IT(&RtcHandle) & RTC_IRQn, as the core does
+void attachSecondsIrqCallback(voidCallbackPtr func)
+{
+  STM32LIBS_SIM &sim = STM32LIBS_SIM::getInstance();
+
+#if !RTC_NATIVE_INIT
+  if(simRtcHandle.Instance != RTC)
+  {
+    sim.halUnbound++;                           // HAL on a NULL instance, no interrupt
+    return;
+  }
+#endif
+  sim.setSecondsCallback(func);
+  sim.nvicEnable(RTC_IRQn);
+}
+
+void detachSecondsIrqCallback(void)
+{
+  STM32LIBS_SIM::getInstance().setSecondsCallback(nullptr);
+}
+
+// default when the library is not linked in
+extern "C" __attribute__((weak)) void HAL_RTCEx_RTCEventErrorCallback(RTC_HandleTypeDef *hrtc)
+{
+  (void)hrtc;
+}
+
+#endif               // STM32LIBS_HOST_SIM
@@ -0,0 +1,214 @@
+// STM32LIBS_SIM.h
+// host (Linux) simulation of the STM32F10x RTC, backup domain and EXTI line 17
+//
+// Compiled only when STM32LIBS_HOST_SIM is defined. The register macros in
+// STM32LIBS_REGS.h then resolve to STM32SimReg proxies (STM32LIBS_SimRegs
+// access policy) instead of absolute addresses, and the few Arduino core / STM32duino RTC functions used by the
+// library are replaced by the shims below. The library sources build unchanged:
+//
+//   g++ -DSTM32LIBS_HOST_SIM -Isrc app.cpp src/STM32LIBS_RTC.cpp src/STM32LIBS_SIM.cpp
+
+#ifndef _STM32LIBS_SIM_H
+#define _STM32LIBS_SIM_H
+
+#ifdef STM32LIBS_HOST_SIM
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// oscillator values, as in the HAL configuration on target
+#define LSE_VALUE           32768UL
+#define LSI_VALUE           40000UL
+#define HSE_VALUE           8000000UL
+
+#define SIM_LSE_HZ          LSE_VALUE
+#define SIM_LSI_HZ          LSI_VALUE
+#define SIM_HSE_HZ          (HSE_VALUE / 128)    // the RTC runs from HSE / 128
+#define SIM_BKP_REGS_MAX    42
+
+/******************************************************************************
+**    Simulated peripheral model.
+**
+**    Time only moves when the simulation is advanced: explicitly with the
+**    advance functions, by every register access (bus cost, so busy-wait loops
+**    terminate) or, in real time mode, by the host clock times a speed factor.
+\*****************************************************************************/
+class STM32LIBS_SIM {
+  public:
+    static STM32LIBS_SIM &getInstance()
+    {
+      static STM32LIBS_SIM instance;
+      return instance;
+    }
+
+    // register bus
+    uint32_t read(uint32_t addr);
+    void write(uint32_t addr, uint32_t val);
+
+    // virtual clock
+    void advanceNs(uint64_t ns);
+    void advanceTicks(uint64_t ticks);
+    void advanceSeconds(uint32_t secs);
+    void setBusCostNs(uint32_t ns) { _busNs = ns; }
+    void setRealTime(double speed);               // 0 = manual stepping only
+    uint64_t getNs(void) { sync(); return _ns; }
+
+    // board configuration
+    void setLseStartupMs(uint32_t ms) { _lseStartupNs = (uint64_t)ms * 1000000ULL; }
+    void setLseFails(bool fails) { _lseFails = fails; }
+    void setLsiHz(uint32_t hz) { _lsiHz = hz; }      // 30 - 60 KHz on real parts
+    void setBackupRegCount(uint8_t count);
+    void powerCycle(bool vbat);                   // MCU reset, backup domain kept if vbat
+
+    // interrupt plumbing used by the shims
+    void irqDisable(void);
+    void irqEnable(void);
+    void setAlarmCallback(void (*cb)(void *), void *data) { _alarmCb = cb; _alarmData = data; }
+    void setSecondsCallback(void (*cb)(void *));  // also sets / clears SECIE like the core
+    void coreRtcInit(uint8_t source, bool reset);
+    void nvicEnable(uint8_t irq);
+
+    // NVIC & the core's HAL handle, both cleared by a reset: alarms are only
+    // delivered once the alarm IRQ is enabled
+    bool irqBound(void);                          // alarm IRQ enabled, HAL handle bound
+    uint32_t halUnbound;                          // HAL calls on an unbound handle
+
+    // statistics
+    uint32_t regReads;
+    uint32_t regWrites;
+    uint32_t alarmIrqs;
+    uint32_t secondIrqs;
+    uint64_t irqOffMaxNs;           // longest __disable_irq() window, virtual time
+    uint64_t alarmIsrMaxNs;         // longest alarm interrupt, virtual time
+
+  private:
+    STM32LIBS_SIM(void) { reset(); }
+    void reset(void);
+    void resetBackupDomain(void);
+    void sync(void);
+    void tick(uint64_t ticks);
+    void commitWrites(void);
+    void deliverIrqs(void);
+    uint32_t clockHz(void);
+    bool clockRunning(void);
+    int8_t bkpIndex(uint32_t addr);
+
+    // virtual time
+    uint64_t _ns;
+    uint64_t _tickNs;               // ns not yet converted to RTCCLK ticks (scaled by Hz)
+    uint64_t _ticks;
+    uint32_t _busNs;
+    double _speed;
+    uint64_t _hostNs;
+
+    // RCC / PWR
+    uint32_t _apb1enr;
+    uint32_t _bdcr;
+    uint32_t _csr;
+    uint32_t _pwrCr;
+    uint64_t _lseReadyNs;
+    uint64_t _lseStartupNs;
+    bool _lseFails;
+    uint32_t _lsiHz;
+
+    // RTC
+    uint32_t _crh;
+    uint32_t _crl;
+    uint32_t _prl;
+    uint32_t _div;
+    uint32_t _cnt;
+    uint32_t _alr;
+    uint32_t _prlLatch, _cntLatch, _alrLatch;
+    uint8_t _latched;               // which latches were written during CNF
+    uint64_t _writeDoneTick;        // RTOFF returns to 1 at this tick
+    bool _rsfPending;
+
+    // backup data registers
+    uint16_t _bkp[SIM_BKP_REGS_MAX];
+    uint8_t _bkpCount;
+
+    // EXTI line 17
+    uint32_t _extiImr, _extiEmr, _extiRtsr, _extiFtsr, _extiPr;
+
+    // interrupts
+    bool _irqMask;                  // PRIMASK
+    uint64_t _irqOffNs;             // when PRIMASK was set
+    bool _inIrq;
+    bool _alarmIrqPending;
+    bool _secondIrqPending;
+    bool _nvicAlarm;                // RTC_Alarm_IRQn enabled
+    bool _nvicSeconds;              // RTC_IRQn enabled
+    void (*_alarmCb)(void *);
+    void *_alarmData;
+    void (*_secondsCb)(void *);
+};
+
+/******************************************************************************
+**    Register proxy, what the STM32LIBS_REGS.h macros expand to on the host.
+\*****************************************************************************/
+class STM32SimReg {
+  public:
+    // the register defines are unsigned long, 64 bit on most hosts (32 on target)
+    explicit STM32SimReg(uint32_t addr): _addr(addr) {}
+    operator uint32_t() const { return STM32LIBS_SIM::getInstance().read(_addr); }
+    STM32SimReg &operator=(const STM32SimReg &reg) { return *this = (uint32_t)reg; }
+    STM32SimReg &operator=(uint64_t val) { STM32LIBS_SIM::getInstance().write(_addr, (uint32_t)val); return *this; }
+    STM32SimReg &operator|=(uint64_t val) { return *this = (uint32_t)*this | val; }
+    STM32SimReg &operator&=(uint64_t val) { return *this = (uint32_t)*this & val; }
+    STM32SimReg &operator^=(uint64_t val) { return *this = (uint32_t)*this ^ val; }
+
+  private:
+    uint32_t _addr;
+};
+
+/******************************************************************************
+**    Register access policy for STM32LIBS_REGS.h.
+\*****************************************************************************/
+struct STM32LIBS_SimRegs {
+  typedef STM32SimReg ref;
+
+  template<uint32_t ADDR> static inline ref reg(void) { return STM32SimReg(ADDR); }
+  static inline ref reg(uint32_t addr) { return STM32SimReg(addr); }
+};
+
+/******************************************************************************
+**    Arduino core & STM32duino RTC shims.
+\*****************************************************************************/
+typedef enum { HOUR_FORMAT_12, HOUR_FORMAT_24 } hourFormat_t;
+typedef enum { HOUR_AM, HOUR_PM } hourAM_PM_t;
+typedef enum { LSI_CLOCK, HSI_CLOCK, LSE_CLOCK, HSE_CLOCK } sourceClock_t;   // as in the core's clock.h
+typedef void (*voidCallbackPtr)(void *);
+typedef struct { uint32_t AsynchPrediv; uint32_t OutPut; } RTC_InitTypeDef;
+typedef struct { void *Instance; RTC_InitTypeDef Init; uint32_t Lock; uint32_t State; } RTC_HandleTypeDef;
+typedef enum { RTC_IRQn = 3, RTC_Alarm_IRQn = 41 } IRQn_Type;
+
+#define RTC                     ((void *)0x40002800UL)
+#define RTC_OUTPUTSOURCE_NONE   0
+#define HAL_UNLOCKED            0
+#define HAL_RTC_STATE_READY     1
+
+uint32_t millis(void);
+uint32_t micros(void);
+void delay(uint32_t ms);
+void __disable_irq(void);
+void __enable_irq(void);
+
+void RTC_init(hourFormat_t format, sourceClock_t source, bool reset = false);
+void RTC_SetClockSource(sourceClock_t source);
+void RTC_getPrediv(int8_t *predivA, int16_t *predivS);
+void RTC_setPrediv(int8_t predivA, int16_t predivS);
+RTC_HandleTypeDef *RTC_GetHandle(void);
+void HAL_NVIC_SetPriority(IRQn_Type irq, uint32_t prio, uint32_t subprio);
+void HAL_NVIC_EnableIRQ(IRQn_Type irq);
+void attachAlarmCallback(voidCallbackPtr func, void *data);
+void detachAlarmCallback(void);
+void attachSecondsIrqCallback(voidCallbackPtr func);
+void detachSecondsIrqCallback(void);
+
+// HAL weak hook, called instead of the seconds callback when OWF is set
+extern "C" void HAL_RTCEx_RTCEventErrorCallback(RTC_HandleTypeDef *hrtc);
+
+#endif               // STM32LIBS_HOST_SIM
+
+#endif               // end _STM32LIBS_SIM_H
@@ -0,0 +1,272 @@
+/******************************************************************************
+  * @file    STM32LIBS_TZ.cpp
+  * @brief   POSIX TZ string compiler & cached UTC -> local time offsets
+  ******************************************************************************
+  */
+
+#include "STM32LIBS_TZ.h"
+
+#define TZ_HOUR           3600L
+#define TZ_NO_TRANSITION  INT64_MIN
+
+// rules used when a TZ string names a DST zone without rules
+static const RTC_tz_rule_t tzUsStart = {TZ_RULE_MONTH, 3, 2, 0, 0, 2 * TZ_HOUR};    // M3.2.0
+static const RTC_tz_rule_t tzUsEnd = {TZ_RULE_MONTH, 11, 1, 0, 0, 2 * TZ_HOUR};     // M11.1.0
+
+
+static const char *parseNum(const char *p, uint16_t *val, uint16_t max)
+{
+  uint16_t v = 0;
+
+  if(*p < '0' || *p > '9')
+    return nullptr;
+  while(*p >= '0' && *p <= '9')
+  {
+    v = v * 10 + (*p++ - '0');
+    if(v > max)
+      return nullptr;
+  }
+  *val = v;
+  return p;
+}
+
+
+/********************************************************************
+ **   @brief Parses a zone abbreviation, 3 or more letters or <...>.
+ **   @returns pointer past the name or nullptr if it is too short.
+\*******************************************************************/
+static const char *parseName(const char *p, char *name)
+{
+  uint8_t n = 0, i = 0;
+  bool quoted = (*p == '<');
+
+  if(quoted)
+    p++;
+  while((*p >= 'A' && *p <= 'Z') || (*p >= 'a' && *p <= 'z') ||
+        (quoted && ((*p >= '0' && *p <= '9') || *p == '+' || *p == '-')))
+  {
+    if(i < TZ_NAME_MAX - 1)
+      name[i++] = *p;
+    n++;
+    p++;
+  }
+  name[i] = 0;
+  if(quoted && *p++ != '>')
+    return nullptr;
+  return (n >= 3) ? p : nullptr;
+}
+
+
+/********************************************************************
+ **   @brief Parses [+|-]hh[:mm[:ss]].
+ **   @param maxHours - 24 for offsets, 167 for rule times.
+ **   @returns pointer past the time or nullptr on a syntax / range error.
+\*******************************************************************/
+static const char *parseTime(const char *p, int32_t *secs, uint16_t maxHours)
+{
+  uint16_t h, m = 0, s = 0;
+  bool neg = (*p == '-');
+
+  if(*p == '-' || *p == '+')
+    p++;
+  if((p = parseNum(p, &h, maxHours)) == nullptr)
+    return nullptr;
+  if(*p == ':' && (p = parseNum(p + 1, &m, 59)) != nullptr && *p == ':')
+    p = parseNum(p + 1, &s, 59);
+  if(p == nullptr)
+    return nullptr;
+  *secs = h * TZ_HOUR + m * 60L + s;
+  if(neg)
+    *secs = -*secs;
+  return p;
+}
+
+
+/********************************************************************
+ **   @brief Parses ,Jn / ,n / ,Mm.w.d with an optional /time.
+ **   @returns pointer past the rule or nullptr on a syntax / range error.
+\*******************************************************************/
+static const char *parseRule(const char *p, RTC_tz_rule_t *rule)
+{
+  uint16_t month, week, wday;
+
+  if(*p++ != ',')
+    return nullptr;
+  if(*p == 'M')
+  {
+    rule->type = TZ_RULE_MONTH;
+    if((p = parseNum(p + 1, &month, 12)) == nullptr || month == 0 || *p != '.' ||
+       (p = parseNum(p + 1, &week, 5)) == nullptr || week == 0 || *p != '.' ||
+       (p = parseNum(p + 1, &wday, 6)) == nullptr)
+      return nullptr;
+    rule->month = month;
+    rule->week = week;
+    rule->wday = wday;
+  }
+  else if(*p == 'J')
+  {
+    rule->type = TZ_RULE_JULIAN;
+    if((p = parseNum(p + 1, &rule->day, 365)) == nullptr || rule->day == 0)
+      return nullptr;
+  }
+  else
+  {
+    rule->type = TZ_RULE_DAY;
+    if((p = parseNum(p, &rule->day, 365)) == nullptr)
+      return nullptr;
+  }
+
+  rule->time = 2 * TZ_HOUR;
+  if(*p == '/')
+    p = parseTime(p + 1, &rule->time, 167);
+  return p;
+}
+
+
+/********************************************************************
+ **   @brief Compiles a POSIX TZ string, ex: "EST5EDT,M3.2.0,M11.1.0".
+ **   @param spec - std offset [dst [offset] [,start[/time],end[/time]]].
+ **     Offsets count hours west of UTC, the DST offset defaults to one
+ **     hour ahead of standard time.
+ **   @returns false on a syntax or range error, tz is then set to UTC.
+\*******************************************************************/
+bool tzCompile(RTC_tz_t *tz, const char *spec)
+{
+  const char *p = spec;
+  int32_t west;
+
+  if(tz == nullptr)
+    return false;
+  *tz = RTC_tz_t();                         // UTC, empty window
+  if(spec == nullptr)
+    return false;
+
+  if((p = parseName(p, tz->stdName)) == nullptr || (p = parseTime(p, &west, 24)) == nullptr)
+    goto fail;
+  tz->stdOffset = -west;
+  tz->dstOffset = tz->stdOffset;
+  if(*p != 0)
+  {
+    if((p = parseName(p, tz->dstName)) == nullptr)
+      goto fail;
+    tz->hasDst = true;
+    tz->dstOffset = tz->stdOffset + TZ_HOUR;
+    if(*p != 0 && *p != ',')
+    {
+      if((p = parseTime(p, &west, 24)) == nullptr)
+        goto fail;
+      tz->dstOffset = -west;
+    }
+    if(*p == 0)
+    {
+      tz->start = tzUsStart;
+      tz->end = tzUsEnd;
+    }
+    else if((p = parseRule(p, &tz->start)) == nullptr || (p = parseRule(p, &tz->end)) == nullptr || *p != 0)
+      goto fail;
+  }
+  tz->offset = tz->stdOffset;
+  return true;
+
+fail:
+  *tz = RTC_tz_t();
+  return false;
+}
+
+
+/********************************************************************
+ **   @brief Day of a transition rule, days since 1970.
+\*******************************************************************/
+static uint32_t ruleDay(const RTC_tz_rule_t *rule, uint16_t year)
+{
+  uint32_t first, day;
+  uint8_t len;
+
+  if(rule->type == TZ_RULE_JULIAN)
+    return calDaysFromCivil(year, 1, 1) + rule->day - 1 + ((rule->day >= 60 && calIsLeapYear(year)) ? 1 : 0);
+  if(rule->type == TZ_RULE_DAY)
+    return calDaysFromCivil(year, 1, 1) + rule->day;
+
+  // weekday d of week w, week 5 = the last one in the month
+  first = calDaysFromCivil(year, rule->month, 1);
+  len = calDaysBeforeMonth[rule->month] - calDaysBeforeMonth[rule->month - 1] +
+        ((rule->month == 2 && calIsLeapYear(year)) ? 1 : 0);
+  day = (rule->wday + 7 - calWeekday(first)) % 7 + (rule->week - 1) * 7;
+  if(day >= len)
+    day -= 7;
+  return first + day;
+}
+
+
+/********************************************************************
+ **   @brief Finds the transitions before and after utc, sets the offset
+ **     and the window they bound. Called by tzOffset() when utc is
+ **     outside the window, about twice a year for a clock running forward.
+\*******************************************************************/
+void tzUpdate(RTC_tz_t *tz, uint32_t utc)
+{
+  int64_t prev = TZ_NO_TRANSITION, next = INT64_MAX, t;
+  bool prevDst = false, nextDst = false;
+  uint32_t sod;
+  uint16_t year, y;
+  uint8_t month, day;
+  uint64_t until;
+
+  if(!tz->hasDst)
+  {
+    tz->offset = tz->stdOffset;
+    tz->isDst = false;
+    tz->from = 0;
+    tz->span = 0xFFFFFFFF;
+    return;
+  }
+
+  // transitions of the years around utc, start in standard time, end in daylight time
+  calCivilFromDays(calSplitEpoch(utc, &sod), &year, &month, &day);
+  for(y = (year > CAL_YEAR_MIN) ? year - 1 : year; y <= year + 1; y++)
+  {
+    t = (int64_t)ruleDay(&tz->start, y) * CAL_SECS_PER_DAY + tz->start.time - tz->stdOffset;
+    if(t <= utc && t > prev)
+    {
+      prev = t;
+      prevDst = true;
+    }
+    else if(t > utc && t < next)
+    {
+      next = t;
+      nextDst = true;
+    }
+    t = (int64_t)ruleDay(&tz->end, y) * CAL_SECS_PER_DAY + tz->end.time - tz->dstOffset;
+    if(t <= utc && t > prev)
+    {
+      prev = t;
+      prevDst = false;
+    }
+    else if(t > utc && t < next)
+    {
+      next = t;
+      nextDst = false;
+    }
+  }
+
+  // before the first transition of 1970 the state is the opposite of the next one
+  tz->isDst = (prev != TZ_NO_TRANSITION) ? prevDst : !nextDst;
+  tz->offset = tz->isDst ? tz->dstOffset : tz->stdOffset;
+  tz->from = (prev > 0) ? (uint32_t)prev : 0;
+  until = (next > 0xFFFFFFFFLL) ? 0x100000000ULL : (uint64_t)next;
+  tz->span = (until - tz->from > 0xFFFFFFFFULL) ? 0xFFFFFFFF : (uint32_t)(until - tz->from);
+}
+
+
+/********************************************************************
+ **   @brief Next transition after utc.
+ **   @returns epoch or 0 if there is none before the 32 bit counter wraps.
+\*******************************************************************/
+uint32_t tzNextTransition(RTC_tz_t *tz, uint32_t utc)
+{
+  uint64_t until;
+
+  tzOffset(tz, utc);
+  until = (uint64_t)tz->from + tz->span;
+  return (!tz->hasDst || until > 0xFFFFFFFFULL) ? 0 : (uint32_t)until;
+}
@@ -0,0 +1,83 @@
+// STM32LIBS_TZ.h
+// POSIX TZ string time zones & daylight saving time for the STM32LIBS_RTC library
+//
+// A TZ string is compiled once into offsets and two transition rules. The
+// first conversion evaluates the rules and keeps the UTC window between the
+// previous and the next transition; every later conversion inside that
+// window is one unsigned compare and an add. The rules are evaluated again
+// only when a transition is crossed, twice a year.
+//
+//   RTC_tz_t tz;
+//   tzCompile(&tz, "CET-1CEST,M3.5.0,M10.5.0/3");   // Central Europe
+//   uint32_t local = tzToLocal(&tz, rtc.getEpoch());
+//
+// Rules are the POSIX forms Jn (1 - 365, Feb 29 never counted), n (0 - 365)
+// and Mm.w.d (weekday d of week w of month m, w = 5 is the last), each with
+// an optional /time of -167 to 167 hours (default 02:00). Names may be
+// quoted: "<+0330>-3:30". A DST name without rules uses the US rules.
+
+#ifndef _STM32LIBS_TZ_H
+#define _STM32LIBS_TZ_H
+
+#include <stdint.h>
+#include "STM32LIBS_CALENDAR.h"
+
+#define TZ_NAME_MAX       8       // zone abbreviation incl. terminator, longer ones are cut
+
+// RTC_tz_rule_t types
+enum {
+  TZ_RULE_JULIAN,         // Jn, 1 - 365, Feb 29 is never counted
+  TZ_RULE_DAY,            // n, 0 - 365, leap days counted
+  TZ_RULE_MONTH,          // Mm.w.d
+};
+
+typedef struct
+{
+  uint8_t type;           // TZ_RULE_xxx
+  uint8_t month;          // Mm.w.d: 1 - 12
+  uint8_t week;           //   1 - 5, 5 = last
+  uint8_t wday;           //   0(Sunday) - 6(Saturday)
+  uint16_t day;           // Jn & n
+  int32_t time;           // local time of the transition, seconds after midnight
+} RTC_tz_rule_t;
+
+typedef struct
+{
+  int32_t stdOffset;      // seconds east of UTC (TZ strings count west of UTC)
+  int32_t dstOffset;
+  RTC_tz_rule_t start;    // to DST, in standard local time
+  RTC_tz_rule_t end;      // back to standard time, in daylight local time
+  bool hasDst;
+  char stdName[TZ_NAME_MAX];
+  char dstName[TZ_NAME_MAX];
+
+  // window of the last conversion: offset is valid for from <= utc < from + span
+  uint32_t from;
+  uint32_t span;
+  int32_t offset;
+  bool isDst;
+} RTC_tz_t;
+
+// false on a syntax / range error, tz is then UTC
+bool tzCompile(RTC_tz_t *tz, const char *spec);
+
+// evaluates the rules for utc and sets the window, see tzOffset()
+void tzUpdate(RTC_tz_t *tz, uint32_t utc);
+
+// seconds to add to utc for local time
+static inline int32_t tzOffset(RTC_tz_t *tz, uint32_t utc)
+{
+  if(utc - tz->from >= tz->span)          // outside the window (or wrapped below it)
+    tzUpdate(tz, utc);
+  return tz->offset;
+}
+
+static inline uint32_t tzToLocal(RTC_tz_t *tz, uint32_t utc)
+{
+  return utc + (uint32_t)tzOffset(tz, utc);
+}
+
+// next transition after utc, 0 if none before the 32 bit counter wraps
+uint32_t tzNextTransition(RTC_tz_t *tz, uint32_t utc);
+
+#endif               // end _STM32LIBS_TZ_H
@@ -0,0 +1,518 @@
+/******************************************************************************
+  * @file    STM32LIBS_WHEEL.cpp
+  * @brief   Hierarchical timing wheel for recurring RTC timers
+  *
+  * Invariant: a timer sits in the finest level whose unit it shares with the
+  * wheel time _now - same minute: seconds wheel, same hour: minutes wheel,
+  * same day: hours wheel, within 64 days: days wheel, else overflow. Every
+  * slot up to _now has been processed, so the next thing to do is always the
+  * first non-empty slot after _now, found with one bit scan per level.
+  * Re-placing the overflow list (or every timer, in begin()) is spread over
+  * steps too: the list is swapped with a spare one and drained one timer per
+  * step, so service() can stop after RTC_WHEEL_STEPS timers at any point.
+  ******************************************************************************
+  */
+
+#include "STM32LIBS_WHEEL.h"
+
+#define WHEEL_NIL       0xFFFF
+#define WHEEL_FREE      0xFFFF
+
+// _step() results
+#define WHEEL_IDLE      0
+#define WHEEL_MOVED     1
+#define WHEEL_EXPIRED   2
+
+// first list head of each level in _heads
+#define WHEEL_L0_BASE   0
+#define WHEEL_L1_BASE   (WHEEL_L0_BASE + WHEEL_L0_SLOTS)
+#define WHEEL_L2_BASE   (WHEEL_L1_BASE + WHEEL_L1_SLOTS)
+#define WHEEL_L3_BASE   (WHEEL_L2_BASE + WHEEL_L2_SLOTS)
+#define WHEEL_OVF_BASE  (WHEEL_L3_BASE + WHEEL_L3_SLOTS)
+
+// overflow list _place() fills and the one being re-placed
+#define WHEEL_OVF_FILL  (WHEEL_OVF_BASE + _ovfSide)
+#define WHEEL_OVF_DRAIN (WHEEL_OVF_BASE + (_ovfSide ^ 1))
+
+static STM32LIBS_RTC &rtc = STM32LIBS_RTC::getInstance();
+
+static const uint16_t levelBase[WHEEL_LEVELS + 1] = {WHEEL_L0_BASE, WHEEL_L1_BASE, WHEEL_L2_BASE, WHEEL_L3_BASE, WHEEL_OVF_BASE};
+
+
+static inline uint8_t headLevel(uint16_t head)
+{
+  if(head < WHEEL_L1_BASE)
+    return 0;
+  if(head < WHEEL_L2_BASE)
+    return 1;
+  if(head < WHEEL_L3_BASE)
+    return 2;
+  if(head < WHEEL_OVF_BASE)
+    return 3;
+  return WHEEL_OVERFLOW;
+}
+
+
+/********************************************************************
+ **   @brief Takes over the RTC alarm interrupt and starts the wheel at
+ **     the current RTC epoch.
+ **   @note Call begin() again after the RTC time is changed. Pending
+ **     timers are re-placed one at a time, interrupts are only held off
+ **     for one list operation.
+\*******************************************************************/
+void STM32LIBS_WHEEL::begin(void)
+{
+  uint16_t i, t;
+  voidFuncPtr callback;
+  void *data;
+
+  _active = false;
+  rtc.disableAlarm();                       // no service() from the interrupt meanwhile
+  // every pending timer goes to the spare overflow list ...
+  for(i = 0; i < WHEEL_HEADS; i++)
+  {
+    if(i == WHEEL_OVF_DRAIN)
+      continue;
+    for(;;)
+    {
+      __disable_irq();
+      if((t = _heads[i]) == WHEEL_NIL)
+      {
+        __enable_irq();
+        break;
+      }
+      _unlink(t);
+      _link(t, WHEEL_OVF_DRAIN);
+      __enable_irq();
+    }
+  }
+  __disable_irq();
+  _overflowMin = 0xFFFFFFFF;
+  _now = rtc.getEpoch();
+  __enable_irq();
+  // ... and is re-placed relative to the new wheel time
+  while(_heads[WHEEL_OVF_DRAIN] != WHEEL_NIL)
+    _step(_now, &callback, &data);
+  _armed = 0;
+  _active = true;
+
+  rtc.attachInterrupt(_alarmISR, this);
+  _arm(false);
+}
+
+
+/********************************************************************
+ **   @brief Releases the RTC alarm. Timers are kept.
+\*******************************************************************/
+void STM32LIBS_WHEEL::end(void)
+{
+  _active = false;
+  _armed = 0;
+  rtc.disableAlarm();
+  rtc.detachInterrupt();
+}
+
+
+/********************************************************************
+ **   @brief Adds a recurring timer.
+ **   @param period - seconds between calls (> 0).
+ **   @param callback - called in interrupt context with data.
+ **   @param first_epoch - first call, 0 = one period from now.
+ **   @returns timer id or RTC_TIMER_NONE if all timers are in use.
+ **   @note Missed periods (ex: interrupts held off for a long time) are
+ **     skipped, the timer stays on its original phase.
+\*******************************************************************/
+int32_t STM32LIBS_WHEEL::every(uint32_t period, voidFuncPtr callback, void *data, uint32_t first_epoch)
+{
+  if(period == 0)
+    return RTC_TIMER_NONE;
+  if(first_epoch == 0)
+    first_epoch = rtc.getEpoch() + period;
+  return _add(first_epoch, period, callback, data);
+}
+
+
+/********************************************************************
+ **   @brief Adds a one-shot timer at an absolute epoch.
+\*******************************************************************/
+int32_t STM32LIBS_WHEEL::at(uint32_t timer_epoch, voidFuncPtr callback, void *data)
+{
+  return _add(timer_epoch, 0, callback, data);
+}
+
+
+int32_t STM32LIBS_WHEEL::_add(uint32_t expires, uint32_t period, voidFuncPtr callback, void *data)
+{
+  uint16_t t;
+  int32_t id;
+
+  if(callback == nullptr)
+    return RTC_TIMER_NONE;
+
+  __disable_irq();
+  if(_freeCount == 0)
+  {
+    __enable_irq();
+    return RTC_TIMER_NONE;
+  }
+  t = _free[--_freeCount];
+  _pool[t].expires = (expires > _now) ? expires : _now + 1;
+  _pool[t].period = period;
+  _pool[t].callback = callback;
+  _pool[t].data = data;
+  _place(t);
+  _count++;
+  id = t | ((int32_t)_pool[t].gen << RTC_TIMER_GEN_SHIFT);
+  __enable_irq();
+
+  _arm(false);                // a slot already passed is left to service()
+  return id;
+}
+
+
+/********************************************************************
+ **   @brief Cancels a timer. O(1).
+ **   @returns false if id is not pending, also once its slot holds a
+ **     newer timer.
+\*******************************************************************/
+bool STM32LIBS_WHEEL::cancel(int32_t id)
+{
+  uint16_t t = id & ((1UL << RTC_TIMER_GEN_SHIFT) - 1);
+
+  if(id < 0 || t >= RTC_MAX_WHEEL_TIMERS)
+    return false;
+
+  __disable_irq();
+  if(_pool[t].head == WHEEL_FREE || _pool[t].gen != (id >> RTC_TIMER_GEN_SHIFT))
+  {
+    __enable_irq();
+    return false;
+  }
+  _unlink(t);
+  _release(t);
+  __enable_irq();
+  return true;
+}
+
+
+/********************************************************************
+ **   @brief Cancels all timers.
+\*******************************************************************/
+void STM32LIBS_WHEEL::clear(void)
+{
+  uint16_t i;
+
+  __disable_irq();
+  for(i = 0; i < WHEEL_HEADS; i++)
+    _heads[i] = WHEEL_NIL;
+  for(i = 0; i < WHEEL_LEVELS; i++)
+    _bits[i] = 0;
+  for(i = 0; i < RTC_MAX_WHEEL_TIMERS; i++)
+  {
+    _pool[i].head = WHEEL_FREE;
+    _pool[i].gen = (_pool[i].gen + 1) & RTC_TIMER_GEN_MASK;
+    _free[i] = RTC_MAX_WHEEL_TIMERS - 1 - i;
+  }
+  _freeCount = RTC_MAX_WHEEL_TIMERS;
+  _count = 0;
+  _overflowMin = 0xFFFFFFFF;
+  __enable_irq();
+}
+
+
+/********************************************************************
+ **   @brief Epoch of the next non-empty slot: a timer expiry in the
+ **     seconds wheel or a cascade point (minute, hour or day boundary)
+ **     of a coarser level.
+ **   @returns 0 if no timers are pending, _now while the overflow list
+ **     is re-placed.
+\*******************************************************************/
+uint32_t STM32LIBS_WHEEL::nextEpoch(void)
+{
+  uint64_t m;
+  uint32_t day, r, nday = 0xFFFFFFFF;
+
+  if(_count == 0)
+    return 0;
+  if(_heads[WHEEL_OVF_DRAIN] != WHEEL_NIL)
+    return _now;
+
+  m = _bits[0] & (~0ULL << ((_now % 60) + 1));
+  if(m)
+    return _now - (_now % 60) + __builtin_ctzll(m);
+  m = _bits[1] & (~0ULL << (((_now / 60) % 60) + 1));
+  if(m)
+    return _now - (_now % 3600) + __builtin_ctzll(m) * 60;
+  m = _bits[2] & (~0ULL << (((_now / 3600) % 24) + 1));
+  if(m)
+    return _now - (_now % 86400) + __builtin_ctzll(m) * 3600;
+
+  // days wheel wraps: slots after today's first, then the ones before it
+  day = _now / 86400;
+  r = day % WHEEL_L3_SLOTS;
+  m = (r == WHEEL_L3_SLOTS - 1) ? 0 : (_bits[3] & (~0ULL << (r + 1)));
+  if(m)
+    nday = day + (__builtin_ctzll(m) - r);
+  else
+  {
+    m = _bits[3] & ((1ULL << r) - 1);
+    if(m)
+      nday = day + (__builtin_ctzll(m) + WHEEL_L3_SLOTS - r);
+  }
+
+  // overflow timers are re-placed once they are within the days wheel
+  if(_heads[WHEEL_OVF_FILL] != WHEEL_NIL)
+  {
+    r = _overflowMin / 86400 - (WHEEL_L3_SLOTS - 1);
+    if(r <= day)
+      r = day + 1;
+    if(r < nday)
+      nday = r;
+  }
+  return nday * 86400;
+}
+
+
+/********************************************************************
+ **   @brief Processes the expired timers and cascades up to the current
+ **     RTC epoch, then queues the RTC alarm for the next non-empty slot.
+ **     Called from the RTC alarm interrupt; poll it from loop() too, the
+ **     RTC alarm write is finished by the next call.
+ **   @returns true if it stopped after RTC_WHEEL_STEPS timers with work
+ **     left. The RTC alarm is then set for the next second, a loop()
+ **     calling again until false catches up sooner.
+ **   @note Interrupts are held off for one step (one timer moved or
+ **     expired) at a time, callbacks run with interrupts enabled.
+\*******************************************************************/
+bool STM32LIBS_WHEEL::service(void)
+{
+  uint32_t now;
+  uint16_t steps = 0;
+  voidFuncPtr callback;
+  void *data;
+  uint8_t step;
+
+  rtc.serviceWrites();                      // lands the last re-arm
+  do {
+    now = rtc.getEpoch();
+    while((step = _step(now, &callback, &data)) != WHEEL_IDLE)
+    {
+      if(step == WHEEL_EXPIRED)
+        callback(data);
+      if(++steps >= RTC_WHEEL_STEPS)
+      {
+        while(!_arm(true));                 // go on with the next second
+        return true;
+      }
+    }
+  } while(!_arm(false));                    // the callbacks ran past the next slot
+  return false;
+}
+
+
+/********************************************************************
+ **   @brief One unit of wheel work up to now: move one timer down from
+ **     a slot whose boundary is _now, expire one timer of the current
+ **     seconds slot or advance _now to the next non-empty slot.
+ **   @returns WHEEL_IDLE when nothing is left up to now, WHEEL_EXPIRED
+ **     with the callback to run or WHEEL_MOVED.
+\*******************************************************************/
+uint8_t STM32LIBS_WHEEL::_step(uint32_t now, voidFuncPtr *callback, void **data)
+{
+  uint16_t t;
+  uint32_t ev;
+
+  __disable_irq();
+  // overflow list (or begin()) re-place, first
+  t = _heads[WHEEL_OVF_DRAIN];
+  if(t != WHEEL_NIL)
+  {
+    _unlink(t);
+    if(_pool[t].expires <= _now)
+      _pool[t].expires = _now + 1;
+    _place(t);
+    cascaded++;
+    __enable_irq();
+    return WHEEL_MOVED;
+  }
+
+  // cascades due at _now, coarsest level first
+  if(_now % 60 == 0)
+  {
+    if(_now % 86400 == 0)
+      t = _heads[WHEEL_L3_BASE + (_now / 86400) % WHEEL_L3_SLOTS];
+    if(t == WHEEL_NIL && _now % 3600 == 0)
+      t = _heads[WHEEL_L2_BASE + (_now / 3600) % 24];
+    if(t == WHEEL_NIL)
+      t = _heads[WHEEL_L1_BASE + (_now / 60) % 60];
+    if(t != WHEEL_NIL)
+    {
+      _unlink(t);
+      _place(t);
+      cascaded++;
+      __enable_irq();
+      return WHEEL_MOVED;
+    }
+  }
+
+  t = _heads[WHEEL_L0_BASE + (_now % 60)];
+  if(t == WHEEL_NIL)
+  {
+    ev = nextEpoch();
+    if(ev == 0 || ev > now)
+    {
+      if(now > _now)
+        _now = now;                         // nothing in between, just move
+      __enable_irq();
+      return WHEEL_IDLE;
+    }
+    _now = ev;
+    // overflow timers within reach: the list is re-placed from the next step
+    if(ev % 86400 == 0 && _heads[WHEEL_OVF_FILL] != WHEEL_NIL && ev / 86400 + (WHEEL_L3_SLOTS - 1) >= _overflowMin / 86400)
+    {
+      _overflowMin = 0xFFFFFFFF;
+      _ovfSide ^= 1;
+    }
+    __enable_irq();
+    return WHEEL_MOVED;
+  }
+
+  // expired: timers in the current seconds slot all expire at _now
+  _unlink(t);
+  *callback = _pool[t].callback;
+  *data = _pool[t].data;
+  fired++;
+  if(_pool[t].period != 0)
+  {
+    _pool[t].expires += _pool[t].period;
+    if(_pool[t].expires <= now)             // skip missed periods
+      _pool[t].expires += ((now - _pool[t].expires) / _pool[t].period + 1) * _pool[t].period;
+    _place(t);
+  }
+  else
+    _release(t);
+  __enable_irq();
+  return WHEEL_EXPIRED;
+}
+
+
+/********************************************************************
+ **   @brief Queues the RTC alarm write for the next non-empty slot, no
+ **     wait: called from the alarm interrupt.
+ **   @param more - work is left up to now, arm the next second instead.
+ **   @returns false if that slot already passed.
+\*******************************************************************/
+bool STM32LIBS_WHEEL::_arm(bool more)
+{
+  uint32_t next;
+
+  if(!_active)
+    return true;
+
+  if(more)
+    next = rtc.getEpoch() + 1;
+  else
+  {
+    __disable_irq();
+    next = nextEpoch();
+    __enable_irq();
+  }
+
+  if(next == 0)
+  {
+    if(_armed != 0)
+      rtc.disableAlarm();
+    _armed = 0;
+    return true;
+  }
+  if(next == _armed && next > rtc.getEpoch())   // polled from loop(), nothing changed
+    return true;
+
+  if(rtc.setAlarmAsync(next) == 0)
+  {
+    _armed = 0;
+    return false;
+  }
+  _armed = next;
+  rearms++;
+  return true;
+}
+
+
+void STM32LIBS_WHEEL::_alarmISR(void *data)
+{
+  STM32LIBS_WHEEL *wheel = (STM32LIBS_WHEEL *)data;
+
+  wheel->_armed = 0;
+  wheel->service();
+}
+
+
+/******************************************************************************
+**    Slot list helpers, called with interrupts disabled.
+\*****************************************************************************/
+void STM32LIBS_WHEEL::_place(uint16_t t)
+{
+  uint32_t e = _pool[t].expires;
+  uint16_t head;
+
+  if(e / 60 == _now / 60)
+    head = WHEEL_L0_BASE + e % 60;
+  else if(e / 3600 == _now / 3600)
+    head = WHEEL_L1_BASE + (e / 60) % 60;
+  else if(e / 86400 == _now / 86400)
+    head = WHEEL_L2_BASE + (e / 3600) % 24;
+  else if(e / 86400 - _now / 86400 < WHEEL_L3_SLOTS)
+    head = WHEEL_L3_BASE + (e / 86400) % WHEEL_L3_SLOTS;
+  else
+  {
+    head = WHEEL_OVF_FILL;
+    if(e < _overflowMin)
+      _overflowMin = e;
+  }
+  _link(t, head);
+}
+
+
+void STM32LIBS_WHEEL::_link(uint16_t t, uint16_t head)
+{
+  uint8_t level;
+
+  _pool[t].head = head;
+  _pool[t].prev = WHEEL_NIL;
+  _pool[t].next = _heads[head];
+  if(_heads[head] != WHEEL_NIL)
+    _pool[_heads[head]].prev = t;
+  _heads[head] = t;
+
+  level = headLevel(head);
+  if(level < WHEEL_LEVELS)
+    _bits[level] |= 1ULL << (head - levelBase[level]);
+}
+
+
+void STM32LIBS_WHEEL::_release(uint16_t t)
+{
+  _pool[t].head = WHEEL_FREE;
+  _pool[t].gen = (_pool[t].gen + 1) & RTC_TIMER_GEN_MASK;
+  _free[_freeCount++] = t;
+  _count--;
+}
+
+
+void STM32LIBS_WHEEL::_unlink(uint16_t t)
+{
+  uint16_t head = _pool[t].head;
+  uint8_t level;
+
+  if(_pool[t].prev != WHEEL_NIL)
+    _pool[_pool[t].prev].next = _pool[t].next;
+  else
+    _heads[head] = _pool[t].next;
+  if(_pool[t].next != WHEEL_NIL)
+    _pool[_pool[t].next].prev = _pool[t].prev;
+
+  level = headLevel(head);
+  if(level < WHEEL_LEVELS && _heads[head] == WHEEL_NIL)
+    _bits[level] &= ~(1ULL << (head - levelBase[level]));
+}
@@ -0,0 +1,119 @@
+/******************************************************************************
+  * @file    STM32LIBS_WHEEL.h
+  * @brief   Hierarchical timing wheel for recurring RTC timers
+  *
+  * For many recurring jobs (every 5 s, every minute, hourly, daily) the heap
+  * in STM32LIBS_ALARMS keeps rebalancing. The wheel keys timers by RTC second
+  * in four levels - seconds (60 slots), minutes (60), hours (24) and days
+  * (64) - plus an overflow list for timers further out. Insert, cancel and
+  * expire are O(1); a timer moves to a finer level when its minute, hour or
+  * day comes up (cascade). Occupancy bitmaps give the next non-empty slot
+  * directly, and only that epoch is programmed into the RTC alarm.
+  *
+  *   STM32LIBS_WHEEL& wheel = STM32LIBS_WHEEL::getInstance();
+  *   wheel.begin();                                  // takes over the RTC alarm
+  *   int32_t id = wheel.every(300, callback, data);  // every 5 minutes
+  *   wheel.cancel(id);
+  *
+  * STM32LIBS_WHEEL and STM32LIBS_ALARMS both own the single RTC alarm, use
+  * one or the other.
+  ******************************************************************************
+  */
+
+#ifndef __STM32LIBS_WHEEL_H
+#define __STM32LIBS_WHEEL_H
+
+#include "STM32LIBS_RTC.h"
+
+// number of timers, override with -D RTC_MAX_WHEEL_TIMERS=n (max 32767)
+#ifndef RTC_MAX_WHEEL_TIMERS
+#define RTC_MAX_WHEEL_TIMERS    32
+#endif
+
+// timers moved or expired per service() call, override with -D RTC_WHEEL_STEPS=n
+#ifndef RTC_WHEEL_STEPS
+#define RTC_WHEEL_STEPS         32
+#endif
+
+#define RTC_TIMER_NONE          -1      // invalid timer id
+
+// timer id: pool slot | generation << 16, as in STM32LIBS_ALARMS
+#define RTC_TIMER_GEN_SHIFT     16
+#define RTC_TIMER_GEN_MASK      0x7FFF
+
+// wheel geometry: seconds, minutes, hours, days
+#define WHEEL_L0_SLOTS          60
+#define WHEEL_L1_SLOTS          60
+#define WHEEL_L2_SLOTS          24
+#define WHEEL_L3_SLOTS          64
+#define WHEEL_LEVELS            4
+#define WHEEL_OVERFLOW          WHEEL_LEVELS
+#define WHEEL_HEADS             (WHEEL_L0_SLOTS + WHEEL_L1_SLOTS + WHEEL_L2_SLOTS + WHEEL_L3_SLOTS + 2)
+
+class STM32LIBS_WHEEL {
+  public:
+    static STM32LIBS_WHEEL &getInstance()
+    {
+      static STM32LIBS_WHEEL instance;
+      return instance;
+    }
+
+    // attach to / release the RTC alarm interrupt
+    void begin(void);
+    void end(void);
+
+    // timer functions
+    int32_t every(uint32_t period, voidFuncPtr callback, void *data = nullptr, uint32_t first_epoch = 0);
+    int32_t at(uint32_t timer_epoch, voidFuncPtr callback, void *data = nullptr);
+    bool cancel(int32_t id);
+    void clear(void);
+
+    uint16_t count(void) { return _count; }
+    uint32_t nextEpoch(void);               // next slot or cascade to process, 0 if none
+
+    // process what is due up to the current RTC epoch, at most RTC_WHEEL_STEPS
+    // timers, and arm the next slot. Poll from loop() while it returns true
+    bool service(void);
+
+    // statistics
+    uint32_t fired;
+    uint32_t cascaded;                      // timers moved to a finer level
+    uint32_t rearms;
+
+  private:
+    STM32LIBS_WHEEL(void): fired(0), cascaded(0), rearms(0), _ovfSide(0), _active(false) { clear(); }
+
+    typedef struct {
+      uint32_t expires;                     // epoch of the next expiry
+      uint32_t period;                      // 0 = one shot
+      voidFuncPtr callback;
+      void *data;
+      uint16_t next;                        // slot list links (pool indexes)
+      uint16_t prev;
+      uint16_t head;                        // index in _heads, WHEEL_FREE if unused
+      uint16_t gen;                         // id generation, bumped when freed
+    } wheel_timer_t;
+
+    static void _alarmISR(void *data);
+    int32_t _add(uint32_t expires, uint32_t period, voidFuncPtr callback, void *data);
+    void _release(uint16_t t);
+    void _place(uint16_t t);
+    void _link(uint16_t t, uint16_t head);
+    void _unlink(uint16_t t);
+    uint8_t _step(uint32_t now, voidFuncPtr *callback, void **data);
+    bool _arm(bool more);
+
+    wheel_timer_t _pool[RTC_MAX_WHEEL_TIMERS];
+    uint16_t _free[RTC_MAX_WHEEL_TIMERS];
+    uint16_t _heads[WHEEL_HEADS];           // slot list heads, all levels + two overflow lists
+    uint64_t _bits[WHEEL_LEVELS];           // non-empty slots per level
+    uint32_t _now;                          // wheel time, everything <= _now is done
+    uint32_t _overflowMin;                  // earliest expiry in the overflow list
+    uint32_t _armed;                        // epoch programmed in the RTC alarm
+    uint16_t _count;
+    uint16_t _freeCount;
+    uint8_t _ovfSide;                       // overflow list _place() fills, the other one is re-placed
+    bool _active;
+};
+
+#endif // __STM32LIBS_WHEEL_H
@@ -16,7 +16,7 @@
 STM32LIBS_RTC& rtc = STM32LIBS_RTC::getInstance();
 RTC_datetime_t datetime;
 RTC_datetime_t alarm_datetime;
-volatile bool alarmEvent = false;
+RTC_event_t events[4];
 uint8_t rtc_config_status;
 uint16_t user_data[10];
 
@@ -39,7 +39,6 @@ void alarmMatch(void *data)
     if (sec == 0)
       sec = 1;
   }
-  alarmEvent = true;
   ts = rtc.getEpoch() + sec;
   rtc.setAlarmFromEpoch(ts);
 }
@@ -81,6 +80,12 @@ void setup()
   **/
   rtc.attachInterrupt(alarmMatch, &atime);    // the second arg can pass data to alarm callback
 
+  /**
+  ** queue alarm events for loop(), nothing is lost if several alarms
+  ** fire between two passes of loop()
+  **/
+  rtc.enableEvents(RTC_EVENT_MASK(RTC_EVENT_ALARM));
+
   /**
   ** set a relative alarm using the current epoch + 'n' seconds
   **/
@@ -112,40 +117,29 @@ void setup()
 void loop()
 {
   static uint8_t i;
+  uint16_t n;
+  char line[RTC_DATETIME_STR_MAX];
+
+  /**
+  ** finish the clock start begin() left running: the RTC switches to the
+  ** LSE crystal (or the LSI fallback) here, the alarm only fires after it
+  **/
+  rtc.serviceClock();
 
   for(i=0; i<10; i++)
   {
     user_data[i] = 0x0;
   }
   rtc.getDateTime(&datetime);
-  Serial.print("Time(hms) ");
-  Serial.print(datetime.hours);
-  Serial.print(":");
-  Serial.print(datetime.minutes);
-  Serial.print(":");  
-  Serial.print(datetime.seconds);
-  if(datetime.hour_format == RTC_HOUR_FORMAT_12)
-  {
-    if(datetime.am_pm == RTC_HOUR_AM)
-      Serial.print(" AM");
-    else
-      Serial.print(" PM");
-  }
+  n = rtc.getDateTimeStr(line, sizeof(line), &datetime, DT_FORMAT_LONG);   // "Monday, June 22, 2020 08:39:00 AM"
+  Serial.write(line, n);
   Serial.println("");
 
-  Serial.print("Date(DMY) ");
-  Serial.print(rtc.getWeekdayName(datetime.weekday));
-  Serial.print(", ");
-  Serial.print(rtc.getMonthName(datetime.month));
-  Serial.print(" ");
-  Serial.print(datetime.day);
-  Serial.print(", ");
-  Serial.println(datetime.year);
-
-  if(alarmEvent)
+  n = rtc.readEvents(events, 4);
+  for(i=0; i<n; i++)
   {
-    Serial.println(">>>>> Alarm Event!!!!!!!!!!!");
-    alarmEvent = false;
+    Serial.print(">>>>> Alarm Event!!!!!!!!!!! epoch= ");
+    Serial.println(events[i].epoch);
   }
 
   // print debug stuff